@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "NaturalLIIO.h"
+#include "SynSearch.h"
+#include "Graph.h"
+#include "Utils.h"
+
+using namespace std;
+
+/**
+ * A single example from a perfcase file: a number of premises, and a
+ * hypothesis.
+ */
+struct perfcase_example {
+  vector<Tree*> premises;
+  const Tree* hypothesis;
+};
+
+/**
+ * Read a perfcase file (e.g., test/data/perfcase_rte3dev.examples),
+ * annotating every premise and hypothesis with the preprocessor.
+ * Examples are separated by blank lines; lines starting with '#' are
+ * comments, and the last line of each block is the hypothesis, optionally
+ * prefixed by its expected truth (e.g., "TRUE: ").
+ */
+vector<perfcase_example> readPerfcase(const char* path, const JavaBridge* proc) {
+  vector<perfcase_example> examples;
+  ifstream in(path);
+  if (!in.is_open()) {
+    fprintf(stderr, "Could not open perfcase file: %s\n", path);
+    exit(1);
+  }
+  vector<string> lines;
+  string line;
+  while (true) {
+    bool eof = !getline(in, line);
+    if (!eof && line.length() > 0 && line[0] != '#') {
+      lines.push_back(line);
+      continue;
+    }
+    if (!eof && line.length() > 0) { continue; }  // comment
+    if (lines.size() > 1) {
+      perfcase_example example;
+      // (hypothesis)
+      string query = lines.back();
+      size_t colon = query.find(": ");
+      if (colon != string::npos && colon < 8) {
+        query = query.substr(colon + 2);
+      }
+      example.hypothesis = proc->annotateQuery(query.c_str());
+      // (premises)
+      for (uint32_t i = 0; i < lines.size() - 1; ++i) {
+        vector<Tree*> trees = proc->annotatePremise(lines[i].c_str());
+        example.premises.insert(example.premises.end(), trees.begin(), trees.end());
+      }
+      if (example.hypothesis != NULL) {
+        examples.push_back(example);
+      }
+    }
+    lines.clear();
+    if (eof) { break; }
+  }
+  return examples;
+}
+
+/**
+ * Benchmark Tree::alignToPremise() over the premises of a perfcase file.
+ * This reports the time taken to align each hypothesis to each of its
+ * premises, both from scratch and re-using the hypothesis' token table
+ * across premises (as executeQuery() does).
+ *
+ * Usage: align_benchmark <perfcase_file> [iterations]
+ */
+int32_t main( int32_t argc, char *argv[] ) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <perfcase_file> [iterations]\n", argv[0]);
+    return 1;
+  }
+  const uint32_t iterations = argc > 2 ? atoi(argv[2]) : 100;
+
+  // Load the data
+  JavaBridge* proc = new JavaBridge();
+  Graph* graph = ReadGraph();
+  printTime("[%c] ");
+  fprintf(stderr, "Annotating %s...\n", argv[1]);
+  vector<perfcase_example> examples = readPerfcase(argv[1], proc);
+  uint64_t numAlignments = 0;
+  for (auto iter = examples.begin(); iter != examples.end(); ++iter) {
+    numAlignments += iter->premises.size();
+  }
+  printTime("[%c] ");
+  fprintf(stderr, "Read %lu examples (%lu premise trees)\n",
+      examples.size(), numAlignments);
+  if (numAlignments == 0) {
+    return 1;
+  }
+  numAlignments *= iterations;
+
+  // Run the benchmark
+  // (from scratch)
+  uint64_t checksum = 0;
+  auto start = chrono::steady_clock::now();
+  for (uint32_t iter = 0; iter < iterations; ++iter) {
+    for (auto ex = examples.begin(); ex != examples.end(); ++ex) {
+      for (auto premise = ex->premises.begin(); premise != ex->premises.end(); ++premise) {
+        AlignmentSimilarity alignment = ex->hypothesis->alignToPremise(**premise, *graph);
+        checksum += alignment.asVector().size();
+      }
+    }
+  }
+  const double fromScratchNanos =
+    chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+  // (with a shared hypothesis table)
+  start = chrono::steady_clock::now();
+  for (uint32_t iter = 0; iter < iterations; ++iter) {
+    for (auto ex = examples.begin(); ex != examples.end(); ++ex) {
+      const alignment_token_table hypothesisTokens(*ex->hypothesis, *graph);
+      for (auto premise = ex->premises.begin(); premise != ex->premises.end(); ++premise) {
+        AlignmentSimilarity alignment = Tree::alignToPremise(
+            hypothesisTokens, alignment_token_table(**premise, *graph));
+        checksum += alignment.asVector().size();
+      }
+    }
+  }
+  const double sharedNanos =
+    chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+  // Report
+  printTime("[%c] ");
+  fprintf(stderr, "%lu alignments (checksum %lu)\n", numAlignments, checksum);
+  printf("from_scratch:        %.1f ns/alignment\n", fromScratchNanos / numAlignments);
+  printf("shared_hypothesis:   %.1f ns/alignment\n", sharedNanos / numAlignments);
+
+  // Clean up
+  for (auto ex = examples.begin(); ex != examples.end(); ++ex) {
+    for (auto premise = ex->premises.begin(); premise != ex->premises.end(); ++premise) {
+      delete *premise;
+    }
+    delete ex->hypothesis;
+  }
+  delete proc;
+  return 0;
+}
@@ -2,13 +2,1265 @@
 
 #include "Utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace btree;
 
 #define CHUNK_SIZE 1048576
 
+/** The number of zeros in the high bits of an EliasFanoFactDB between samples */
+#define EF_ZERO_SAMPLE_RATE 256
+
+/** The number of facts FactDB::lookupBatch() overrides probe together */
+#define KB_LOOKUP_BATCH 64
+
+/** A failed merge of a MutableFactDB is retried after at most 2^this seconds */
+#define KB_MERGE_MAX_BACKOFF 6
+
+/** The size of the pages of a knowledge base file a TieredFactDB reads */
+#define KB_PAGE_SIZE 4096
+
+/** The first bytes of a sorted knowledge base: "NLKB" */
+#define KB_MAGIC   0x424B4C4E
+#define KB_VERSION 1
+/** The kb_header flag marking a knowledge base with counts */
+#define KB_FLAG_COUNTS 1
+/** The largest count stored for a fact */
+#define KB_MAX_COUNT 65535
+
+//
+// The checksum of a sequence of facts (FNV-1a, a fact at a time)
+//
+inline uint64_t checksumFacts(const uint64_t* facts, const uint64_t& count) {
+  uint64_t checksum = 0xcbf29ce484222325;
+  for (uint64_t i = 0; i < count; ++i) {
+    checksum ^= facts[i];
+    checksum *= 0x100000001b3;
+  }
+  return checksum;
+}
+
+/** The range below which interpolation search switches to bisection */
+#define INTERPOLATION_MIN_RANGE 16
+/** The number of interpolation steps before giving up on the facts being uniform */
+#define INTERPOLATION_MAX_STEPS 8
+
+//
+// interpolationIndex()
+//
+uint64_t interpolationIndex(const uint64_t* facts, const uint64_t& count,
+                            const uint64_t& fact) {
+  if (count == 0) { return count; }
+  uint64_t lo = 0;
+  uint64_t hi = count - 1;
+  for (uint32_t step = 0; step < INTERPOLATION_MAX_STEPS; ++step) {
+    if (fact < facts[lo] || fact > facts[hi]) { return count; }
+    if (hi - lo < INTERPOLATION_MIN_RANGE) { break; }
+    // (facts are distinct, so facts[hi] > facts[lo] here)
+    const uint64_t guess = lo + (uint64_t)
+      (((unsigned __int128) (fact - facts[lo]) * (hi - lo)) / (facts[hi] - facts[lo]));
+    if (facts[guess] < fact) {
+      lo = guess + 1;
+    } else if (facts[guess] > fact) {
+      hi = guess - 1;  // (guess > lo, as facts[lo] <= fact)
+    } else {
+      return guess;
+    }
+  }
+  if (lo > hi) { return count; }
+  const uint64_t* found = std::lower_bound(facts + lo, facts + hi + 1, fact);
+  return (found != facts + hi + 1 && *found == fact) ? found - facts : count;
+}
+
+//
+// Fill the Eytzinger tree rooted at node with the sorted facts, from the
+// given index on; returns the index of the next fact to place.
+//
+uint64_t fillEytzinger(const uint64_t* facts, const uint64_t& count,
+                       uint64_t* tree, const uint64_t& node, uint64_t next) {
+  if (node <= count) {
+    next = fillEytzinger(facts, count, tree, 2 * node, next);
+    tree[node] = facts[next];
+    next += 1;
+    next = fillEytzinger(facts, count, tree, 2 * node + 1, next);
+  }
+  return next;
+}
+
+//
+// Call the callback on the facts of the Eytzinger tree rooted at node, in
+// sorted order.
+//
+void walkEytzinger(const uint64_t* tree, const uint64_t& count, const uint64_t& node,
+                   const std::function<void(const uint64_t&, const uint32_t&)>& callback) {
+  if (node <= count) {
+    walkEytzinger(tree, count, 2 * node, callback);
+    callback(tree[node], 1);
+    walkEytzinger(tree, count, 2 * node + 1, callback);
+  }
+}
+
+//
+// FactDB::forEachSorted()
+//
+void FactDB::forEachSorted(
+    const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+  vector<uint64_t> facts;
+  facts.reserve(size());
+  forEach([&facts](const uint64_t& fact) -> void { facts.push_back(fact); });
+  sortUniqueFacts(&facts, 0);
+  for (auto iter = facts.begin(); iter != facts.end(); ++iter) {
+    callback(*iter, count(*iter));
+  }
+}
+
+//
+// StaticFactDB::StaticFactDB()
+//
+StaticFactDB::StaticFactDB(const uint64_t* facts, const uint64_t& count,
+                           const kb_layout& layout)
+    : facts(facts), count(count), indexLayout(layout), tree(NULL) {
+  if (layout == KB_LAYOUT_EYTZINGER) {
+    // (cache line aligned, so that the descendants of a node three levels
+    //  down share a line)
+    void* memory = NULL;
+    if (posix_memalign(&memory, 64, (count + 1) * sizeof(uint64_t)) != 0) {
+      fprintf(stderr, "Could not allocate the KB index (%lu facts)\n", count);
+      exit(1);
+    }
+    tree = (uint64_t*) memory;
+    tree[0] = 0;
+    fillEytzinger(facts, count, tree, 1, 0);
+    this->facts = NULL;
+  }
+}
+
+//
+// StaticFactDB::~StaticFactDB()
+//
+StaticFactDB::~StaticFactDB() {
+  if (tree != NULL) { free(tree); }
+}
+
+//
+// StaticFactDB::contains()
+//
+bool StaticFactDB::contains(const uint64_t& fact) const {
+  switch (indexLayout) {
+    case KB_LAYOUT_SORTED:
+      return std::binary_search(facts, facts + count, fact);
+    case KB_LAYOUT_INTERPOLATION:
+      return interpolationSearch(facts, count, fact);
+    case KB_LAYOUT_EYTZINGER: {
+      // (descend without branching on the comparison: left on <=, right on
+      //  >, prefetching the node's descendants three levels down)
+      uint64_t node = 1;
+      while (node <= count) {
+        __builtin_prefetch(tree + 8 * node);
+        node = 2 * node + (tree[node] < fact);
+      }
+      // (undo the right turns after the last left turn, to get to the
+      //  smallest fact >= the one looked for)
+      node >>= __builtin_ffsll(~node);
+      return node != 0 && tree[node] == fact;
+    }
+  }
+  return false;
+}
+
+//
+// StaticFactDB::lookupBatch()
+//
+void StaticFactDB::lookupBatch(const uint64_t* queries, const uint32_t& numQueries,
+                               bool* found, kb_lookup_stats* stats) const {
+  stats->lookups += numQueries;
+  stats->filterHits += numQueries;
+  if (tree == NULL) {
+    // (fetch where each fact would be if the facts were uniform, as the
+    //  first step of an interpolation search guesses, for every fact)
+    for (uint32_t i = 0; i < numQueries; ++i) {
+      __builtin_prefetch(facts + (uint64_t) (((unsigned __int128) queries[i] * count) >> 64));
+    }
+    for (uint32_t i = 0; i < numQueries; ++i) { found[i] = contains(queries[i]); }
+    return;
+  }
+  uint64_t nodes[KB_LOOKUP_BATCH];
+  for (uint32_t begin = 0; begin < numQueries; begin += KB_LOOKUP_BATCH) {
+    const uint32_t size = min((uint32_t) KB_LOOKUP_BATCH, numQueries - begin);
+    const uint64_t* batch = queries + begin;
+    // (every fact descends as contains() does; all of them reach the
+    //  bottom of the tree within a level of each other)
+    for (uint32_t i = 0; i < size; ++i) { nodes[i] = 1; }
+    bool descending = count > 0;
+    while (descending) {
+      descending = false;
+      for (uint32_t i = 0; i < size; ++i) {
+        if (nodes[i] <= count) {
+          __builtin_prefetch(tree + 8 * nodes[i]);
+          nodes[i] = 2 * nodes[i] + (tree[nodes[i]] < batch[i]);
+          descending = true;
+        }
+      }
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      const uint64_t node = nodes[i] >> __builtin_ffsll(~nodes[i]);
+      found[begin + i] = node != 0 && tree[node] == batch[i];
+    }
+  }
+}
+
+//
+// StaticFactDB::forEach()
+//
+void StaticFactDB::forEach(const std::function<void(const uint64_t&)>& callback) const {
+  const uint64_t* begin = tree != NULL ? tree + 1 : facts;
+  for (uint64_t i = 0; i < count; ++i) { callback(begin[i]); }
+}
+
+//
+// StaticFactDB::forEachSorted()
+//
+void StaticFactDB::forEachSorted(
+    const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+  if (tree != NULL) {
+    walkEytzinger(tree, count, 1, callback);
+  } else {
+    for (uint64_t i = 0; i < count; ++i) { callback(facts[i], 1); }
+  }
+}
+
+//
+// EliasFanoFactDB::EliasFanoFactDB()
+//
+EliasFanoFactDB::EliasFanoFactDB(const uint64_t* facts, const uint64_t& count)
+    : count(count) {
+  // Split the facts, leaving around as many buckets as facts
+  // (the high bits number ceil(log2(count)), but at least one)
+  const uint32_t highBits = count <= 2 ? 1 : 64 - __builtin_clzll(count - 1);
+  lowBits = 64 - highBits;
+  numBuckets = ((uint64_t) 1) << highBits;
+
+  // Write the low bits
+  const uint64_t numLowWords = (count * lowBits + 63) / 64 + 1;
+  lows = (uint64_t*) malloc(numLowWords * sizeof(uint64_t));
+  memset(lows, 0, numLowWords * sizeof(uint64_t));
+  const uint64_t lowMask = (((uint64_t) 1) << lowBits) - 1;
+  for (uint64_t i = 0; i < count; ++i) {
+    const uint64_t bit = i * lowBits;
+    const uint64_t offset = bit & 63;
+    const uint64_t low = facts[i] & lowMask;
+    lows[bit >> 6] |= low << offset;
+    if (offset + lowBits > 64) { lows[(bit >> 6) + 1] |= low >> (64 - offset); }
+  }
+
+  // Write the high bits
+  const uint64_t numHighBits = count + numBuckets;
+  numHighWords = (numHighBits + 63) / 64;
+  highs = (uint64_t*) malloc(numHighWords * sizeof(uint64_t));
+  memset(highs, 0, numHighWords * sizeof(uint64_t));
+  for (uint64_t i = 0; i < count; ++i) {
+    const uint64_t bit = (facts[i] >> lowBits) + i;
+    highs[bit >> 6] |= ((uint64_t) 1) << (bit & 63);
+  }
+
+  // Sample the zeros
+  numZeroSamples = (numBuckets + EF_ZERO_SAMPLE_RATE - 1) / EF_ZERO_SAMPLE_RATE;
+  zeroSamples = (uint64_t*) malloc(numZeroSamples * sizeof(uint64_t));
+  uint64_t numZeros = 0;
+  for (uint64_t bit = 0; bit < numHighBits; ++bit) {
+    if ((highs[bit >> 6] & (((uint64_t) 1) << (bit & 63))) != 0) { continue; }
+    if (numZeros % EF_ZERO_SAMPLE_RATE == 0) {
+      zeroSamples[numZeros / EF_ZERO_SAMPLE_RATE] = bit;
+    }
+    numZeros += 1;
+  }
+}
+
+//
+// EliasFanoFactDB::~EliasFanoFactDB()
+//
+EliasFanoFactDB::~EliasFanoFactDB() {
+  free(lows);
+  free(highs);
+  free(zeroSamples);
+}
+
+//
+// EliasFanoFactDB::selectZero()
+//
+uint64_t EliasFanoFactDB::selectZero(const uint64_t& k) const {
+  uint64_t position = zeroSamples[k / EF_ZERO_SAMPLE_RATE];
+  uint64_t remaining = k % EF_ZERO_SAMPLE_RATE;
+  if (remaining == 0) { return position; }
+  // Count zeros a word at a time from the sample
+  position += 1;
+  uint64_t wordI = position >> 6;
+  uint64_t zeros = ~highs[wordI] & (~((uint64_t) 0) << (position & 63));
+  while (true) {
+    const uint64_t numZeros = __builtin_popcountll(zeros);
+    if (numZeros >= remaining) { break; }
+    remaining -= numZeros;
+    wordI += 1;
+    zeros = ~highs[wordI];
+  }
+  // Find the zero within the word
+  for (uint64_t i = 1; i < remaining; ++i) { zeros &= zeros - 1; }
+  return (wordI << 6) + __builtin_ctzll(zeros);
+}
+
+//
+// EliasFanoFactDB::contains()
+//
+bool EliasFanoFactDB::contains(const uint64_t& fact) const {
+  if (count == 0) { return false; }
+  const uint64_t high = fact >> lowBits;
+  const uint64_t low = fact & ((((uint64_t) 1) << lowBits) - 1);
+  // The facts with these high bits follow the zero closing the previous bucket
+  return bucketContains(bucketStart(high), high, low);
+}
+
+//
+// EliasFanoFactDB::bucketContains()
+//
+bool EliasFanoFactDB::bucketContains(uint64_t bit, const uint64_t& high,
+                                     const uint64_t& low) const {
+  uint64_t index = bit - high;
+  while ((highs[bit >> 6] & (((uint64_t) 1) << (bit & 63))) != 0) {
+    const uint64_t candidate = lowAt(index);
+    if (candidate == low) { return true; }
+    if (candidate > low) { return false; }
+    bit += 1;
+    index += 1;
+  }
+  return false;
+}
+
+//
+// EliasFanoFactDB::lookupBatch()
+//
+void EliasFanoFactDB::lookupBatch(const uint64_t* queries, const uint32_t& numQueries,
+                                  bool* found, kb_lookup_stats* stats) const {
+  stats->lookups += numQueries;
+  stats->filterHits += numQueries;
+  if (count == 0) {
+    for (uint32_t i = 0; i < numQueries; ++i) { found[i] = false; }
+    return;
+  }
+  const uint64_t lowMask = (((uint64_t) 1) << lowBits) - 1;
+  uint64_t bits[KB_LOOKUP_BATCH];
+  for (uint32_t begin = 0; begin < numQueries; begin += KB_LOOKUP_BATCH) {
+    const uint32_t size = min((uint32_t) KB_LOOKUP_BATCH, numQueries - begin);
+    const uint64_t* batch = queries + begin;
+    // (fetch the zero samples the buckets are found from, then the start of
+    //  each bucket in the high bits and the low bits, and only then compare)
+    for (uint32_t i = 0; i < size; ++i) {
+      const uint64_t high = batch[i] >> lowBits;
+      if (high > 0) { __builtin_prefetch(zeroSamples + (high - 1) / EF_ZERO_SAMPLE_RATE); }
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      const uint64_t high = batch[i] >> lowBits;
+      bits[i] = bucketStart(high);
+      __builtin_prefetch(highs + (bits[i] >> 6));
+      __builtin_prefetch(lows + (((bits[i] - high) * lowBits) >> 6));
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      found[begin + i] = bucketContains(bits[i], batch[i] >> lowBits, batch[i] & lowMask);
+    }
+  }
+}
+
+//
+// EliasFanoFactDB::forEach()
+//
+void EliasFanoFactDB::forEach(const std::function<void(const uint64_t&)>& callback) const {
+  uint64_t index = 0;
+  for (uint64_t wordI = 0; wordI < numHighWords; ++wordI) {
+    uint64_t ones = highs[wordI];
+    while (ones != 0) {
+      const uint64_t bit = (wordI << 6) + __builtin_ctzll(ones);
+      const uint64_t high = bit - index;
+      callback((high << lowBits) | lowAt(index));
+      index += 1;
+      ones &= ones - 1;
+    }
+  }
+}
+
+//
+// EliasFanoFactDB::bytesUsed()
+//
+uint64_t EliasFanoFactDB::bytesUsed() const {
+  return ((count * lowBits + 63) / 64 + 1 + numHighWords + numZeroSamples) * sizeof(uint64_t);
+}
+
+//
+// BloomFactDB::BloomFactDB()
+//
+BloomFactDB::BloomFactDB(const FactDB* kb, const bool& owned,
+                         const uint32_t& bitsPerFact)
+    : kb(kb), owned(owned) {
+  // Size the filter
+  blockCount = (kb->size() * bitsPerFact + 511) / 512;
+  if (blockCount == 0) { blockCount = 1; }
+  numHashes = (uint32_t) (bitsPerFact * log(2.0) + 0.5);
+  if (numHashes < 1) { numHashes = 1; }
+  if (numHashes > 16) { numHashes = 16; }
+  void* memory = NULL;
+  if (posix_memalign(&memory, 64, blockCount * 64) != 0) {
+    fprintf(stderr, "Could not allocate the KB Bloom filter (%lu blocks)\n", blockCount);
+    exit(1);
+  }
+  blocks = (uint64_t*) memory;
+  memset(blocks, 0, blockCount * 64);
+  // Add the facts
+  kb->forEach([this](const uint64_t& fact) -> void {
+    uint64_t* block = blocks + 8 * blockIndex(fact);
+    const uint64_t probe = probeHash(fact);
+    const uint32_t first = probe & 511;
+    const uint32_t step = ((probe >> 9) & 511) | 1;
+    for (uint32_t i = 0; i < numHashes; ++i) {
+      const uint32_t bit = (first + i * step) & 511;
+      block[bit >> 6] |= ((uint64_t) 1) << (bit & 63);
+    }
+  });
+}
+
+//
+// BloomFactDB::lookupBatch()
+//
+void BloomFactDB::lookupBatch(const uint64_t* queries, const uint32_t& numQueries,
+                              bool* found, kb_lookup_stats* stats) const {
+  uint64_t passed[KB_LOOKUP_BATCH];
+  uint32_t passedIndex[KB_LOOKUP_BATCH];
+  bool passedFound[KB_LOOKUP_BATCH];
+  for (uint32_t begin = 0; begin < numQueries; begin += KB_LOOKUP_BATCH) {
+    const uint32_t size = min((uint32_t) KB_LOOKUP_BATCH, numQueries - begin);
+    const uint64_t* batch = queries + begin;
+    for (uint32_t i = 0; i < size; ++i) {
+      __builtin_prefetch(blocks + 8 * blockIndex(batch[i]));
+    }
+    uint32_t numPassed = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      found[begin + i] = false;
+      if (mayContain(batch[i])) {
+        passed[numPassed] = batch[i];
+        passedIndex[numPassed] = begin + i;
+        numPassed += 1;
+      }
+    }
+    stats->lookups += size;
+    stats->filterHits += numPassed;
+    kb_lookup_stats kbStats;
+    kb->lookupBatch(passed, numPassed, passedFound, &kbStats);
+    stats->diskVerifications += kbStats.diskVerifications;
+    for (uint32_t i = 0; i < numPassed; ++i) { found[passedIndex[i]] = passedFound[i]; }
+  }
+}
+
+//
+// BloomFactDB::~BloomFactDB()
+//
+BloomFactDB::~BloomFactDB() {
+  free(blocks);
+  if (owned) { delete kb; }
+}
+
+//
+// BloomFactDB::falsePositiveRate()
+//
+double BloomFactDB::falsePositiveRate(const uint64_t& numProbes) const {
+  mt19937_64 random(42);
+  uint64_t numMisses = 0;
+  uint64_t numFalsePositives = 0;
+  for (uint64_t i = 0; i < numProbes; ++i) {
+    const uint64_t fact = random();
+    if (kb->contains(fact)) { continue; }
+    numMisses += 1;
+    if (mayContain(fact)) { numFalsePositives += 1; }
+  }
+  return numMisses == 0 ? 0.0 : ((double) numFalsePositives) / ((double) numMisses);
+}
+
+//
+// MappedFactDB::MappedFactDB()
+//
+MappedFactDB::MappedFactDB(void* region, const uint64_t& regionSize,
+                           const uint32_t& minCount)
+    : region(region), regionSize(regionSize), minCount(minCount) {
+  header = (const kb_header*) region;
+  data = (const uint64_t*) (((const char*) region) + sizeof(kb_header));
+  counts = (header->flags & KB_FLAG_COUNTS) != 0
+    ? (const uint16_t*) (data + header->numFacts) : NULL;
+  numKept = header->numFacts;
+  if (counts != NULL && minCount > 1) {
+    for (uint64_t i = 0; i < header->numFacts; ++i) {
+      if (counts[i] < minCount) { numKept -= 1; }
+    }
+  }
+}
+
+//
+// MappedFactDB::~MappedFactDB()
+//
+MappedFactDB::~MappedFactDB() {
+  munmap(region, regionSize);
+}
+
+//
+// MappedFactDB::contains()
+//
+bool MappedFactDB::contains(const uint64_t& fact) const {
+  const uint64_t index = interpolationIndex(data, header->numFacts, fact);
+  return index < header->numFacts && keeps(index);
+}
+
+//
+// MappedFactDB::count()
+//
+uint32_t MappedFactDB::count(const uint64_t& fact) const {
+  const uint64_t index = interpolationIndex(data, header->numFacts, fact);
+  if (index == header->numFacts || !keeps(index)) { return 0; }
+  return countAt(index);
+}
+
+//
+// MappedFactDB::adviseRandomAccess()
+//
+void MappedFactDB::adviseRandomAccess() const {
+  madvise(region, regionSize, MADV_RANDOM);
+}
+
+//
+// MappedFactDB::verify()
+//
+bool MappedFactDB::verify() const {
+  uint64_t checksum = checksumFacts(data, header->numFacts);
+  if (counts != NULL) {
+    for (uint64_t i = 0; i < header->numFacts; ++i) {
+      checksum = (checksum ^ counts[i]) * 0x100000001b3;
+    }
+  }
+  return checksum == header->checksum;
+}
+
+//
+// MappedFactDB::open()
+//
+MappedFactDB* MappedFactDB::open(const char* path, const uint32_t& minCount) {
+  const int fd = ::open(path, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(kb_header)) {
+    close(fd);
+    return NULL;
+  }
+  const uint64_t size = info.st_size;
+  void* region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) { return NULL; }
+  const kb_header* header = (const kb_header*) region;
+  const uint64_t bytesPerFact = sizeof(uint64_t) +
+    ((header->flags & KB_FLAG_COUNTS) != 0 ? sizeof(uint16_t) : 0);
+  if (header->magic != KB_MAGIC || header->version != KB_VERSION ||
+      header->hashScheme != KB_HASH_SCHEME ||
+      size != sizeof(kb_header) + header->numFacts * bytesPerFact) {
+    munmap(region, size);
+    return NULL;
+  }
+  return new MappedFactDB(region, size, minCount);
+}
+
+//
+// The index of the first fact which starts on the given page of a sorted
+// knowledge base file (following the header)
+//
+inline uint64_t firstFactOnPage(const uint64_t& page) {
+  if (page == 0) { return 0; }
+  return (page * KB_PAGE_SIZE - sizeof(kb_header) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+}
+
+//
+// TieredFactDB::TieredFactDB()
+//
+TieredFactDB::TieredFactDB(const MappedFactDB* store, const uint32_t& bitsPerFact)
+    : store(store) {
+  // Build the filter
+  filter = new BloomFactDB(store, false, bitsPerFact);
+  // Build the fence index
+  const uint64_t* facts = store->facts();
+  for (uint64_t page = 0; firstFactOnPage(page) < store->numInFile(); ++page) {
+    fences.push_back(facts[firstFactOnPage(page)]);
+  }
+  // From here on, the file is only read a page at a time
+  store->adviseRandomAccess();
+}
+
+//
+// TieredFactDB::~TieredFactDB()
+//
+TieredFactDB::~TieredFactDB() {
+  delete filter;
+  delete store;
+}
+
+//
+// TieredFactDB::storeContains()
+//
+bool TieredFactDB::storeContains(const uint64_t& fact) const {
+  const uint64_t page = std::upper_bound(fences.begin(), fences.end(), fact) - fences.begin();
+  if (page == 0) { return false; }  // (smaller than every fact)
+  const uint64_t* facts = store->facts();
+  const uint64_t* begin = facts + firstFactOnPage(page - 1);
+  const uint64_t* end = facts + min(firstFactOnPage(page), store->numInFile());
+  const uint64_t* found = std::lower_bound(begin, end, fact);
+  return found != end && *found == fact && store->keeps(found - facts);
+}
+
+//
+// sortFacts()
+//
+void sortFacts(vector<uint64_t>* facts, uint32_t numThreads) {
+  if (numThreads == 0) { numThreads = thread::hardware_concurrency(); }
+  if (numThreads == 0) { numThreads = 1; }
+  if (facts->size() < ((uint64_t) numThreads) * 65536) {
+    numThreads = 1;  // (not worth the threads)
+  }
+  uint64_t* data = facts->data();
+  // Sort a chunk per thread
+  vector<uint64_t> bounds(numThreads + 1);
+  for (uint32_t i = 0; i <= numThreads; ++i) {
+    bounds[i] = facts->size() * i / numThreads;
+  }
+  vector<thread> threads;
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    threads.push_back(thread([data, &bounds, i]() -> void {
+      std::sort(data + bounds[i], data + bounds[i + 1]);
+    }));
+  }
+  for (auto iter = threads.begin(); iter != threads.end(); ++iter) { iter->join(); }
+  // Merge neighboring chunks pairwise, in parallel, until one is left
+  for (uint32_t width = 1; width < numThreads; width *= 2) {
+    threads.clear();
+    for (uint32_t i = 0; i + width < numThreads; i += 2 * width) {
+      const uint64_t begin = bounds[i];
+      const uint64_t middle = bounds[i + width];
+      const uint64_t end = bounds[min(i + 2 * width, numThreads)];
+      threads.push_back(thread([data, begin, middle, end]() -> void {
+        std::inplace_merge(data + begin, data + middle, data + end);
+      }));
+    }
+    for (auto iter = threads.begin(); iter != threads.end(); ++iter) { iter->join(); }
+  }
+}
+
+//
+// sortUniqueFacts()
+//
+void sortUniqueFacts(vector<uint64_t>* facts, uint32_t numThreads) {
+  sortFacts(facts, numThreads);
+  facts->erase(std::unique(facts->begin(), facts->end()), facts->end());
+}
+
+//
+// keepFrequentFacts()
+//
+uint64_t keepFrequentFacts(vector<uint64_t>* facts, const uint32_t& minCount) {
+  uint64_t numKept = 0;
+  uint64_t numDropped = 0;
+  uint64_t* data = facts->data();
+  for (uint64_t begin = 0; begin < facts->size(); ) {
+    uint64_t end = begin + 1;
+    while (end < facts->size() && data[end] == data[begin]) { end += 1; }
+    if (end - begin >= minCount) {
+      data[numKept] = data[begin];
+      numKept += 1;
+    } else {
+      numDropped += 1;
+    }
+    begin = end;
+  }
+  facts->resize(numKept);
+  return numDropped;
+}
+
+//
+// bulkBuildKB()
+//
+btree_set<uint64_t>* bulkBuildKB(const vector<uint64_t>& facts) {
+  btree_set<uint64_t>* kb = new btree_set<uint64_t>();
+  for (auto iter = facts.begin(); iter != facts.end(); ++iter) {
+    kb->insert(kb->end(), *iter);
+  }
+  return kb;
+}
+
+//
+// drainIntoKB()
+//
+btree_set<uint64_t>* drainIntoKB(vector<uint64_t>* facts) {
+  btree_set<uint64_t>* kb = new btree_set<uint64_t>();
+  const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  const uint64_t* data = facts->data();
+  for (uint64_t begin = 0; begin < facts->size(); begin += CHUNK_SIZE) {
+    const uint64_t end = min(begin + CHUNK_SIZE, (uint64_t) facts->size());
+    for (uint64_t i = begin; i < end; ++i) {
+      kb->insert(kb->end(), data[i]);
+    }
+    // (release the whole pages of this chunk; they are never read again)
+    const uintptr_t from = ((uintptr_t) (data + begin) + pageSize - 1) / pageSize * pageSize;
+    const uintptr_t to = ((uintptr_t) (data + end)) / pageSize * pageSize;
+    if (to > from) {
+      madvise((void*) from, to - from, MADV_DONTNEED);
+    }
+  }
+  vector<uint64_t>().swap(*facts);
+  return kb;
+}
+
+//
+// DeltaFactDB::lookupBatch()
+//
+void DeltaFactDB::lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                              bool* found, kb_lookup_stats* stats) const {
+  uint64_t rest[KB_LOOKUP_BATCH];
+  uint32_t restIndex[KB_LOOKUP_BATCH];
+  bool restFound[KB_LOOKUP_BATCH];
+  for (uint32_t begin = 0; begin < numFacts; begin += KB_LOOKUP_BATCH) {
+    const uint32_t size = min((uint32_t) KB_LOOKUP_BATCH, numFacts - begin);
+    uint32_t numRest = 0;
+    for (uint32_t i = begin; i < begin + size; ++i) {
+      found[i] = delta->find(facts[i]) != delta->end();
+      if (found[i]) {
+        stats->lookups += 1;
+        stats->filterHits += 1;
+      } else {
+        rest[numRest] = facts[i];
+        restIndex[numRest] = i;
+        numRest += 1;
+      }
+    }
+    base->lookupBatch(rest, numRest, restFound, stats);
+    for (uint32_t i = 0; i < numRest; ++i) { found[restIndex[i]] = restFound[i]; }
+  }
+}
+
+//
+// DeltaFactDB::forEachSorted()
+//
+void DeltaFactDB::forEachSorted(
+    const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+  auto added = delta->begin();
+  base->forEachSorted([this, &added, &callback](const uint64_t& fact, const uint32_t& count) -> void {
+    while (added != delta->end() && *added < fact) {
+      callback(*added, 1);
+      ++added;
+    }
+    callback(fact, count);
+  });
+  for (; added != delta->end(); ++added) { callback(*added, 1); }
+}
+
+//
+// MutableFactDB::MutableFactDB()
+//
+MutableFactDB::MutableFactDB(const FactDB* base, const char* logPath,
+                             const uint64_t& mergeThreshold)
+    : numAdded(0), logPath(logPath), mergedPath(string(logPath) + ".merged"),
+      mergeThreshold(mergeThreshold), mergeCount(0), stopping(false) {
+  // Reopen the last merge, if there was one
+  // (the log was cut down to the facts added since)
+  struct stat info;
+  if (stat(mergedPath.c_str(), &info) == 0) {
+    delete base;
+    this->base = shared_ptr<const FactDB>(readKB(mergedPath, 1));
+    printTime("[%c] ");
+    fprintf(stderr, "Reopened the knowledge base merged into %s\n", mergedPath.c_str());
+  } else {
+    this->base = shared_ptr<const FactDB>(base);
+  }
+  // Replay the log
+  // (dropping a partly written fact at the end, if there is one)
+  btree_set<uint64_t>* delta = new btree_set<uint64_t>();
+  if (stat(logPath, &info) == 0 && info.st_size % sizeof(uint64_t) != 0) {
+    if (truncate(logPath, info.st_size - info.st_size % sizeof(uint64_t)) != 0) {
+      fprintf(stderr, "Can't truncate KB log %s!\n", logPath);
+      exit(1);
+    }
+  }
+  FILE* replay = fopen(logPath, "rb");
+  if (replay != NULL) {
+    vector<uint64_t> chunk(CHUNK_SIZE);
+    uint64_t numRead;
+    while ((numRead = fread(chunk.data(), sizeof(uint64_t), CHUNK_SIZE, replay)) > 0) {
+      for (uint64_t i = 0; i < numRead; ++i) {
+        if (!this->base->contains(chunk[i])) { delta->insert(chunk[i]); }
+      }
+    }
+    fclose(replay);
+  }
+  numAdded = delta->size();
+  if (delta->empty()) {
+    delete delta;
+  } else {
+    layers.push_back(shared_ptr<const btree_set<uint64_t> >(delta));
+  }
+  publish();
+  // Open the log
+  log = fopen(logPath, "ab");
+  if (log == NULL) {
+    fprintf(stderr, "Can't open KB log %s!\n", logPath);
+    exit(1);
+  }
+  // Start merging
+  merger = thread(&MutableFactDB::mergeLoop, this);
+}
+
+//
+// MutableFactDB::~MutableFactDB()
+//
+MutableFactDB::~MutableFactDB() {
+  {
+    lock_guard<mutex> lock(writeLock);
+    stopping = true;
+  }
+  mergeNeeded.notify_one();
+  merger.join();
+  fclose(log);
+}
+
+//
+// MutableFactDB::publish()
+//
+void MutableFactDB::publish() const {
+  shared_ptr<const FactDB> kb = base;
+  for (auto layer = layers.begin(); layer != layers.end(); ++layer) {
+    kb = make_shared<const DeltaFactDB>(kb, *layer);
+  }
+  atomic_store(&current, kb);
+}
+
+//
+// MutableFactDB::add()
+//
+uint64_t MutableFactDB::add(const vector<uint64_t>& facts) const {
+  vector<uint64_t> toAdd(facts);
+  std::sort(toAdd.begin(), toAdd.end());
+  toAdd.erase(std::unique(toAdd.begin(), toAdd.end()), toAdd.end());
+  lock_guard<mutex> lock(writeLock);
+  // Find the new facts
+  const shared_ptr<const FactDB> snapshot = atomic_load(&current);
+  vector<uint64_t> added;
+  for (auto iter = toAdd.begin(); iter != toAdd.end(); ++iter) {
+    if (!snapshot->contains(*iter)) { added.push_back(*iter); }
+  }
+  if (added.empty()) { return 0; }
+  // Log them
+  if (fwrite(added.data(), sizeof(uint64_t), added.size(), log) != added.size() ||
+      fflush(log) != 0) {
+    fprintf(stderr, "WARNING: could not write to the KB log; added facts will be lost on restart\n");
+  }
+  // Publish them, as a new layer
+  // (merged with the layers before it which are no larger, so there are
+  //  O(log(delta)) layers, and a fact is copied O(log(delta)) times)
+  vector<uint64_t> layer(added);
+  while (!layers.empty() && (uint64_t) layers.back()->size() <= layer.size()) {
+    vector<uint64_t> merged;
+    merged.reserve(layer.size() + layers.back()->size());
+    std::merge(layer.begin(), layer.end(), layers.back()->begin(), layers.back()->end(),
+               back_inserter(merged));
+    layer.swap(merged);
+    layers.pop_back();
+  }
+  layers.push_back(shared_ptr<const btree_set<uint64_t> >(bulkBuildKB(layer)));
+  publish();
+  numAdded += added.size();
+  if (numAdded >= mergeThreshold) { mergeNeeded.notify_one(); }
+  return added.size();
+}
+
+//
+// MutableFactDB::merge()
+//
+bool MutableFactDB::merge() const {
+  lock_guard<mutex> merging(mergeLock);
+  shared_ptr<const FactDB> snapshot;
+  vector<shared_ptr<const btree_set<uint64_t> > > mergingLayers;
+  uint64_t numMerging;
+  {
+    lock_guard<mutex> lock(writeLock);
+    snapshot = atomic_load(&current);
+    mergingLayers = layers;
+    numMerging = numAdded;
+  }
+  if (numMerging == 0) { return true; }
+  // Write the merged knowledge base, and read it back
+  // (without holding writeLock; facts can be added all the while. It is
+  //  written to a temporary file, as the last merge may still be mapped)
+  const string writingPath = mergedPath + ".tmp";
+  KBWriter* writer = KBWriter::open(writingPath.c_str());
+  bool ok = (writer != NULL);
+  if (ok) {
+    snapshot->forEachSorted([writer](const uint64_t& fact, const uint32_t& count) -> void {
+      writer->add(fact, count);
+    });
+    ok = writer->close();
+    delete writer;
+  }
+  ok = ok && rename(writingPath.c_str(), mergedPath.c_str()) == 0;
+  if (!ok) {
+    unlink(writingPath.c_str());
+    printTime("[%c] ");
+    fprintf(stderr, "WARNING: could not write the merged knowledge base to %s; not merging\n",
+            mergedPath.c_str());
+    return false;
+  }
+  const shared_ptr<const FactDB> merged(readKB(mergedPath, 1));
+  // Publish it, along with the facts added since the merge started
+  // (a layer which was merged is still there, unless it was merged with a
+  //  newer layer since)
+  lock_guard<mutex> lock(writeLock);
+  btree_set<uint64_t>* remaining = new btree_set<uint64_t>();
+  for (auto layer = layers.begin(); layer != layers.end(); ++layer) {
+    if (std::find(mergingLayers.begin(), mergingLayers.end(), *layer) != mergingLayers.end()) {
+      continue;
+    }
+    for (auto iter = (*layer)->begin(); iter != (*layer)->end(); ++iter) {
+      bool wasMerged = false;
+      for (auto old = mergingLayers.begin(); old != mergingLayers.end() && !wasMerged; ++old) {
+        wasMerged = (*old)->find(*iter) != (*old)->end();
+      }
+      if (!wasMerged) { remaining->insert(*iter); }
+    }
+  }
+  base = merged;
+  layers.clear();
+  numAdded = remaining->size();
+  if (remaining->empty()) {
+    delete remaining;
+  } else {
+    layers.push_back(shared_ptr<const btree_set<uint64_t> >(remaining));
+  }
+  publish();
+  mergeCount += 1;
+  printTime("[%c] ");
+  fprintf(stderr, "Merged %lu added facts into the knowledge base; KB size=%lu\n",
+          numMerging, merged->size());
+  // Cut the log down to the facts which were not merged
+  // (if this fails, the merged facts are replayed, and found in the merge)
+  const string rewritingPath = logPath + ".tmp";
+  FILE* rewritten = fopen(rewritingPath.c_str(), "wb");
+  bool logged = (rewritten != NULL);
+  for (auto layer = layers.begin(); logged && layer != layers.end(); ++layer) {
+    for (auto iter = (*layer)->begin(); logged && iter != (*layer)->end(); ++iter) {
+      logged = fwrite(&*iter, sizeof(uint64_t), 1, rewritten) == 1;
+    }
+  }
+  if (rewritten != NULL) { logged = (fclose(rewritten) == 0) && logged; }
+  logged = logged && rename(rewritingPath.c_str(), logPath.c_str()) == 0;
+  if (!logged) {
+    unlink(rewritingPath.c_str());
+    printTime("[%c] ");
+    fprintf(stderr, "WARNING: could not cut down the KB log %s; it is replayed in full\n",
+            logPath.c_str());
+    return true;
+  }
+  fclose(log);
+  log = fopen(logPath.c_str(), "ab");
+  if (log == NULL) {
+    fprintf(stderr, "Can't open KB log %s!\n", logPath.c_str());
+    exit(1);
+  }
+  return true;
+}
+
+//
+// MutableFactDB::mergeLoop()
+//
+void MutableFactDB::mergeLoop() {
+  unique_lock<mutex> lock(writeLock);
+  uint32_t numFailures = 0;
+  while (!stopping) {
+    if (numAdded >= mergeThreshold) {
+      lock.unlock();
+      const bool merged = merge();
+      lock.lock();
+      if (merged) {
+        numFailures = 0;
+      } else {
+        // Wait before trying again, twice as long after each failure in a row
+        // (adding facts wakes this thread, so wait until a deadline)
+        numFailures += 1;
+        const auto retry = chrono::steady_clock::now() + chrono::seconds(
+            ((uint64_t) 1) << min(numFailures - 1, (uint32_t) KB_MERGE_MAX_BACKOFF));
+        while (!stopping && mergeNeeded.wait_until(lock, retry) == cv_status::no_timeout) { }
+      }
+    } else {
+      mergeNeeded.wait(lock);
+    }
+  }
+}
+
+//
+// openKBLog()
+//
+const FactDB* openKBLog(const FactDB* kb) {
+  if (KB_LOG_FILE[0] == '\0') {
+    return kb;
+  }
+  const MutableFactDB* mutableKB = new MutableFactDB(kb, KB_LOG_FILE, KB_MERGE_THRESHOLD);
+  printTime("[%c] ");
+  fprintf(stderr, "Logging added facts to %s (%lu replayed)\n",
+          KB_LOG_FILE, mutableKB->deltaSize());
+  return mutableKB;
+}
+
+//
+// KBWriter::KBWriter()
+//
+KBWriter::KBWriter(FILE* file, FILE* countFile, const string& countPath)
+    : file(file), countFile(countFile), countPath(countPath), numFacts(0),
+      last(0), lastCount(0), checksum(0xcbf29ce484222325), ok(true) {
+  buffer.reserve(CHUNK_SIZE);
+  countBuffer.reserve(CHUNK_SIZE);
+  // (the header is written at the end, once the facts are counted)
+  kb_header header;
+  memset(&header, 0, sizeof(kb_header));
+  ok = fwrite(&header, sizeof(kb_header), 1, file) == 1;
+}
+
+//
+// KBWriter::~KBWriter()
+//
+KBWriter::~KBWriter() {
+  if (file != NULL) { close(); }
+}
+
+//
+// KBWriter::addCount()
+//
+void KBWriter::addCount() {
+  countBuffer.push_back(min(lastCount, (uint64_t) KB_MAX_COUNT));
+}
+
+//
+// KBWriter::flush()
+//
+void KBWriter::flush() {
+  ok = ok && fwrite(buffer.data(), sizeof(uint64_t), buffer.size(), file) == buffer.size();
+  ok = ok && fwrite(countBuffer.data(), sizeof(uint16_t), countBuffer.size(), countFile) == countBuffer.size();
+  buffer.clear();
+  countBuffer.clear();
+}
+
+//
+// KBWriter::close()
+//
+bool KBWriter::close() {
+  if (numFacts > 0) { addCount(); }
+  flush();
+  // Append the counts after the facts
+  ok = ok && fflush(countFile) == 0 && fseek(countFile, 0, SEEK_SET) == 0;
+  while (ok) {
+    countBuffer.resize(countBuffer.capacity());
+    countBuffer.resize(fread(countBuffer.data(), sizeof(uint16_t), countBuffer.size(), countFile));
+    if (countBuffer.empty()) { break; }
+    for (auto iter = countBuffer.begin(); iter != countBuffer.end(); ++iter) {
+      checksum = (checksum ^ *iter) * 0x100000001b3;
+    }
+    ok = fwrite(countBuffer.data(), sizeof(uint16_t), countBuffer.size(), file) == countBuffer.size();
+  }
+  fclose(countFile);
+  unlink(countPath.c_str());
+  // Write the header
+  kb_header header;
+  memset(&header, 0, sizeof(kb_header));
+  header.magic = KB_MAGIC;
+  header.version = KB_VERSION;
+  header.hashScheme = KB_HASH_SCHEME;
+  header.flags = KB_FLAG_COUNTS;
+  header.numFacts = numFacts;
+  header.checksum = checksum;
+  ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(kb_header), 1, file) == 1;
+  ok = (fclose(file) == 0) && ok;
+  file = NULL;
+  return ok;
+}
+
+//
+// KBWriter::open()
+//
+KBWriter* KBWriter::open(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) { return NULL; }
+  const string countPath = string(path) + ".counts";
+  FILE* countFile = fopen(countPath.c_str(), "w+b");
+  if (countFile == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  return new KBWriter(file, countFile, countPath);
+}
+
+//
+// ExternalFactSorter::ExternalFactSorter()
+//
+ExternalFactSorter::ExternalFactSorter(const string& runPrefix,
+                                       const uint64_t& memoryBytes,
+                                       const uint32_t& numThreads)
+    : runPrefix(runPrefix), numThreads(numThreads), numAdded(0), ok(true) {
+  // (one buffer fills while the other is sorted)
+  bufferCapacity = max((uint64_t) 1, memoryBytes / 2 / sizeof(uint64_t));
+  buffer.reserve(bufferCapacity);
+}
+
+//
+// ExternalFactSorter::~ExternalFactSorter()
+//
+ExternalFactSorter::~ExternalFactSorter() {
+  if (spiller.joinable()) { spiller.join(); }
+  for (auto iter = runs.begin(); iter != runs.end(); ++iter) {
+    unlink(iter->c_str());
+  }
+}
+
+//
+// ExternalFactSorter::spill()
+//
+void ExternalFactSorter::spill() {
+  if (spiller.joinable()) { spiller.join(); }
+  spilling.swap(buffer);
+  buffer.clear();
+  buffer.reserve(bufferCapacity);
+  const string path = runPrefix + ".run" + to_string(runs.size());
+  runs.push_back(path);
+  spiller = thread([this, path]() -> void {
+    sortFacts(&spilling, numThreads);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+      ok = false;
+      return;
+    }
+    // (write each distinct fact, followed by the number of times it was added)
+    vector<uint64_t> pairs;
+    pairs.reserve(2 * CHUNK_SIZE);
+    for (uint64_t begin = 0; begin < spilling.size(); ) {
+      uint64_t end = begin + 1;
+      while (end < spilling.size() && spilling[end] == spilling[begin]) { end += 1; }
+      pairs.push_back(spilling[begin]);
+      pairs.push_back(end - begin);
+      if (pairs.size() >= 2 * CHUNK_SIZE || end == spilling.size()) {
+        if (fwrite(pairs.data(), sizeof(uint64_t), pairs.size(), file) != pairs.size()) {
+          ok = false;
+        }
+        pairs.clear();
+      }
+      begin = end;
+    }
+    if (fclose(file) != 0) { ok = false; }
+    spilling.clear();
+  });
+}
+
+//
+// A sorted run of facts being read back for a merge: each fact is followed
+// by its count in the run.
+//
+struct fact_run {
+  FILE* file;
+  vector<uint64_t> chunk;
+  uint64_t position;
+
+  /** Read the next chunk of the run; false at the end of the run */
+  bool refill() {
+    chunk.resize(chunk.capacity());
+    chunk.resize(fread(chunk.data(), sizeof(uint64_t), chunk.size(), file));
+    position = 0;
+    return !chunk.empty();
+  }
+};
+
+//
+// ExternalFactSorter::write()
+//
+bool ExternalFactSorter::write(const char* path, uint64_t* numFacts) {
+  // Everything fit in memory
+  if (runs.empty()) {
+    const bool written = writeSortedKB(&buffer, path);
+    *numFacts = buffer.size();
+    return written;
+  }
+
+  // Sort the last run
+  if (!buffer.empty()) { spill(); }
+  spiller.join();
+  vector<uint64_t>().swap(buffer);
+  vector<uint64_t>().swap(spilling);
+  if (!ok) { return false; }
+
+  // Merge the runs
+  // (the memory is split between the runs' read buffers)
+  KBWriter* writer = KBWriter::open(path);
+  if (writer == NULL) { return false; }
+  const uint64_t chunkSize = max((uint64_t) 1024, bufferCapacity * 2 / runs.size()) & ~((uint64_t) 1);
+  vector<fact_run> readers(runs.size());
+  typedef pair<uint64_t,uint32_t> head;
+  priority_queue<head, vector<head>, greater<head> > heads;
+  for (uint32_t i = 0; i < runs.size(); ++i) {
+    readers[i].file = fopen(runs[i].c_str(), "rb");
+    if (readers[i].file == NULL) { ok = false; continue; }
+    readers[i].chunk.reserve(chunkSize);
+    if (readers[i].refill()) { heads.push(make_pair(readers[i].chunk[0], i)); }
+  }
+  while (!heads.empty()) {
+    const head top = heads.top();
+    heads.pop();
+    fact_run& reader = readers[top.second];
+    writer->add(top.first, reader.chunk[reader.position + 1]);  // (summing duplicates)
+    reader.position += 2;
+    if (reader.position < reader.chunk.size() || reader.refill()) {
+      heads.push(make_pair(reader.chunk[reader.position], top.second));
+    }
+  }
+  for (auto iter = readers.begin(); iter != readers.end(); ++iter) {
+    if (iter->file != NULL) { fclose(iter->file); }
+  }
+  *numFacts = writer->size();
+  const bool written = writer->close();
+  delete writer;
+  return written && ok;
+}
+
+//
+// writeSortedKB()
+//
+bool writeSortedKB(vector<uint64_t>* facts, const char* path) {
+  sortFacts(facts, 0);
+  KBWriter* writer = KBWriter::open(path);
+  if (writer == NULL) { return false; }
+  for (auto iter = facts->begin(); iter != facts->end(); ++iter) {
+    writer->add(*iter);  // (counting duplicates)
+  }
+  const bool ok = writer->close();
+  delete writer;
+  facts->erase(std::unique(facts->begin(), facts->end()), facts->end());
+  return ok;
+}
+
 //
 // Append To KB
 //
@@ -20,9 +1272,27 @@ void appendToKB(const uint64_t* factStream,
   }
 }
 
-const btree_set<uint64_t>* readKB(string path) {
-  btree_set<uint64_t>* kb = new btree_set<uint64_t>();
+//
+// Put a Bloom filter in front of a knowledge base just read, if one is
+// configured.
+//
+const FactDB* filterKB(const FactDB* kb) {
+#if KB_BLOOM_BITS_PER_FACT > 0
+  if (kb->empty()) { return kb; }
+  const BloomFactDB* filtered = new BloomFactDB(kb, true, KB_BLOOM_BITS_PER_FACT);
+  printTime("[%c] ");
+  fprintf(stderr, "Bloom filter: %u bits/fact in %lu blocks; measured false positive rate %.5f\n",
+          KB_BLOOM_BITS_PER_FACT, filtered->numBlocks(), filtered->falsePositiveRate(1000000));
+  return filtered;
+#else
+  return kb;
+#endif
+}
 
+//
+// readKB()
+//
+const FactDB* readKB(string path, const uint32_t& minFactCount) {
   // Open the KB file
   FILE* file;
   file = fopen(path.c_str(), "r");
@@ -31,29 +1301,121 @@ const btree_set<uint64_t>* readKB(string path) {
     exit(1);
   }
 
-  // Read chunks
-  uint64_t* buffer = (uint64_t*) malloc(CHUNK_SIZE * sizeof(uint64_t));
-  uint64_t numRead;
-  uint64_t nextPrint = 10 * 1000 * 1000;
-  printTime("[%c] ");
-  fprintf(stderr, "Reading the knowledge base...");
-  while ( 
-      (numRead = fread(buffer, sizeof(uint64_t), CHUNK_SIZE, file)) 
-        == CHUNK_SIZE ) {
-    appendToKB(buffer, numRead, kb);
-    if (kb->size() > nextPrint) {
-      nextPrint += (10 * 1000 * 1000);
-      fprintf(stderr, ".");
+  // Map a sorted KB
+  uint32_t magic = 0;
+  if (fread(&magic, sizeof(uint32_t), 1, file) == 1 && magic == KB_MAGIC) {
+    fclose(file);
+    MappedFactDB* kb = MappedFactDB::open(path.c_str(), minFactCount);
+    if (kb == NULL) {
+      fprintf(stderr, "Can't map KB file %s (wrong version or hash scheme?)\n",
+              path.c_str());
+      exit(1);
     }
+    printTime("[%c] ");
+    fprintf(stderr, "Mapped the knowledge base; KB size=%lu\n", kb->size());
+    if (minFactCount > 1 && !kb->hasCounts()) {
+      printTime("[%c] ");
+      fprintf(stderr, "WARNING: KB file %s has no fact counts; keeping every fact\n",
+              path.c_str());
+    } else if (minFactCount > 1) {
+      printTime("[%c] ");
+      fprintf(stderr, "Dropped %lu facts seen fewer than %u times\n",
+              kb->numDropped(), minFactCount);
+    }
+#if KB_INDEX_LAYOUT==2 || KB_INDEX_LAYOUT==3
+    // (copy out only the facts kept)
+    const uint64_t* facts = kb->facts();
+    vector<uint64_t> kept;
+    if (kb->numDropped() > 0) {
+      kept.reserve(kb->size());
+      kb->forEach([&kept](const uint64_t& fact) -> void { kept.push_back(fact); });
+      facts = kept.data();
+    }
+#endif
+#if KB_INDEX_LAYOUT==2
+    const StaticFactDB* index = new StaticFactDB(facts, kb->size(), KB_LAYOUT_EYTZINGER);
+    delete kb;
+    printTime("[%c] ");
+    fprintf(stderr, "Indexed the knowledge base in Eytzinger order\n");
+    return filterKB(index);
+#elif KB_INDEX_LAYOUT==4
+    const TieredFactDB* tiered = new TieredFactDB(kb,
+        KB_BLOOM_BITS_PER_FACT > 0 ? KB_BLOOM_BITS_PER_FACT : 10);
+    printTime("[%c] ");
+    fprintf(stderr, "Reading the knowledge base in two tiers; %.2f bytes/fact in memory\n",
+            ((double) tiered->residentBytes()) / max((uint64_t) 1, tiered->size()));
+    return tiered;
+#elif KB_INDEX_LAYOUT==3
+    const EliasFanoFactDB* index = new EliasFanoFactDB(facts, kb->size());
+    delete kb;
+    printTime("[%c] ");
+    fprintf(stderr, "Compressed the knowledge base to %.2f bytes/fact\n",
+            ((double) index->bytesUsed()) / max((uint64_t) 1, index->size()));
+    return filterKB(index);
+#else
+    return filterKB(kb);
+#endif
+  }
+  rewind(file);
+#if KB_INDEX_LAYOUT==4
+  printTime("[%c] ");
+  fprintf(stderr, "WARNING: only a sorted KB (see write_kb) can be read in two tiers; reading %s into memory\n",
+          path.c_str());
+#endif
+
+  // Read the facts
+  // (in large sequential reads, straight into place)
+  struct stat info;
+  if (fstat(fileno(file), &info) != 0) {
+    fprintf(stderr, "Can't stat KB file %s!\n", path.c_str());
+    exit(1);
   }
-  appendToKB(buffer, numRead, kb);
-  fprintf(stderr, "done.\n");
+  vector<uint64_t> facts(info.st_size / sizeof(uint64_t));
+  printTime("[%c] ");
+  fprintf(stderr, "Reading the knowledge base (%lu facts)...\n", facts.size());
+  uint64_t numRead = 0;
+  while (numRead < facts.size()) {
+    const uint64_t toRead = min((uint64_t) CHUNK_SIZE * 8, facts.size() - numRead);
+    const uint64_t chunkRead = fread(facts.data() + numRead, sizeof(uint64_t), toRead, file);
+    if (chunkRead == 0) { break; }
+    numRead += chunkRead;
+  }
+  fclose(file);
+  facts.resize(numRead);
+
+  // Sort and deduplicate them, and build the btree from the sorted facts
+  // (a fact's count is the number of times it occurs in the file)
+  sortFacts(&facts, 0);
+  const uint64_t numDropped = keepFrequentFacts(&facts, minFactCount);
+  printTime("[%c] ");
+  fprintf(stderr, "Sorted the knowledge base; building the index...\n");
+  if (minFactCount > 1) {
+    printTime("[%c] ");
+    fprintf(stderr, "Dropped %lu facts seen fewer than %u times\n",
+            numDropped, minFactCount);
+  }
+#if KB_INDEX_LAYOUT==3
+  const EliasFanoFactDB* index = new EliasFanoFactDB(facts.data(), facts.size());
+  vector<uint64_t>().swap(facts);
+  printTime("[%c] ");
+  fprintf(stderr, "KB size=%lu; compressed to %.2f bytes/fact\n", index->size(),
+          ((double) index->bytesUsed()) / max((uint64_t) 1, index->size()));
+  return filterKB(index);
+#else
+  btree_set<uint64_t>* kb = drainIntoKB(&facts);
   printTime("[%c] ");
   fprintf(stderr, "KB size=%lu\n", kb->size());
 
   // Return
-  free(buffer);
-  fclose(file);
-  return kb;
+  return filterKB(new BTreeFactDB(kb, true));
+#endif
 }
 
+//
+// readKB()
+//
+const FactDB* readKB(string path) {
+  const char* minFactCount = getenv(MIN_FACT_COUNT_ENV_VAR);
+  return readKB(path, minFactCount != NULL && minFactCount[0] != '\0'
+      ? strtoul(minFactCount, NULL, 10) : MIN_FACT_COUNT);
+}
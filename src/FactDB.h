@@ -1,9 +1,793 @@
 #ifndef FACT_DB_H
 #define FACT_DB_H
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "config.h"
 #include "btree_set.h"
 
+/**
+ * The version of the fact hash (see Tree::hash()) the knowledge base was
+ * written with. This must change whenever the hash of a fact changes, so
+ * that a stale knowledge base is not silently searched.
+ */
+#define KB_HASH_SCHEME 1
+
+// How to search a knowledge base: 1 searches a mapped file in place, by
+// interpolation; 2 copies it into Eytzinger order; 3 compresses it with
+// Elias-Fano (EliasFanoFactDB); 4 keeps only a filter in memory, and verifies
+// its hits against the mapped file (TieredFactDB).
+#ifndef KB_INDEX_LAYOUT
+  #define KB_INDEX_LAYOUT 1
+#endif
+// The size of the Bloom filter put in front of the knowledge base when it is
+// read, in bits per fact; 0 for no filter (or, for a TieredFactDB, which
+// always has one, the default of 10 bits per fact).
+#ifndef KB_BLOOM_BITS_PER_FACT
+  #define KB_BLOOM_BITS_PER_FACT 0
+#endif
+// The log of facts added to the knowledge base while running; empty for a
+// read only knowledge base. See MutableFactDB.
+#ifndef KB_LOG_FILE
+  #define KB_LOG_FILE ""
+#endif
+// The number of added facts at which they are merged into the knowledge base
+#ifndef KB_MERGE_THRESHOLD
+  #define KB_MERGE_THRESHOLD 100000
+#endif
+// The number of times a fact must have been seen to be read into the
+// knowledge base; this can be overridden at runtime with the environment
+// variable MIN_FACT_COUNT_ENV_VAR.
+#ifndef MIN_FACT_COUNT
+  #define MIN_FACT_COUNT 1
+#endif
+#define MIN_FACT_COUNT_ENV_VAR "MIN_FACT_COUNT"
+
+/**
+ * Counts of the work done looking facts up in a knowledge base; e.g., over
+ * the course of a search.
+ */
+struct kb_lookup_stats {
+  /** The number of facts looked up */
+  uint64_t lookups = 0;
+  /** The lookups which a filter could not rule out (all of them, if there is no filter) */
+  uint64_t filterHits = 0;
+  /** The lookups which read the knowledge base file */
+  uint64_t diskVerifications = 0;
+
+  inline kb_lookup_stats& operator+=(const kb_lookup_stats& other) {
+    lookups += other.lookups;
+    filterHits += other.filterHits;
+    diskVerifications += other.diskVerifications;
+    return *this;
+  }
+};
+
+/**
+ * A knowledge base: the set of hashes of the facts known to be true.
+ * This is what the search looks its candidate premises up in.
+ */
+class FactDB {
+ public:
+  virtual ~FactDB() { }
+
+  /** Returns true if the fact with the given hash is in the knowledge base */
+  virtual bool contains(const uint64_t& fact) const = 0;
+
+  /** As contains(), but counting the work done into the given stats */
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    stats->lookups += 1;
+    stats->filterHits += 1;
+    return contains(fact);
+  }
+
+  /**
+   * Look up a batch of facts, sorted and distinct, setting found[i] if
+   * facts[i] is in the knowledge base, and counting the work done as
+   * lookup() would. By default, the facts are looked up one at a time;
+   * a knowledge base whose probes don't depend on each other issues the
+   * memory accesses of the whole batch together, so that their cache
+   * misses overlap.
+   */
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const {
+    for (uint32_t i = 0; i < numFacts; ++i) { found[i] = lookup(facts[i], stats); }
+  }
+
+  /** The number of facts in the knowledge base */
+  virtual uint64_t size() const = 0;
+
+  /** Call the callback on every fact in the knowledge base, in no particular order */
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const = 0;
+
+  /**
+   * Call the callback on every fact in the knowledge base in sorted order,
+   * along with its count (see count()); e.g., to write the knowledge base out
+   * with a KBWriter. By default, the facts are copied out and sorted.
+   */
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const;
+
+  /**
+   * The number of times the fact was seen in the corpus the knowledge base
+   * was built from: 0 if it's not in the knowledge base, and 1 for any fact
+   * in a knowledge base which does not keep counts.
+   */
+  virtual uint32_t count(const uint64_t& fact) const { return contains(fact) ? 1 : 0; }
+
+  /** Returns true if there are no facts in the knowledge base */
+  inline bool empty() const { return size() == 0; }
+
+  /**
+   * A view of the knowledge base which does not change while it is held;
+   * e.g., for the duration of a search. For a read only knowledge base, this
+   * is the knowledge base itself.
+   */
+  virtual std::shared_ptr<const FactDB> snapshot() const {
+    return std::shared_ptr<const FactDB>(this, [](const FactDB* kb) -> void { });
+  }
+};
+
+/**
+ * A knowledge base held in memory, as a btree set.
+ */
+class BTreeFactDB : public FactDB {
+ public:
+  /**
+   * Wrap a set of facts.
+   *
+   * @param facts The facts in the knowledge base.
+   * @param owned If true, the set is deleted along with this knowledge base.
+   */
+  BTreeFactDB(const btree::btree_set<uint64_t>* facts, const bool& owned)
+    : facts(facts), owned(owned) { }
+
+  virtual ~BTreeFactDB() {
+    if (owned) { delete facts; }
+  }
+
+  virtual bool contains(const uint64_t& fact) const {
+    return facts->find(fact) != facts->end();
+  }
+
+  virtual uint64_t size() const { return facts->size(); }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    for (auto iter = facts->begin(); iter != facts->end(); ++iter) {
+      callback(*iter);
+    }
+  }
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+    for (auto iter = facts->begin(); iter != facts->end(); ++iter) {
+      callback(*iter, 1);
+    }
+  }
+
+ private:
+  const btree::btree_set<uint64_t>* facts;
+  bool owned;
+};
+
+/**
+ * The ways a sorted array of facts can be laid out for lookups.
+ */
+enum kb_layout {
+  /** Sorted order, searched by bisection */
+  KB_LAYOUT_SORTED,
+  /**
+   * Sorted order, searched by interpolating between the ends of the range.
+   * Fact hashes are uniformly distributed, so this takes a handful of probes
+   * rather than one per bit of the fact count.
+   */
+  KB_LAYOUT_INTERPOLATION,
+  /**
+   * The facts of an implicit binary search tree in breadth first order, so
+   * that the top levels of the tree share cache lines, and the next levels
+   * can be prefetched while the current one is compared against. This takes
+   * a copy of the facts.
+   */
+  KB_LAYOUT_EYTZINGER
+};
+
+/**
+ * Find the fact in the sorted array, by interpolation search. This falls
+ * back to bisection if the facts turn out not to be uniform.
+ *
+ * @return The index of the fact, or count if it is not in the array.
+ */
+uint64_t interpolationIndex(const uint64_t* facts, const uint64_t& count,
+                            const uint64_t& fact);
+
+/** Returns true if the fact is in the sorted array; @see interpolationIndex() */
+inline bool interpolationSearch(const uint64_t* facts, const uint64_t& count,
+                                const uint64_t& fact) {
+  return interpolationIndex(facts, count, fact) < count;
+}
+
+/**
+ * A read only knowledge base over a sorted array of distinct facts, with one
+ * of the layouts in kb_layout.
+ */
+class StaticFactDB : public FactDB {
+ public:
+  /**
+   * Index the given facts. For the sorted layouts, the facts are searched
+   * in place, and must outlive the knowledge base; the Eytzinger layout
+   * copies them.
+   *
+   * @param facts The facts, sorted and distinct; e.g., MappedFactDB::facts().
+   * @param count The number of facts.
+   * @param layout The layout to search the facts with.
+   */
+  StaticFactDB(const uint64_t* facts, const uint64_t& count, const kb_layout& layout);
+
+  virtual ~StaticFactDB();
+
+  virtual bool contains(const uint64_t& fact) const;
+
+  /**
+   * The Eytzinger tree is descended for every fact at once, a level at a
+   * time; for the sorted layouts, the first probe of every fact is
+   * prefetched before any is searched for.
+   */
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const;
+
+  virtual uint64_t size() const { return count; }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const;
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const;
+
+  /** The layout the facts are searched with */
+  inline kb_layout layout() const { return indexLayout; }
+
+ private:
+  const uint64_t* facts;
+  uint64_t count;
+  kb_layout indexLayout;
+  /** The facts in Eytzinger order, from index 1; NULL for other layouts */
+  uint64_t* tree;
+};
+
+/**
+ * A read only knowledge base over a sorted array of distinct facts,
+ * compressed with Elias-Fano coding. Each fact is split into its high bits,
+ * around log2 of the number of facts, and the rest (its low bits). The low
+ * bits are stored as they are, packed; the high bits are stored as unary
+ * coded gaps, which for uniform hashes comes to around two bits per fact.
+ * So a knowledge base of n facts takes around 66 - log2(n) bits per fact,
+ * rather than 64; e.g., 4.5 bytes per fact for a billion facts.
+ *
+ * A lookup finds the facts which share its high bits from a sample of the
+ * positions of the gaps, and compares their low bits; this is a few cache
+ * misses, as for the other layouts.
+ */
+class EliasFanoFactDB : public FactDB {
+ public:
+  /**
+   * Compress the given facts; these can be freed afterwards.
+   *
+   * @param facts The facts, sorted and distinct.
+   * @param count The number of facts.
+   */
+  EliasFanoFactDB(const uint64_t* facts, const uint64_t& count);
+
+  virtual ~EliasFanoFactDB();
+
+  virtual bool contains(const uint64_t& fact) const;
+
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const;
+
+  virtual uint64_t size() const { return count; }
+
+  /** The facts are decoded in sorted order */
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const;
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+    forEach([&callback](const uint64_t& fact) -> void { callback(fact, 1); });
+  }
+
+  /** The number of bytes the compressed facts take up */
+  uint64_t bytesUsed() const;
+
+ private:
+  /** The low bits of the fact at the given index */
+  inline uint64_t lowAt(const uint64_t& index) const {
+    const uint64_t bit = index * lowBits;
+    const uint64_t offset = bit & 63;
+    uint64_t value = lows[bit >> 6] >> offset;
+    if (offset + lowBits > 64) { value |= lows[(bit >> 6) + 1] << (64 - offset); }
+    return value & ((((uint64_t) 1) << lowBits) - 1);
+  }
+
+  /** The position of the k'th (from 0) zero in the high bits */
+  uint64_t selectZero(const uint64_t& k) const;
+
+  /** The position in the high bits at which the facts with these high bits start */
+  inline uint64_t bucketStart(const uint64_t& high) const {
+    return high == 0 ? 0 : selectZero(high - 1) + 1;
+  }
+
+  /** Returns true if the bucket starting at the given bit has the low bits */
+  bool bucketContains(uint64_t bit, const uint64_t& high, const uint64_t& low) const;
+
+  uint64_t count;
+  uint32_t lowBits;
+  /** The number of possible high bit values; i.e., zeros in the high bits */
+  uint64_t numBuckets;
+  uint64_t* lows;
+  /** The high bits: the i'th fact, with high bits h, sets bit h + i */
+  uint64_t* highs;
+  uint64_t numHighWords;
+  /** The position of every EF_ZERO_SAMPLE_RATE'th zero in the high bits */
+  uint64_t* zeroSamples;
+  uint64_t numZeroSamples;
+};
+
+/**
+ * The header of a sorted knowledge base file; @see MappedFactDB.
+ */
+struct kb_header {
+  uint32_t magic;
+  uint32_t version;
+  /** The KB_HASH_SCHEME the facts were hashed with */
+  uint32_t hashScheme;
+  /** KB_FLAG_COUNTS if the facts are followed by their counts */
+  uint32_t flags;
+  uint64_t numFacts;
+  /** A checksum of the facts, and their counts; @see MappedFactDB::verify() */
+  uint64_t checksum;
+};
+
+/**
+ * A knowledge base stored on disk as a sorted array of distinct fact hashes,
+ * following a kb_header, and optionally followed by the number of times
+ * each fact was seen (a uint16_t each, saturating). The file is memory mapped
+ * read only, so that opening it takes no time regardless of its size, and its
+ * pages are shared between every process which has it open. Facts are looked
+ * up by interpolation search.
+ * These files are written by writeSortedKB(), or a KBWriter.
+ */
+class MappedFactDB : public FactDB {
+ public:
+  virtual ~MappedFactDB();
+
+  virtual bool contains(const uint64_t& fact) const;
+
+  virtual uint32_t count(const uint64_t& fact) const;
+
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    stats->diskVerifications += 1;
+    return FactDB::lookup(fact, stats);
+  }
+
+  virtual uint64_t size() const { return numKept; }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    for (uint64_t i = 0; i < header->numFacts; ++i) {
+      if (keeps(i)) { callback(data[i]); }
+    }
+  }
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+    for (uint64_t i = 0; i < header->numFacts; ++i) {
+      if (keeps(i)) { callback(data[i], countAt(i)); }
+    }
+  }
+
+  /** True if the file has the count of each fact */
+  inline bool hasCounts() const { return counts != NULL; }
+
+  /** The count of the fact at the given index of facts(); 1 without counts */
+  inline uint32_t countAt(const uint64_t& index) const {
+    return counts == NULL ? 1 : counts[index];
+  }
+
+  /** False if the fact at the given index of facts() was seen too rarely to keep */
+  inline bool keeps(const uint64_t& index) const {
+    return countAt(index) >= minCount;
+  }
+
+  /** The number of facts in the file, including those not kept */
+  inline uint64_t numInFile() const { return header->numFacts; }
+
+  /** The number of facts in the file which were seen too rarely to keep */
+  inline uint64_t numDropped() const { return header->numFacts - numKept; }
+
+  /**
+   * Tell the kernel that the file will be read at random, so that it does
+   * not read ahead of each page that is touched.
+   */
+  void adviseRandomAccess() const;
+
+  /**
+   * Every fact in the file, in sorted order, including those which were
+   * seen too rarely to keep (see keeps()).
+   */
+  inline const uint64_t* facts() const { return data; }
+
+  /**
+   * Recompute the checksum of the facts, and compare it against the one in
+   * the header. This reads the entire file.
+   */
+  bool verify() const;
+
+  /**
+   * Memory map a knowledge base written by writeSortedKB().
+   *
+   * @param path The file to map.
+   * @param minCount Facts seen fewer times than this are left out of the
+   *                 knowledge base; this needs a file with counts.
+   *
+   * @return The knowledge base, or NULL if the file can't be read, or is not
+   *         a knowledge base with the current version and hash scheme.
+   */
+  static MappedFactDB* open(const char* path, const uint32_t& minCount = 1);
+
+ private:
+  MappedFactDB(void* region, const uint64_t& regionSize, const uint32_t& minCount);
+
+  void* region;
+  uint64_t regionSize;
+  const kb_header* header;
+  const uint64_t* data;
+  /** The count of each fact, or NULL if the file has no counts */
+  const uint16_t* counts;
+  uint32_t minCount;
+  uint64_t numKept;
+};
+
+/**
+ * A blocked Bloom filter in front of another knowledge base. Every fact sets
+ * a few bits in a single cache line sized block of the filter, so the lookup
+ * of a fact which is not in the knowledge base (by far the most common case
+ * in a search) usually touches one cache line, rather than the knowledge
+ * base itself.
+ */
+class BloomFactDB : public FactDB {
+ public:
+  /**
+   * Build the filter over every fact in the given knowledge base.
+   *
+   * @param kb The knowledge base to filter.
+   * @param owned If true, the knowledge base is deleted along with the filter.
+   * @param bitsPerFact The size of the filter; e.g., 10 bits per fact gives
+   *                    a false positive rate of around 1%.
+   */
+  BloomFactDB(const FactDB* kb, const bool& owned, const uint32_t& bitsPerFact);
+
+  virtual ~BloomFactDB();
+
+  virtual bool contains(const uint64_t& fact) const {
+    return mayContain(fact) && kb->contains(fact);
+  }
+
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    stats->lookups += 1;
+    if (!mayContain(fact)) { return false; }
+    stats->filterHits += 1;
+    kb_lookup_stats kbStats;
+    const bool found = kb->lookup(fact, &kbStats);
+    stats->diskVerifications += kbStats.diskVerifications;
+    return found;
+  }
+
+  /** The filter blocks are fetched together, and the facts passing them looked up in a batch */
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const;
+
+  virtual uint64_t size() const { return kb->size(); }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    kb->forEach(callback);
+  }
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+    kb->forEachSorted(callback);
+  }
+
+  virtual uint32_t count(const uint64_t& fact) const {
+    return mayContain(fact) ? kb->count(fact) : 0;
+  }
+
+  /** Returns false if the fact is certainly not in the knowledge base */
+  inline bool mayContain(const uint64_t& fact) const {
+    const uint64_t* block = blocks + 8 * blockIndex(fact);
+    const uint64_t probe = probeHash(fact);
+    const uint32_t first = probe & 511;
+    const uint32_t step = ((probe >> 9) & 511) | 1;
+    for (uint32_t i = 0; i < numHashes; ++i) {
+      const uint32_t bit = (first + i * step) & 511;
+      if ((block[bit >> 6] & (((uint64_t) 1) << (bit & 63))) == 0) { return false; }
+    }
+    return true;
+  }
+
+  /**
+   * Measure the false positive rate of the filter, as the fraction of random
+   * facts not in the knowledge base which pass it.
+   *
+   * @param numProbes The number of random facts to try.
+   */
+  double falsePositiveRate(const uint64_t& numProbes) const;
+
+  /** The number of 512 bit blocks in the filter */
+  inline uint64_t numBlocks() const { return blockCount; }
+
+ private:
+  /** The block of a fact, from the high bits of a remix of its hash */
+  inline uint64_t blockIndex(const uint64_t& fact) const {
+    return (uint64_t) (((unsigned __int128) (fact * 0x9E3779B97F4A7C15)) * blockCount >> 64);
+  }
+
+  /** The hash picking the bits of a fact within its block */
+  static inline uint64_t probeHash(const uint64_t& fact) {
+    return (fact ^ (fact >> 31)) * 0xBF58476D1CE4E5B9;
+  }
+
+  const FactDB* kb;
+  bool owned;
+  uint64_t* blocks;
+  uint64_t blockCount;
+  uint32_t numHashes;
+};
+
+/**
+ * A knowledge base for when the facts don't fit in memory, in two tiers: a
+ * Bloom filter and a fence index are held in memory, and the facts themselves
+ * stay in a sorted knowledge base file on disk, which is mapped. Only the
+ * lookups which pass the filter touch the file; each of these reads a single
+ * page, which the fence index (the first fact on every page of the file)
+ * picks out.
+ */
+class TieredFactDB : public FactDB {
+ public:
+  /**
+   * Build the filter and the fence index over the given file, reading it
+   * through once.
+   *
+   * @param store The knowledge base file; this is deleted along with the
+   *              knowledge base.
+   * @param bitsPerFact The size of the filter.
+   */
+  TieredFactDB(const MappedFactDB* store, const uint32_t& bitsPerFact);
+
+  virtual ~TieredFactDB();
+
+  virtual bool contains(const uint64_t& fact) const {
+    return filter->mayContain(fact) && storeContains(fact);
+  }
+
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    stats->lookups += 1;
+    if (!filter->mayContain(fact)) { return false; }
+    stats->filterHits += 1;
+    stats->diskVerifications += 1;
+    return storeContains(fact);
+  }
+
+  virtual uint64_t size() const { return store->size(); }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    store->forEach(callback);
+  }
+
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const {
+    store->forEachSorted(callback);
+  }
+
+  virtual uint32_t count(const uint64_t& fact) const {
+    return filter->mayContain(fact) ? store->count(fact) : 0;
+  }
+
+  /** The number of bytes held in memory: the filter, and the fence index */
+  inline uint64_t residentBytes() const {
+    return filter->numBlocks() * 64 + fences.size() * sizeof(uint64_t);
+  }
+
+ private:
+  /** Look the fact up in the file, reading the one page it could be on */
+  bool storeContains(const uint64_t& fact) const;
+
+  const MappedFactDB* store;
+  const BloomFactDB* filter;
+  /** The first fact on each page of the file */
+  std::vector<uint64_t> fences;
+};
+
+/**
+ * A read only knowledge base, along with the facts added to it since it was
+ * built; this is a snapshot of a MutableFactDB.
+ */
+class DeltaFactDB : public FactDB {
+ public:
+  /**
+   * @param base The knowledge base.
+   * @param delta The facts added to it, none of which are in the base.
+   */
+  DeltaFactDB(const std::shared_ptr<const FactDB>& base,
+              const std::shared_ptr<const btree::btree_set<uint64_t> >& delta)
+    : base(base), delta(delta) { }
+
+  virtual bool contains(const uint64_t& fact) const {
+    return delta->find(fact) != delta->end() || base->contains(fact);
+  }
+
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    if (delta->find(fact) != delta->end()) { return FactDB::lookup(fact, stats); }
+    return base->lookup(fact, stats);
+  }
+
+  /** The facts not in the delta are looked up in the base in a batch */
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const;
+
+  virtual uint64_t size() const { return base->size() + delta->size(); }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    base->forEach(callback);
+    for (auto iter = delta->begin(); iter != delta->end(); ++iter) { callback(*iter); }
+  }
+
+  /** The facts of the base and the delta are merged as they are walked */
+  virtual void forEachSorted(
+      const std::function<void(const uint64_t&, const uint32_t&)>& callback) const;
+
+  virtual uint32_t count(const uint64_t& fact) const {
+    return delta->find(fact) != delta->end() ? 1 : base->count(fact);
+  }
+
+  const std::shared_ptr<const FactDB> base;
+  const std::shared_ptr<const btree::btree_set<uint64_t> > delta;
+};
+
+/**
+ * A knowledge base which facts can be added to while it is being searched.
+ * Added facts are appended to a log file, and to an in memory set of the
+ * facts added since the knowledge base was built (the delta), and are seen
+ * by every search started after they were added. Once the delta grows past
+ * a threshold, a background thread merges it into a new knowledge base.
+ *
+ * The delta is kept in layers, each a set which is never changed once it is
+ * published: added facts go into a new layer, which is merged with the
+ * layers before it while they are no larger than it. So adding a fact copies
+ * it O(log(delta)) times over all, rather than copying the whole delta.
+ *
+ * Searches never take a lock on the knowledge base: each search holds a
+ * snapshot (a DeltaFactDB), which is never changed. Adding facts or merging
+ * publishes a new snapshot; an old snapshot is freed along with the last
+ * search which holds it.
+ *
+ * The log is in the raw knowledge base format (see readKB()), and is replayed
+ * when the knowledge base is created. Every merge is kept as a sorted
+ * knowledge base file next to the log (the log path, with ".merged"
+ * appended), and the log is then cut down to the facts added since; so a
+ * restart reopens the last merge, and replays only those.
+ */
+class MutableFactDB : public FactDB {
+ public:
+  /**
+   * @param base The knowledge base to add facts to; this is deleted once no
+   *             snapshot holds it. If a merge was kept next to the log, that
+   *             is opened in its place, and this is deleted right away.
+   * @param logPath The log to replay, and to append added facts to.
+   * @param mergeThreshold The number of added facts to merge at.
+   */
+  MutableFactDB(const FactDB* base, const char* logPath,
+                const uint64_t& mergeThreshold);
+
+  virtual ~MutableFactDB();
+
+  virtual bool contains(const uint64_t& fact) const {
+    return snapshot()->contains(fact);
+  }
+
+  virtual bool lookup(const uint64_t& fact, kb_lookup_stats* stats) const {
+    return snapshot()->lookup(fact, stats);
+  }
+
+  virtual void lookupBatch(const uint64_t* facts, const uint32_t& numFacts,
+                           bool* found, kb_lookup_stats* stats) const {
+    snapshot()->lookupBatch(facts, numFacts, found, stats);
+  }
+
+  virtual uint64_t size() const { return snapshot()->size(); }
+
+  virtual void forEach(const std::function<void(const uint64_t&)>& callback) const {
+    snapshot()->forEach(callback);
+  }
+
+  virtual uint32_t count(const uint64_t& fact) const {
+    return snapshot()->count(fact);
+  }
+
+  virtual std::shared_ptr<const FactDB> snapshot() const {
+    return std::atomic_load(&current);
+  }
+
+  /**
+   * Add the given facts, logging them. This is safe to call alongside
+   * searches, and alongside other calls to add(), so it can be called on a
+   * knowledge base shared by every search.
+   *
+   * @return The number of facts which were not already in the knowledge base.
+   */
+  uint64_t add(const std::vector<uint64_t>& facts) const;
+
+  /**
+   * Merge the facts added so far into the knowledge base, synchronously.
+   * The knowledge base and the added facts are streamed, in sorted order and
+   * with their counts, into a new sorted knowledge base file next to the log
+   * (the log path, with ".merged" appended), which is then read as readKB()
+   * reads a sorted knowledge base: mapped, and indexed and filtered as
+   * KB_INDEX_LAYOUT and KB_BLOOM_BITS_PER_FACT say. The log is then
+   * rewritten with just the facts added since the merge started.
+   *
+   * @return False if the file couldn't be written, in which case nothing is
+   *         merged.
+   */
+  bool merge() const;
+
+  /** The number of facts added, but not yet merged */
+  inline uint64_t deltaSize() const { return numAdded; }
+
+  /** The number of merges which have been run */
+  inline uint64_t numMerges() const { return mergeCount; }
+
+ private:
+  /**
+   * Replace the current snapshot with the base and the layers of the delta,
+   * each layer a DeltaFactDB over the ones before it; the caller holds
+   * writeLock.
+   */
+  void publish() const;
+
+  /** The loop of the background merge thread; a failed merge is retried after a wait */
+  void mergeLoop();
+
+  mutable std::shared_ptr<const FactDB> current;
+  /** The knowledge base the delta was added to */
+  mutable std::shared_ptr<const FactDB> base;
+  /** The layers of the delta, largest (and oldest) first */
+  mutable std::vector<std::shared_ptr<const btree::btree_set<uint64_t> > > layers;
+  mutable std::atomic<uint64_t> numAdded;
+  mutable FILE* log;
+  std::string logPath;
+  /** The file the merged knowledge base is written to */
+  std::string mergedPath;
+  uint64_t mergeThreshold;
+  mutable std::atomic<uint64_t> mergeCount;
+  /** Held to add facts, or to publish a snapshot */
+  mutable std::mutex writeLock;
+  /** Held for the duration of a merge */
+  mutable std::mutex mergeLock;
+  mutable std::condition_variable mergeNeeded;
+  bool stopping;
+  std::thread merger;
+};
+
+/**
+ * If KB_LOG_FILE is set, wrap the knowledge base in a MutableFactDB logging
+ * to it; otherwise, return the knowledge base as it is.
+ */
+const FactDB* openKBLog(const FactDB* kb);
+
 /**
  * Appends the given facts to the fact stream.
  *
@@ -33,14 +817,219 @@ inline const btree::btree_set<uint64_t>* readKB(
 }
 
 /**
- * Reads a knowledge base from a given serialized file. This file should be
- * a simple sequence of hashed values; each 8 bytes represents a fact, followed
- * immediately by the next fact.
+ * Sort the facts in place: each thread sorts a chunk, and the chunks are
+ * then merged pairwise in parallel.
+ *
+ * @param facts The facts to sort.
+ * @param numThreads The number of threads to use; 0 uses every core.
+ */
+void sortFacts(std::vector<uint64_t>* facts, uint32_t numThreads);
+
+/** Sort the facts in place, as sortFacts(), and deduplicate them */
+void sortUniqueFacts(std::vector<uint64_t>* facts, uint32_t numThreads);
+
+/**
+ * Deduplicate sorted facts in place, dropping the facts which occur fewer
+ * than minCount times.
+ *
+ * @return The number of distinct facts dropped.
+ */
+uint64_t keepFrequentFacts(std::vector<uint64_t>* facts, const uint32_t& minCount);
+
+/**
+ * Build a btree set from sorted, distinct facts. Every fact is appended at
+ * the end of the tree, where the btree splits full nodes unevenly in favor
+ * of the left node; so the nodes it leaves behind are packed, and each
+ * insertion is constant time.
+ */
+btree::btree_set<uint64_t>* bulkBuildKB(const std::vector<uint64_t>& facts);
+
+/**
+ * Build a btree set from sorted, distinct facts, as bulkBuildKB(), but hand
+ * the memory of the facts back to the system a chunk at a time as they are
+ * added; so the facts and the finished tree are never both in memory.
+ * The facts are empty afterwards.
+ */
+btree::btree_set<uint64_t>* drainIntoKB(std::vector<uint64_t>* facts);
+
+/**
+ * Writes a sorted knowledge base (see MappedFactDB) a fact at a time, so
+ * that the facts never need to be in memory all at once. The counts of the
+ * facts are written alongside them.
+ */
+class KBWriter {
+ public:
+  ~KBWriter();
+
+  /**
+   * Append a fact. Facts must be added in sorted order; a fact equal to the
+   * last one added adds to its count.
+   *
+   * @param fact The fact to add.
+   * @param count The number of times the fact was seen.
+   *
+   * @return False if the fact is out of order, and was not added.
+   */
+  inline bool add(const uint64_t& fact, const uint64_t& count = 1) {
+    if (numFacts > 0 && fact <= last) {
+      if (fact != last) { return false; }
+      lastCount += count;
+      return true;
+    }
+    if (numFacts > 0) { addCount(); }
+    buffer.push_back(fact);
+    checksum = (checksum ^ fact) * 0x100000001b3;
+    last = fact;
+    lastCount = count;
+    numFacts += 1;
+    if (buffer.size() == buffer.capacity()) { flush(); }
+    return true;
+  }
+
+  /** The number of (distinct) facts written so far */
+  inline uint64_t size() const { return numFacts; }
+
+  /**
+   * Write the remaining facts, and the header, and close the file.
+   *
+   * @return False if the file could not be written.
+   */
+  bool close();
+
+  /**
+   * Create the knowledge base file.
+   *
+   * @return The writer, or NULL if the file can't be created.
+   */
+  static KBWriter* open(const char* path);
+
+ private:
+  KBWriter(FILE* file, FILE* countFile, const std::string& countPath);
+
+  /** Buffer the count of the last fact, now that it is complete */
+  void addCount();
+
+  /** Write out the buffered facts, and counts */
+  void flush();
+
+  FILE* file;
+  /** A temporary file of the counts, which are appended to the facts at the end */
+  FILE* countFile;
+  std::string countPath;
+  std::vector<uint64_t> buffer;
+  std::vector<uint16_t> countBuffer;
+  uint64_t numFacts;
+  uint64_t last;
+  uint64_t lastCount;
+  uint64_t checksum;
+  bool ok;
+};
+
+/**
+ * Sorts and deduplicates more facts than fit in memory, and writes them as a
+ * sorted knowledge base, with the number of times each fact was added.
+ * Facts are collected into a buffer; each time it fills, it is sorted in
+ * parallel (see sortFacts()) and written to a temporary run file of facts and
+ * their counts, on a background thread, while the next buffer fills. At the
+ * end, the runs are merged into the knowledge base in one pass.
+ */
+class ExternalFactSorter {
+ public:
+  /**
+   * @param runPrefix The path prefix of the temporary run files; e.g., the
+   *                  path of the knowledge base being written.
+   * @param memoryBytes The memory to use for buffering facts.
+   * @param numThreads The number of threads to sort with; 0 uses every core.
+   */
+  ExternalFactSorter(const std::string& runPrefix, const uint64_t& memoryBytes,
+                     const uint32_t& numThreads);
+
+  /** Deletes the temporary runs */
+  ~ExternalFactSorter();
+
+  /** Add a fact, in any order */
+  inline void add(const uint64_t& fact) {
+    buffer.push_back(fact);
+    numAdded += 1;
+    if (buffer.size() >= bufferCapacity) { spill(); }
+  }
+
+  /**
+   * Write every fact added, sorted and deduplicated, as a knowledge base.
+   *
+   * @param path The knowledge base to write.
+   * @param numFacts [output] The number of distinct facts written.
+   *
+   * @return False if the knowledge base, or a run, could not be written.
+   */
+  bool write(const char* path, uint64_t* numFacts);
+
+  /** The number of facts added, including duplicates */
+  inline uint64_t size() const { return numAdded; }
+
+  /** The number of runs written to disk so far */
+  inline uint64_t numRuns() const { return runs.size(); }
+
+ private:
+  /** Sort and write out the buffer as a run, in the background */
+  void spill();
+
+  std::string runPrefix;
+  uint64_t bufferCapacity;
+  uint32_t numThreads;
+  std::vector<uint64_t> buffer;
+  /** The buffer being sorted and written by spiller */
+  std::vector<uint64_t> spilling;
+  std::thread spiller;
+  std::vector<std::string> runs;
+  uint64_t numAdded;
+  std::atomic<bool> ok;
+};
+
+/**
+ * Sort and deduplicate the given facts, and write them as a knowledge base
+ * which can be memory mapped by MappedFactDB::open(). The number of times
+ * each fact occurs is written as its count.
+ *
+ * @param facts The facts to write. These are sorted and deduplicated in place.
+ * @param path The file to write to.
+ *
+ * @return False if the file could not be written.
+ */
+bool writeSortedKB(std::vector<uint64_t>* facts, const char* path);
+
+/**
+ * Reads a knowledge base from a given serialized file. This is either a
+ * sorted knowledge base written by writeSortedKB(), which is memory mapped,
+ * or a simple sequence of hashed values, which is read into memory; in the
+ * latter case each 8 bytes represents a fact, followed immediately by the
+ * next fact. These are sorted in parallel, and the btree is built from the
+ * sorted facts, releasing them as it goes (see drainIntoKB()).
+ *
+ * A sorted knowledge base is searched in place, unless KB_INDEX_LAYOUT is
+ * KB_LAYOUT_EYTZINGER, in which case it is copied into that layout. If
+ * KB_INDEX_LAYOUT is 3, either kind of knowledge base is compressed into an
+ * EliasFanoFactDB rather than held in a btree or mapped. If it is 4, a sorted
+ * knowledge base is read as a TieredFactDB.
+ * If KB_BLOOM_BITS_PER_FACT is set, a Bloom filter is built in front of the
+ * knowledge base, and its false positive rate is reported.
+ *
+ * Facts seen fewer than minFactCount times are left out: the counts of a
+ * sorted knowledge base are written alongside it, and the count of a fact in
+ * a raw knowledge base is the number of times it occurs in the file. A
+ * knowledge base copied into memory (see KB_INDEX_LAYOUT) keeps no counts.
  *
  * @param path The path to the file.
- * 
- * @return A set representing the facts in the knowledge base.
+ * @param minFactCount The number of times a fact must have been seen.
+ *
+ * @return The knowledge base.
+ */
+const FactDB* readKB(std::string path, const uint32_t& minFactCount);
+
+/**
+ * Read a knowledge base, as above, with the minimum fact count configured by
+ * the environment variable MIN_FACT_COUNT_ENV_VAR, or else MIN_FACT_COUNT.
  */
-const btree::btree_set<uint64_t>* readKB(std::string path);
+const FactDB* readKB(std::string path);
 
 #endif
@@ -130,8 +130,8 @@ BidirectionalGraph::BidirectionalGraph(const Graph* impl)
   uint32_t length;
   for (uint32_t sink = 0; sink < size; ++sink) {
     const edge* incomingFromSink = incomingEdgesFast(sink, &length);
-    for (uint32_t source = 0; source < length; ++source) {
-      outgoingEdgeData[source].push_back(incomingFromSink[source]);
+    for (uint32_t edgeI = 0; edgeI < length; ++edgeI) {
+      outgoingEdgeData[incomingFromSink[edgeI].source].push_back(incomingFromSink[edgeI]);
     }
   }
 }
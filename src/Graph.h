@@ -71,6 +71,15 @@ class BidirectionalGraph : public Graph {
     }
     return rtn;
   }
+
+  /**
+   * Get all outgoing edges from a source word, ignoring word senses.
+   * @see incomingEdgesFast(const word&, uint32_t*)
+   */
+  inline const edge* outgoingEdgesFast(const word& source, uint32_t* outputLength) const {
+    *outputLength = outgoingEdgeData[source].size();
+    return outgoingEdgeData[source].data();
+  }
   
   /** {@inheritDoc} */
   virtual const edge* incomingEdgesFast(const word& sink, uint32_t* outputLength) const {
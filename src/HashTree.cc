@@ -10,15 +10,89 @@
 #include "NaturalLIIO.h"
 #include "SynSearch.h"
 #include "Graph.h"
+#include "Utils.h"
 
 using namespace std;
 
+/** The memory to sort facts in for -o, if not given with -m */
+#define DEFAULT_MEMORY_MB 1024
+
+/**
+ * Hash a whole stream of trees from stdin on every core (see hashTrees()).
+ * The hashes are written to stdout as binary uint64_t values, in the order
+ * the trees were read -- the raw knowledge base format read by readKB() --
+ * or, if kbPath is given, sorted into a knowledge base with the number of
+ * times each fact was seen, as write_kb would.
+ */
+int32_t batchMain(const uint32_t& numThreads, const char* kbPath,
+                  const uint64_t& memoryMB) {
+  ExternalFactSorter* sorter = NULL;
+  if (kbPath != NULL) {
+    sorter = new ExternalFactSorter(string(kbPath), memoryMB * 1024 * 1024, numThreads);
+  }
+  bool ok = true;
+  uint64_t numSkipped = 0;
+  const uint64_t numHashed = hashTrees(stdin, numThreads,
+      [sorter, &ok](const uint64_t* hashes, const uint64_t& count) -> void {
+        if (sorter != NULL) {
+          for (uint64_t i = 0; i < count; ++i) { sorter->add(hashes[i]); }
+        } else if (fwrite(hashes, sizeof(uint64_t), count, stdout) != count) {
+          ok = false;
+        }
+      }, &numSkipped);
+  printTime("[%c] ");
+  fprintf(stderr, "Hashed %lu trees (%lu empty, too long, or repeated in a sentence)\n",
+          numHashed, numSkipped);
+
+  if (sorter != NULL) {
+    uint64_t numFacts = 0;
+    ok = sorter->write(kbPath, &numFacts);
+    printTime("[%c] ");
+    fprintf(stderr, "Wrote %lu distinct facts to %s\n", numFacts, kbPath);
+    delete sorter;
+  } else {
+    ok = (fflush(stdout) == 0) && ok;
+  }
+  if (!ok) {
+    fprintf(stderr, "Could not write the hashes!\n");
+    return 1;
+  }
+  return 0;
+}
 
 /**
  * The Entry point for streaming dependency trees into candidate
  * facts.
+ *
+ * By default, each tree is hashed as soon as it is read, and its hash is
+ * printed as text. With -b, the trees are hashed in batches instead; see
+ * batchMain().
+ *
+ * Usage: hash_tree [-b [-j threads] [-o kb_file [-m megabytes]]]
  */
 int32_t main( int32_t argc, char *argv[] ) {
+  bool batch = false;
+  uint32_t numThreads = 0;
+  const char* kbPath = NULL;
+  uint64_t memoryMB = DEFAULT_MEMORY_MB;
+  for (int32_t argI = 1; argI < argc; ++argI) {
+    if (string(argv[argI]) == "-b") {
+      batch = true;
+    } else if (string(argv[argI]) == "-j" && argI + 1 < argc) {
+      numThreads = strtoul(argv[++argI], NULL, 10);
+    } else if (string(argv[argI]) == "-o" && argI + 1 < argc) {
+      kbPath = argv[++argI];
+    } else if (string(argv[argI]) == "-m" && argI + 1 < argc) {
+      memoryMB = strtoul(argv[++argI], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: hash_tree [-b [-j threads] [-o kb_file [-m megabytes]]]\n");
+      exit(1);
+    }
+  }
+  if (batch) {
+    return batchMain(numThreads, kbPath, memoryMB);
+  }
+
   while (!cin.fail()) {
     Tree* sentence = readTreeFromStdin();
     if (sentence != NULL) {
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "FactDB.h"
+#include "btree_set.h"
+
+using namespace std;
+
+/** The number of lookups to time per index */
+#define DEFAULT_NUM_LOOKUPS 10000000
+
+/**
+ * Time the given lookups, printing the lookups per second, the latency of a
+ * lookup, and the bytes per fact the index takes.
+ */
+template<class LOOKUP>
+void timeLookups(const char* name, const uint64_t& numFacts, const uint64_t& bytes,
+                 const vector<uint64_t>& queries, LOOKUP contains) {
+  uint64_t hits = 0;
+  auto start = chrono::steady_clock::now();
+  for (auto iter = queries.begin(); iter != queries.end(); ++iter) {
+    hits += contains(*iter) ? 1 : 0;
+  }
+  const double seconds =
+    chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  printf("%12lu facts  %-14s %8.2fM lookups/s  %7.1f ns/lookup  %6.2f bytes/fact  (%lu hits)\n",
+         numFacts, name, queries.size() / seconds / 1e6, seconds * 1e9 / queries.size(),
+         ((double) bytes) / numFacts, hits);
+  fflush(stdout);
+}
+
+/**
+ * Benchmark KB lookups with each index over random (uniform) fact hashes,
+ * against btree_set::find(). Half of the lookups are facts in the KB.
+ * Memory use peaks at around 20 bytes per fact, for the btree.
+ *
+ * Usage: kb_benchmark [num_facts ...] [-n num_lookups]
+ *   e.g., kb_benchmark 10000000 100000000 1000000000
+ */
+int32_t main( int32_t argc, char *argv[] ) {
+  vector<uint64_t> sizes;
+  uint64_t numLookups = DEFAULT_NUM_LOOKUPS;
+  for (int32_t i = 1; i < argc; ++i) {
+    if (string(argv[i]) == "-n" && i + 1 < argc) {
+      numLookups = strtoul(argv[++i], NULL, 10);
+    } else {
+      sizes.push_back(strtoul(argv[i], NULL, 10));
+    }
+  }
+  if (sizes.empty()) {
+    sizes.push_back(10000000);
+    sizes.push_back(100000000);
+    sizes.push_back(1000000000);
+  }
+
+  mt19937_64 random(42);
+  for (auto size = sizes.begin(); size != sizes.end(); ++size) {
+    // Create the facts, as write_kb would
+    vector<uint64_t> facts(*size);
+    for (uint64_t i = 0; i < facts.size(); ++i) { facts[i] = random(); }
+    std::sort(facts.begin(), facts.end());
+    facts.erase(std::unique(facts.begin(), facts.end()), facts.end());
+    // Create the queries
+    vector<uint64_t> queries(numLookups);
+    for (uint64_t i = 0; i < queries.size(); ++i) {
+      queries[i] = (i % 2 == 0) ? facts[random() % facts.size()] : random();
+    }
+
+    // Time each index
+    {
+      StaticFactDB kb(facts.data(), facts.size(), KB_LAYOUT_SORTED);
+      timeLookups("binary", facts.size(), facts.size() * sizeof(uint64_t), queries,
+          [&kb](const uint64_t& fact) -> bool { return kb.contains(fact); });
+    }
+    {
+      StaticFactDB kb(facts.data(), facts.size(), KB_LAYOUT_INTERPOLATION);
+      timeLookups("interpolation", facts.size(), facts.size() * sizeof(uint64_t), queries,
+          [&kb](const uint64_t& fact) -> bool { return kb.contains(fact); });
+    }
+    {
+      StaticFactDB kb(facts.data(), facts.size(), KB_LAYOUT_EYTZINGER);
+      timeLookups("eytzinger", facts.size(), (facts.size() + 1) * sizeof(uint64_t), queries,
+          [&kb](const uint64_t& fact) -> bool { return kb.contains(fact); });
+    }
+    {
+      BloomFactDB kb(new StaticFactDB(facts.data(), facts.size(), KB_LAYOUT_INTERPOLATION),
+                     true, 10);
+      timeLookups("bloom+interp", facts.size(),
+                  facts.size() * sizeof(uint64_t) + kb.numBlocks() * 64, queries,
+          [&kb](const uint64_t& fact) -> bool { return kb.contains(fact); });
+    }
+    {
+      EliasFanoFactDB kb(facts.data(), facts.size());
+      timeLookups("elias-fano", facts.size(), kb.bytesUsed(), queries,
+          [&kb](const uint64_t& fact) -> bool { return kb.contains(fact); });
+    }
+    {
+      btree::btree_set<uint64_t>* kb = bulkBuildKB(facts);
+      const uint64_t numFacts = facts.size();
+      vector<uint64_t>().swap(facts);  // (free the facts before timing)
+      timeLookups("btree_set", numFacts, kb->bytes_used(), queries,
+          [kb](const uint64_t& fact) -> bool { return kb->find(fact) != kb->end(); });
+      delete kb;
+    }
+  }
+  return 0;
+}
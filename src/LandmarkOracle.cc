@@ -0,0 +1,222 @@
+#include "LandmarkOracle.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Utils.h"
+
+using namespace std;
+
+/** The first bytes of a landmark table: "NLLM" */
+#define LANDMARK_MAGIC   0x4D4C4C4E
+#define LANDMARK_VERSION 1
+
+/** A cost larger than any path, standing in for infinity when comparing */
+#define LANDMARK_FAR 1e30f
+
+//
+// Find the cost of the cheapest path between the given word and every
+// other word. If forward is true, these are the costs of mutating the word
+// into every other word; otherwise, the costs of mutating every other word
+// into it.
+//
+void shortestPaths(const BidirectionalGraph& graph, const word& start,
+                   const bool& forward, vector<float>* distance) {
+  typedef pair<float,word> queue_entry;
+  distance->assign(graph.vocabSize(), numeric_limits<float>::infinity());
+  priority_queue<queue_entry, vector<queue_entry>, greater<queue_entry> > queue;
+  (*distance)[start] = 0.0f;
+  queue.push(make_pair(0.0f, start));
+  while (!queue.empty()) {
+    const queue_entry top = queue.top();
+    queue.pop();
+    if (top.first > (*distance)[top.second]) { continue; }  // stale
+    uint32_t numEdges;
+    const edge* edges = forward
+      ? graph.incomingEdgesFast(top.second, &numEdges)
+      : graph.outgoingEdgesFast(top.second, &numEdges);
+    for (uint32_t edgeI = 0; edgeI < numEdges; ++edgeI) {
+      const word next = forward ? edges[edgeI].source : edges[edgeI].sink;
+      const float cost = top.first + edges[edgeI].cost;
+      if (next < distance->size() && cost < (*distance)[next]) {
+        (*distance)[next] = cost;
+        queue.push(make_pair(cost, next));
+      }
+    }
+  }
+}
+
+//
+// LandmarkOracle::LandmarkOracle()
+//
+LandmarkOracle::LandmarkOracle(char* data, const uint64_t& size, const bool& mapped)
+    : data(data), size(size), mapped(mapped) {
+  header = (const landmark_header*) data;
+  landmarks = (const word*) (data + sizeof(landmark_header));
+  costs = (const float*) (data + sizeof(landmark_header) +
+                          header->numLandmarks * sizeof(word));
+}
+
+//
+// LandmarkOracle::~LandmarkOracle()
+//
+LandmarkOracle::~LandmarkOracle() {
+  if (mapped) {
+    munmap(data, size);
+  } else {
+    free(data);
+  }
+}
+
+//
+// LandmarkOracle::tableSize()
+//
+uint64_t LandmarkOracle::tableSize(const uint32_t& numLandmarks,
+                                   const uint64_t& vocabSize) {
+  return sizeof(landmark_header) + numLandmarks * sizeof(word) +
+         vocabSize * 2 * numLandmarks * sizeof(float);
+}
+
+//
+// LandmarkOracle::build()
+//
+LandmarkOracle* LandmarkOracle::build(const BidirectionalGraph& graph,
+                                      const uint32_t& requestedLandmarks) {
+  const uint64_t vocabSize = graph.vocabSize();
+  // Count the edges of each word; a word without edges can't be a landmark
+  vector<uint32_t> degree(vocabSize, 0);
+  uint64_t numCandidates = 0;
+  for (word w = 0; w < vocabSize; ++w) {
+    uint32_t numIncoming, numOutgoing;
+    graph.incomingEdgesFast(w, &numIncoming);
+    graph.outgoingEdgesFast(w, &numOutgoing);
+    degree[w] = numIncoming + numOutgoing;
+    if (degree[w] > 0) { numCandidates += 1; }
+  }
+  const uint32_t numLandmarks = requestedLandmarks < numCandidates
+    ? requestedLandmarks : numCandidates;
+
+  // Allocate the table
+  const uint64_t size = tableSize(numLandmarks, vocabSize);
+  char* data = (char*) malloc(size);
+  memset(data, 0, size);
+  landmark_header* header = (landmark_header*) data;
+  header->magic = LANDMARK_MAGIC;
+  header->version = LANDMARK_VERSION;
+  header->numLandmarks = numLandmarks;
+  header->vocabSize = vocabSize;
+  word* landmarks = (word*) (data + sizeof(landmark_header));
+  float* costs = (float*) (data + sizeof(landmark_header) + numLandmarks * sizeof(word));
+
+  // Choose the landmarks, and fill in their costs
+  // (the distance from each word to its closest landmark, in either direction)
+  vector<float> closest(vocabSize, numeric_limits<float>::infinity());
+  vector<float> fromLandmark;
+  vector<float> toLandmark;
+  for (uint32_t l = 0; l < numLandmarks; ++l) {
+    // (pick the next landmark)
+    word landmark = 0;
+    bool found = false;
+    for (word w = 0; w < vocabSize; ++w) {
+      if (degree[w] == 0) { continue; }
+      if (!found || closest[w] > closest[landmark] ||
+          (closest[w] == closest[landmark] && degree[w] > degree[landmark])) {
+        landmark = w;
+        found = true;
+      }
+    }
+    landmarks[l] = landmark;
+    closest[landmark] = -numeric_limits<float>::infinity();  // (never again)
+    // (compute its costs)
+    shortestPaths(graph, landmark, true, &fromLandmark);
+    shortestPaths(graph, landmark, false, &toLandmark);
+    for (word w = 0; w < vocabSize; ++w) {
+      costs[((uint64_t) w) * 2 * numLandmarks + l] = fromLandmark[w];
+      costs[((uint64_t) w) * 2 * numLandmarks + numLandmarks + l] = toLandmark[w];
+      const float distance = min(fromLandmark[w], LANDMARK_FAR) + min(toLandmark[w], LANDMARK_FAR);
+      if (distance < closest[w]) { closest[w] = distance; }
+    }
+    printTime("[%c] ");
+    fprintf(stderr, "  landmark %u / %u: %s\n", l + 1, numLandmarks, graph.gloss(getTaggedWord(landmark, 0, 0)));
+  }
+
+  return new LandmarkOracle(data, size, false);
+}
+
+//
+// LandmarkOracle::summarizeGoals()
+//
+landmark_goals LandmarkOracle::summarizeGoals(const vector<word>& goals) const {
+  const uint32_t numLandmarks = header->numLandmarks;
+  landmark_goals summary;
+  summary.minToGoal.resize(numLandmarks, numeric_limits<float>::infinity());
+  summary.maxFromGoal.resize(numLandmarks, -numeric_limits<float>::infinity());
+  for (auto iter = goals.begin(); iter != goals.end(); ++iter) {
+    if (*iter >= header->vocabSize) { continue; }
+    const float* goalCosts = costs + ((uint64_t) *iter) * 2 * numLandmarks;
+    for (uint32_t l = 0; l < numLandmarks; ++l) {
+      summary.minToGoal[l] = min(summary.minToGoal[l], goalCosts[l]);
+      summary.maxFromGoal[l] = max(summary.maxFromGoal[l], goalCosts[numLandmarks + l]);
+    }
+  }
+  return summary;
+}
+
+//
+// LandmarkOracle::writeTo()
+//
+bool LandmarkOracle::writeTo(const char* path) const {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) { return false; }
+  const bool ok = fwrite(data, 1, size, file) == size;
+  return (fclose(file) == 0) && ok;
+}
+
+//
+// LandmarkOracle::open()
+//
+LandmarkOracle* LandmarkOracle::open(const char* path) {
+  const int fd = ::open(path, O_RDONLY);
+  if (fd < 0) { return NULL; }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (uint64_t) info.st_size < sizeof(landmark_header)) {
+    close(fd);
+    return NULL;
+  }
+  const uint64_t size = info.st_size;
+  void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) { return NULL; }
+  const landmark_header* header = (const landmark_header*) data;
+  if (header->magic != LANDMARK_MAGIC || header->version != LANDMARK_VERSION ||
+      size != tableSize(header->numLandmarks, header->vocabSize)) {
+    munmap(data, size);
+    return NULL;
+  }
+  return new LandmarkOracle((char*) data, size, true);
+}
+
+//
+// ReadLandmarks()
+//
+LandmarkOracle* ReadLandmarks() {
+  if (LANDMARK_FILE[0] == '\0') {
+    return NULL;
+  }
+  LandmarkOracle* oracle = LandmarkOracle::open(LANDMARK_FILE);
+  printTime("[%c] ");
+  if (oracle == NULL) {
+    fprintf(stderr, "Could not read landmark table: %s\n", LANDMARK_FILE);
+  } else {
+    fprintf(stderr, "Read %u landmarks for %lu words from %s\n",
+            oracle->numLandmarks(), oracle->vocabSize(), LANDMARK_FILE);
+  }
+  return oracle;
+}
@@ -0,0 +1,181 @@
+#ifndef LANDMARK_ORACLE_H
+#define LANDMARK_ORACLE_H
+
+#include <limits>
+#include <vector>
+
+#include "config.h"
+#include "Types.h"
+#include "Graph.h"
+
+#ifndef LANDMARK_FILE
+  #define LANDMARK_FILE ""
+#endif
+
+/**
+ * The header of a landmark table; @see LandmarkOracle.
+ */
+struct landmark_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numLandmarks;
+  uint32_t reserved;
+  uint64_t vocabSize;
+};
+
+/**
+ * The costs between each landmark and the nearest (or furthest) of a set of
+ * goal words; @see LandmarkOracle::summarizeGoals().
+ */
+struct landmark_goals {
+  /** For each landmark, the least cost from it to a goal word */
+  std::vector<float> minToGoal;
+  /** For each landmark, the greatest cost from a goal word to it */
+  std::vector<float> maxFromGoal;
+};
+
+/**
+ * A lower bound on the cost of mutating one word into another, from the
+ * shortest path costs between every word and a few landmark words. By the
+ * triangle inequality, for any landmark l:
+ *
+ *   d(a, b) >= d(l, b) - d(l, a)   and   d(a, b) >= d(a, l) - d(b, l)
+ *
+ * A cost is the sum of the edge costs along a path in the mutation graph,
+ * where a word mutates from an edge's sink to the edge's source. This is a
+ * bound on the graph's edge costs, not on the (per edge) search costs.
+ *
+ * The table is built offline (see write_landmarks), and memory mapped when
+ * it is read. For each word, it stores the cost from each landmark to the
+ * word, followed by the cost from the word to each landmark; an unreachable
+ * word has an infinite cost.
+ */
+class LandmarkOracle {
+ public:
+  ~LandmarkOracle();
+
+  /**
+   * A lower bound on the cost of mutating the first word into the second.
+   * This is infinite if the landmarks show that it can't be done, and 0 for a
+   * word not in the table.
+   */
+  inline float lowerBound(const word& from, const word& to) const {
+    if (from == to || from >= header->vocabSize || to >= header->vocabSize) {
+      return 0.0f;
+    }
+    const uint32_t numLandmarks = header->numLandmarks;
+    const float* fromCosts = costs + ((uint64_t) from) * 2 * numLandmarks;
+    const float* toCosts = costs + ((uint64_t) to) * 2 * numLandmarks;
+    float bound = 0.0f;
+    for (uint32_t l = 0; l < numLandmarks; ++l) {
+      // (d(l, to) - d(l, from))
+      bound = tighten(bound, toCosts[l], fromCosts[l]);
+      // (d(from, l) - d(to, l))
+      bound = tighten(bound, fromCosts[numLandmarks + l], toCosts[numLandmarks + l]);
+    }
+    return bound;
+  }
+
+  /**
+   * The smallest lower bound on mutating the word into any of the targets.
+   * A target not in the table (e.g., INVALID_WORD) is not in the graph, so
+   * no word mutates into it; it is skipped.
+   */
+  inline float lowerBound(const word& from, const std::vector<word>& targets) const {
+    float bound = std::numeric_limits<float>::infinity();
+    for (auto iter = targets.begin(); iter != targets.end(); ++iter) {
+      if (*iter >= header->vocabSize) { continue; }
+      const float candidate = lowerBound(from, *iter);
+      if (candidate < bound) {
+        bound = candidate;
+        if (bound == 0.0f) { break; }
+      }
+    }
+    return bound;
+  }
+
+  /**
+   * Summarize the costs between the landmarks and a set of goal words, once
+   * per query, for the bound below. Goal words not in the table are skipped,
+   * as above.
+   */
+  landmark_goals summarizeGoals(const std::vector<word>& goals) const;
+
+  /**
+   * A lower bound on mutating the word into any of the summarized goals, in
+   * O(numLandmarks()) rather than O(numLandmarks() * goals). For every
+   * landmark l, and so for the nearest goal g,
+   *
+   *   d(from, g) >= min_g d(l, g) - d(l, from)
+   *   d(from, g) >= d(from, l) - max_g d(g, l)
+   *
+   * This is looser than the bound above, but infinite whenever some landmark
+   * shows that no goal can be reached at all; and 0 for a word not in the
+   * table.
+   */
+  inline float lowerBound(const word& from, const landmark_goals& goals) const {
+    if (from >= header->vocabSize) { return 0.0f; }
+    const uint32_t numLandmarks = header->numLandmarks;
+    const float* fromCosts = costs + ((uint64_t) from) * 2 * numLandmarks;
+    float bound = 0.0f;
+    for (uint32_t l = 0; l < numLandmarks; ++l) {
+      bound = tighten(bound, goals.minToGoal[l], fromCosts[l]);
+      bound = tighten(bound, fromCosts[numLandmarks + l], goals.maxFromGoal[l]);
+    }
+    return bound;
+  }
+
+  /** The number of landmarks in the table */
+  inline uint32_t numLandmarks() const { return header->numLandmarks; }
+
+  /** The i'th landmark word */
+  inline word landmark(const uint32_t& i) const { return landmarks[i]; }
+
+  /** The number of words in the table */
+  inline uint64_t vocabSize() const { return header->vocabSize; }
+
+  /**
+   * Build the table for a graph. The first landmark is the best connected
+   * word; each subsequent landmark is the word furthest from the landmarks
+   * chosen so far.
+   *
+   * @param graph The mutation graph, with its outgoing edges.
+   * @param numLandmarks The number of landmarks to choose.
+   */
+  static LandmarkOracle* build(const BidirectionalGraph& graph,
+                               const uint32_t& numLandmarks);
+
+  /** Write the table to a file, to be read by open(); false on an I/O error */
+  bool writeTo(const char* path) const;
+
+  /** Memory map a table written by writeTo(); NULL if it can't be read */
+  static LandmarkOracle* open(const char* path);
+
+ private:
+  LandmarkOracle(char* data, const uint64_t& size, const bool& mapped);
+
+  /** Tighten a bound with the difference x - y, where either may be infinite */
+  static inline float tighten(const float& bound, const float& x, const float& y) {
+    if (y == std::numeric_limits<float>::infinity()) { return bound; }
+    const float difference = x - y;
+    return difference > bound ? difference : bound;
+  }
+
+  /** The size of a table with the given dimensions, in bytes */
+  static uint64_t tableSize(const uint32_t& numLandmarks, const uint64_t& vocabSize);
+
+  char* data;
+  uint64_t size;
+  bool mapped;
+  const landmark_header* header;
+  const word* landmarks;
+  const float* costs;
+};
+
+/**
+ * Read the landmark table configured as LANDMARK_FILE.
+ * @return The oracle, or NULL if no table is configured or it can't be read.
+ */
+LandmarkOracle* ReadLandmarks();
+
+#endif
@@ -1,5 +1,6 @@
 #include "NaturalLIIO.h"
 
+#include "LandmarkOracle.h"
 #include "Utils.h"
 
 #include <arpa/inet.h>
@@ -85,11 +86,12 @@ void init() {
  * Note that this is truth independent at this point.
  *
  * @param response The search response.
+ * @param argmax Set to the index of the most confident path in the response,
+ *               if there is one.
  * @return A confidence value between 0 and 1/2;
  */
 double confidence(const syn_search_response &response,
-                  const vector<SearchNode> **argmax,
-                  const feature_vector **argmax2) {
+                  int64_t *argmax) {
   if (response.size() == 0) {
     return 0.0;
   }
@@ -99,8 +101,7 @@ double confidence(const syn_search_response &response,
     double confidence = 1.0 / (1.0 + exp(cost));
     if (confidence > max) {
       max = confidence;
-      *argmax = &(response.paths[i].nodeSequence);
-      *argmax2 = &(response.featurizedPaths[i]);
+      *argmax = i;
     }
   }
   return max;
@@ -282,6 +283,15 @@ bool parseMetadata(const char *rawLine, SynSearchCosts **costs,
     } else if (toSet == "skipNegationSearch") {
       opts->skipNegationSearch = to_bool(value);
       fprintf(stderr, "set skipNegationSearch to %u\n", to_bool(value));
+    } else if (toSet == "addPremisesToKB") {
+      opts->addPremisesToKB = to_bool(value);
+      fprintf(stderr, "set addPremisesToKB to %u\n", to_bool(value));
+    } else if (toSet == "negationSearchMargin") {
+      opts->negationSearchMargin = atof(value.c_str());
+      fprintf(stderr, "set negationSearchMargin to %f\n", opts->negationSearchMargin);
+    } else if (toSet == "factCountBonus") {
+      opts->factCountBonus = atof(value.c_str());
+      fprintf(stderr, "set factCountBonus to %f\n", opts->factCountBonus);
     } else if (toSet == "alignment") {
       if (alignments->size() < MAX_FUZZY_MATCHES) {
         alignments->push_back(parseAlignment(value));
@@ -354,7 +364,7 @@ bool existsSoftFalseJudgment(const float* ifTrue, const float* ifFalse, const fl
 //
 // executeQuery()
 //
-string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
+string executeQuery(const vector<Tree*> premises, const FactDB *kb,
                     const Tree* query,
                     const Graph *graph, const SynSearchCosts *costs,
                     vector<AlignmentSimilarity> alignments,
@@ -364,6 +374,8 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
   bool doAlignments = (alignments.size() == 0);
   btree_set<uint64_t> auxKB;
   uint32_t factsInserted = 0;
+  // (the query's tokens, shared across every premise alignment)
+  alignment_token_table* queryTokens = NULL;
   for (auto treeIter = premises.begin(); treeIter != premises.end();
        ++treeIter) {
     Tree *premise = *treeIter;
@@ -378,16 +390,38 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
     // align the tree
     if (doAlignments && alignments.size() < MAX_FUZZY_MATCHES) {
       fprintf(stderr, "ALIGNING %s\n", toString(*premise, *graph).c_str());
-      AlignmentSimilarity alignment = query->alignToPremise(*premise, *graph);
+      if (queryTokens == NULL) {
+        queryTokens = new alignment_token_table(*query, *graph);
+      }
+      AlignmentSimilarity alignment = Tree::alignToPremise(
+          *queryTokens, alignment_token_table(*premise, *graph));
       alignment.debugPrint(*query, *graph);  // debug print the alignment
       fprintf(stderr, "  score (if true):  %f\n", alignment.score(*query, true));
       fprintf(stderr, "  score (if false): %f\n", alignment.score(*query, false));
       alignments.push_back(alignment);
     }
   }
+  if (queryTokens != NULL) {
+    delete queryTokens;
+  }
   printTime("[%c] ");
   fprintf(stderr, "|KB| %lu premise(s) added, yielding %u total facts\n",
           premises.size(), factsInserted);
+  // (add the premises to the knowledge base for good, if asked to)
+  if (options.addPremisesToKB) {
+    const MutableFactDB* mutableKB = dynamic_cast<const MutableFactDB*>(kb);
+    printTime("[%c] ");
+    if (mutableKB == NULL) {
+      fprintf(stderr, "|KB| WARNING: the knowledge base is read only (configure with KB_LOG_FILE); not adding premises\n");
+    } else {
+      const vector<uint64_t> premiseHashes(auxKB.begin(), auxKB.end());
+      fprintf(stderr, "|KB| %lu premise(s) added to the knowledge base\n",
+              mutableKB->add(premiseHashes));
+    }
+  }
+  // (the knowledge base doesn't change under the searches)
+  const shared_ptr<const FactDB> kbSnapshot = kb->snapshot();
+  kb = kbSnapshot.get();
   printTime("[%c] ");
   fprintf(stderr, "|ALIGN| %lu alignment(s) registered\n", alignments.size());
 
@@ -399,27 +433,77 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
   }
 
   // Run Search
+  // (only the cheapest path of either search is ever used)
+  syn_search_options trueOptions = options;
+  trueOptions.maxResults = 1;
+  // (without a main KB, only mutations toward a premise word can find
+  //  anything. This is pruned with the outgoing edges of the graph if it
+  //  has them, and with the landmark table if there is one)
+  ReachableWords* premiseWords = NULL;
+#if SEARCH_PREMISE_PRUNING!=0
+  static const LandmarkOracle* landmarks = ReadLandmarks();
+  const BidirectionalGraph* reverseGraph = dynamic_cast<const BidirectionalGraph*>(graph);
+  if (kb->empty() && (landmarks != NULL || reverseGraph != NULL)) {
+    const vector<word> targets = premiseTargets(*graph, premises, alignments);
+    if (reverseGraph != NULL) {
+      premiseWords = new ReachableWords(*reverseGraph, targets,
+          ReachableWords::maxEdgeCost(*costs, trueOptions.costThreshold));
+      trueOptions.premiseWords = premiseWords;
+    }
+    if (landmarks != NULL) {
+      trueOptions.landmarks = landmarks;
+      trueOptions.goalWords = targets;
+    }
+  }
+#endif
+  // (exact matches and pure deletions are looked up before searching;
+  //  unless there are soft alignments, which only the full search scores)
+  kb_lookup_stats fastStats;
+  auto search = [&](const bool& assumedTruth, const syn_search_options& searchOptions) -> syn_search_response {
+    if (alignments.empty() &&
+        searchOptions.maxTicks > 0 && searchOptions.maxFastSearchVariants > 0) {
+      syn_search_response fastResult =
+          FastSearch(graph, kb, auxKB, query, costs, assumedTruth, searchOptions);
+      if (fastResult.paths.size() > 0) {
+        return fastResult;
+      }
+      fastStats += fastResult.kbStats;
+    }
+    return SynSearch(graph, kb, auxKB, query, costs, assumedTruth, searchOptions, alignments);
+  };
   // (assuming the KB is true)
-  const syn_search_response resultIfTrue =
-      SynSearch(graph, kb, auxKB, query, costs, true, options, alignments);
-  // (assuming the KB is false)
-  syn_search_options falseOptions = options;
+  const syn_search_response resultIfTrue = search(true, trueOptions);
+  int64_t bestPathIfTrue = -1;
+  double confidenceOfTrue = confidence(resultIfTrue, &bestPathIfTrue);
+  // (assuming the KB is false; this is only run if the true search was
+  //  inconclusive, as a cheap proof of truth can't be beaten)
+  const char* negationPolicy = "always";
   if (options.skipNegationSearch) {
+    negationPolicy = "never";
+  } else if (options.negationSearchMargin <= 0.5) {
+    negationPolicy = "conditional";
+  }
+  const bool runNegationSearch = !options.skipNegationSearch &&
+      (resultIfTrue.paths.size() == 0 ||
+       confidenceOfTrue < options.negationSearchMargin);
+  syn_search_options falseOptions = trueOptions;
+  if (!runNegationSearch) {
     falseOptions.maxTicks = 0l;
+    if (!options.skipNegationSearch) {
+      printTime("[%c] ");
+      fprintf(stderr, "Skipping the search from false: found a path with confidence %f >= %f\n",
+              confidenceOfTrue, options.negationSearchMargin);
+    }
+  }
+  const syn_search_response resultIfFalse = search(false, falseOptions);
+  if (premiseWords != NULL) {
+    delete premiseWords;
   }
-  const syn_search_response resultIfFalse =
-      SynSearch(graph, kb, auxKB, query, costs, false, falseOptions, alignments);
 
   // Grok result
   // (confidence)
-  const vector<SearchNode> *bestPathIfTrue = NULL;
-  const vector<SearchNode> *bestPathIfFalse = NULL;
-  const feature_vector *bestFeaturesIfTrue = NULL;
-  const feature_vector *bestFeaturesIfFalse = NULL;
-  double confidenceOfTrue =
-      confidence(resultIfTrue, &bestPathIfTrue, &bestFeaturesIfTrue);
-  double confidenceOfFalse =
-      confidence(resultIfFalse, &bestPathIfFalse, &bestFeaturesIfFalse);
+  int64_t bestPathIfFalse = -1;
+  double confidenceOfFalse = confidence(resultIfFalse, &bestPathIfFalse);
   // (soft alignments)
   const uint8_t* closestSoftAlignment = &resultIfTrue.closestSoftAlignment;
   const float* closestSoftAlignmentScoresIfTrue = resultIfTrue.closestSoftAlignmentScores;
@@ -428,20 +512,20 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
   // (truth)
   const char* hardGuess = "unknown";
   const char* softGuess = "unknown";
-  const vector<SearchNode> *bestPath = NULL;
+  vector<SearchNode> bestPath;  // empty if there is no best path
   const feature_vector *bestFeatures = NULL;
   if (confidenceOfTrue > confidenceOfFalse) {
     // Case: hard true
     *truth = probability(confidenceOfTrue, true);
-    bestPath = bestPathIfTrue;
-    bestFeatures = bestFeaturesIfTrue;
+    bestPath = resultIfTrue.nodeSequence(bestPathIfTrue);
+    bestFeatures = &resultIfTrue.featurizedPaths[bestPathIfTrue];
     hardGuess = "true";
     softGuess = "true";
   } else if (confidenceOfTrue < confidenceOfFalse) {
     // Case: hard false
     *truth = probability(confidenceOfFalse, false);
-    bestPath = bestPathIfFalse;
-    bestFeatures = bestFeaturesIfFalse;
+    bestPath = resultIfFalse.nodeSequence(bestPathIfFalse);
+    bestFeatures = &resultIfFalse.featurizedPaths[bestPathIfFalse];
     hardGuess = "false";
     softGuess = "false";
   } else {
@@ -451,9 +535,9 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
       fprintf(stderr, "\033[1;33mWARNING:\033[0m Exactly the same max "
                       "confidence returned for both 'true' and 'false'");
       fprintf(stderr, "  if true: %s\n",
-              toJSON(*graph, *query, *bestPathIfTrue).c_str());
+              toJSON(*graph, *query, resultIfTrue.nodeSequence(bestPathIfTrue)).c_str());
       fprintf(stderr, "  if false: %s\n",
-              toJSON(*graph, *query, *bestPathIfFalse).c_str());
+              toJSON(*graph, *query, resultIfFalse.nodeSequence(bestPathIfFalse)).c_str());
       *truth = 0.5;
     } else if (resultIfFalse.closestSoftAlignmentScore < resultIfTrue.closestSoftAlignmentScore) {
       // Case: soft true
@@ -503,21 +587,32 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
     *truth = 1.0;
   }
 
+  // (knowledge base lookups, including those of a fast search which fell through)
+  kb_lookup_stats kbStats = fastStats;
+  kbStats += resultIfTrue.kbStats;
+  kbStats += resultIfFalse.kbStats;
+
   // Generate JSON
   stringstream rtn;
   rtn << fixed
-      << "{\"numResults\": " << (resultIfTrue.size() + resultIfFalse.size())
+      << "{\"numResults\": " << (resultIfTrue.numResults + resultIfFalse.numResults)
       << ", "
       << "\"totalTicks\": "
       << (resultIfTrue.totalTicks + resultIfFalse.totalTicks) << ", "
+      << "\"negationSearch\": {\"policy\": \"" << negationPolicy << "\", "
+      << "\"margin\": " << options.negationSearchMargin << ", "
+      << "\"ran\": " << (runNegationSearch ? "true" : "false") << "}, "
+      << "\"kbLookups\": {\"lookups\": " << kbStats.lookups << ", "
+      << "\"filterHits\": " << kbStats.filterHits << ", "
+      << "\"diskVerifications\": " << kbStats.diskVerifications << "}, "
       << "\"truth\": " << (*truth) << ", "
       << "\"hardGuess\": \"" << (hardGuess) << "\", "
       << "\"softGuess\": \"" << (softGuess) << "\", "
       << "\"query\": \"" << escapeQuote(toString(*query, *graph)) << "\", "
       << "\"bestPremise\": "
-      << (bestPath == NULL
+      << (bestPath.empty()
               ? "null"
-              : ("\"" + escapeQuote(kbGloss(*graph, *query, *bestPath)) + "\""))
+              : ("\"" + escapeQuote(kbGloss(*graph, *query, bestPath)) + "\""))
       << ", "
       << "\"success\": true"
       << ", "
@@ -528,7 +623,7 @@ string executeQuery(const vector<Tree*> premises, const btree_set<uint64_t> *kb,
       << "\"closestSoftAlignmentSearchCosts\": " << toJSON(closestSoftAlignmentSearchCosts, MAX_FUZZY_MATCHES) << ", "
 #endif
       << "\"path\": "
-      << (bestPath != NULL ? toJSON(*graph, *query, *bestPath) : "[]");
+      << (!bestPath.empty() ? toJSON(*graph, *query, bestPath) : "[]");
   // (dump feature vector)
   if (bestFeatures != NULL) {
     rtn << ", \"features\": {"
@@ -676,7 +771,7 @@ Tree* readTreeFromStdin() {
 // repl()
 //
 uint32_t repl(const Graph *graph, JavaBridge *proc,
-              const btree_set<uint64_t> *kb) {
+              const FactDB *kb) {
   uint32_t failedExamples = 0;
   SynSearchCosts* costs = intermediateNaturalLogicCosts();
   syn_search_options opts;
@@ -735,7 +830,7 @@ uint32_t repl(const Graph *graph, JavaBridge *proc,
 //
 // repl (with trees)
 //
-uint32_t repl(const Graph *graph, const btree_set<uint64_t> *kb) {
+uint32_t repl(const Graph *graph, const FactDB *kb) {
   uint32_t failedExamples = 0;
   SynSearchCosts* costs = intermediateNaturalLogicCosts();
   syn_search_options opts;
@@ -831,7 +926,7 @@ void closeConnection(const uint32_t socket, sockaddr_in *client) {
 //
 // executeQuery() w/JavaBridge
 //
-string executeQuery(const JavaBridge *proc, const btree_set<uint64_t> *kb,
+string executeQuery(const JavaBridge *proc, const FactDB *kb,
                     const vector<string> &knownFacts, const string &query,
                     const Graph *graph, const SynSearchCosts *costs,
                     const vector<AlignmentSimilarity>& alignments,
@@ -918,7 +1013,7 @@ ssize_t readLine(uint32_t fd, char *buf, size_t n) {
  */
 void handleConnection(const uint32_t &socket, sockaddr_in *client,
                       const JavaBridge *proc, const Graph *graph,
-                      const btree_set<uint64_t> *kb) {
+                      const FactDB *kb) {
 
   // Initialize options
   SynSearchCosts* costs = intermediateNaturalLogicCosts();
@@ -980,7 +1075,7 @@ void handleConnection(const uint32_t &socket, sockaddr_in *client,
 // startServer
 //
 bool startServer(const uint32_t &port, const JavaBridge *proc,
-                 const Graph *graph, const btree_set<uint64_t> *kb) {
+                 const Graph *graph, const FactDB *kb) {
   // Get hostname, for debugging
   char hostname[256];
   gethostname(hostname, 256);
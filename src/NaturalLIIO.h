@@ -47,7 +47,7 @@ bool parseMetadata(const char *rawLine, SynSearchCosts *costs,
  *
  * @return A JSON formatted response with the result of the search.
  */
-std::string executeQuery(const std::vector<Tree*> premises, const btree::btree_set<uint64_t> *kb,
+std::string executeQuery(const std::vector<Tree*> premises, const FactDB *kb,
                          const std::vector<std::string> &knownFacts, const std::string &query,
                          const Graph *graph, const SynSearchCosts *costs,
                          const std::vector<AlignmentSimilarity>& alignments,
@@ -57,7 +57,7 @@ std::string executeQuery(const std::vector<Tree*> premises, const btree::btree_s
 /**
  * Execute a query using the java bridge to annotate the trees.
  */
-std::string executeQuery(const JavaBridge *proc, const btree::btree_set<uint64_t> *kb,
+std::string executeQuery(const JavaBridge *proc, const FactDB *kb,
                          const std::vector<std::string> &knownFacts, const std::string &query,
                          const Graph *graph, const SynSearchCosts *costs,
                          const std::vector<AlignmentSimilarity>& alignments,
@@ -94,17 +94,17 @@ Tree* readTreeFromStdin(SynSearchCosts* costs,
  * @return The number of failed examples, if any were annotated. 0 by default.
  */
 uint32_t repl(const Graph *graph, JavaBridge *proc,
-              const btree::btree_set<uint64_t> *kb);
+              const FactDB *kb);
 
 /**
- * @see repl(Graph* JavaBridge* btree::btree_set<uint64_t>)
+ * @see repl(Graph* JavaBridge* FactDB)
  */
-uint32_t repl(const Graph *graph, const btree::btree_set<uint64_t> *kb);
+uint32_t repl(const Graph *graph, const FactDB *kb);
 
 /**
  * Set up listening on a server port.
  */
 bool startServer(const uint32_t &port, const JavaBridge *proc,
-                 const Graph *graph, const btree::btree_set<uint64_t> *kb);
+                 const Graph *graph, const FactDB *kb);
 
 #endif
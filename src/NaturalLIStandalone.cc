@@ -7,6 +7,7 @@
 
 #include "NaturalLIIO.h"
 #include "FactDB.h"
+#include "LandmarkOracle.h"
 
 using namespace std;
 using namespace btree;
@@ -19,19 +20,28 @@ int32_t main(int32_t argc, char *argv[]) {
   init();
 
   // Read the knowledge base
-  const btree_set<uint64_t> *kb;
+  const FactDB *kb;
   if (KB_FILE[0] != '\0') {
     kb = readKB(string(KB_FILE));
   } else {
-    kb = new btree_set<uint64_t>;
+    kb = new BTreeFactDB(new btree_set<uint64_t>, true);
     fprintf(stderr,
             "No knowledge base given (configure with KB_FILE=/path/to/kb)\n");
   }
+  kb = openKBLog(kb);
 
   // Create bridge
   JavaBridge *proc = new JavaBridge();
   // Load graph
   Graph *graph = ReadGraph();
+#if SEARCH_PREMISE_PRUNING!=0
+  // (with no knowledge base, searches can be pruned to the words which
+  //  reach a premise; without a landmark table, this needs the outgoing
+  //  edges of the graph)
+  if (kb->empty() && LANDMARK_FILE[0] == '\0') {
+    graph = new BidirectionalGraph(graph);
+  }
+#endif
 
   // Start server
   std::thread t(startServer, SERVER_PORT, proc, graph, kb);
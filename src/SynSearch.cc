@@ -1,10 +1,14 @@
 #include <cstring>
 #include <sstream>
 #include <thread>
+#include <type_traits>
 
 #include "SynSearch.h"
 #include "Utils.h"
 
+/** The number of trees hashTrees() reads before hashing them in parallel */
+#define HASH_TREES_BATCH_SIZE 16384
+
 /**
  * Set the alignment weights
  */
@@ -117,7 +121,6 @@ inline syn_path_data mkSearchNodeData(
     const bool&        truth,
     const uint32_t&    deleteMask,
     const tagged_word& currentToken,
-    const ::word&      governor,
     const uint64_t& backpointer,
     const bool& allQuantifiersSeen) {
   syn_path_data dat;
@@ -127,9 +130,10 @@ inline syn_path_data mkSearchNodeData(
   dat.deleteMask = deleteMask;
   dat.currentWord = currentToken.word;
   dat.currentSense = currentToken.sense;
-  dat.governor = governor;
+  dat.ancestors = 0;
   dat.backpointer = backpointer;
   dat.allQuantifiersSeen = allQuantifiersSeen;
+  dat.kbHit = false;
   return dat;
 }
 
@@ -140,7 +144,6 @@ inline syn_path_data mkSearchNodeData(
     const uint32_t&    deleteMask,
     const ::word&      currentWord,
     const uint8_t&     currentSense,
-    const ::word&      governor,
     const uint64_t& backpointer,
     const bool& allQuantifiersSeen) {
   syn_path_data dat;
@@ -150,14 +153,15 @@ inline syn_path_data mkSearchNodeData(
   dat.deleteMask = deleteMask;
   dat.currentWord = currentWord;
   dat.currentSense = currentSense;
-  dat.governor = governor;
+  dat.ancestors = 0;
   dat.backpointer = backpointer;
   dat.allQuantifiersSeen = allQuantifiersSeen;
+  dat.kbHit = false;
   return dat;
 }
 
 SearchNode::SearchNode()
-    : data(mkSearchNodeData(42l, 255, false, 42, getTaggedWord(0, 0, 0), TREE_ROOT_WORD, 0, false)) { 
+    : data(mkSearchNodeData(42l, 255, false, 42, getTaggedWord(0, 0, 0), 0, false)) { 
   // IMPORTANT: this lets us hash all the quantifiers at once, if we want to.
   memset(this->quantifierMonotonicities, 0, MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -173,14 +177,14 @@ SearchNode::SearchNode(const SearchNode& from)
   
 SearchNode::SearchNode(const Tree& init)
     : data(mkSearchNodeData(init.hash(), init.root(), true, 
-                         0x0, init.wordAndSense(init.root()), TREE_ROOT_WORD, 0, false)) {
+                         0x0, init.wordAndSense(init.root()), 0, false)) {
   memcpy(this->quantifierMonotonicities, init.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
  
 SearchNode::SearchNode(const Tree& init, const bool& assumedInitialTruth)
     : data(mkSearchNodeData(init.hash(), init.root(), assumedInitialTruth, 
-                         0x0, init.wordAndSense(init.root()), TREE_ROOT_WORD, 0, false)) {
+                         0x0, init.wordAndSense(init.root()), 0, false)) {
   memcpy(this->quantifierMonotonicities, init.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -188,14 +192,14 @@ SearchNode::SearchNode(const Tree& init, const bool& assumedInitialTruth)
 SearchNode::SearchNode(const Tree& init, const bool& assumedInitialTruth,
                        const uint8_t& index)
     : data(mkSearchNodeData(init.hash(), index, assumedInitialTruth, 
-                         0x0, init.wordAndSense(index), init.word(init.governor(index)), 0, false)) {
+                         0x0, init.wordAndSense(index), 0, false)) {
   memcpy(this->quantifierMonotonicities, init.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
  
 SearchNode::SearchNode(const Tree& init, const uint8_t& index)
     : data(mkSearchNodeData(init.hash(), index, true, 
-                         0x0, init.wordAndSense(index), init.word(init.governor(index)), 0, false)) {
+                         0x0, init.wordAndSense(index), 0, false)) {
   memcpy(this->quantifierMonotonicities, init.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -209,7 +213,10 @@ SearchNode::SearchNode(const SearchNode& from, const uint64_t& newHash,
                  const uint32_t& backpointer)
     : data(mkSearchNodeData(newHash, from.data.index, newTruthValue,
                          from.data.deleteMask, newToken,
-                         from.data.governor, backpointer, from.data.allQuantifiersSeen)) {
+                         backpointer, from.data.allQuantifiersSeen)) {
+#if SEARCH_CYCLE_FINGERPRINT!=0
+  this->data.ancestors = childAncestors(from);
+#endif
   memcpy(this->quantifierMonotonicities, from.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -223,7 +230,10 @@ SearchNode::SearchNode(const SearchNode& from, const uint64_t& newHash,
     : data(mkSearchNodeData(newHash, from.data.index, newTruthValue,
                          addedDeletions | from.data.deleteMask, 
                          from.data.currentWord, from.data.currentSense,
-                         from.data.governor, backpointer, from.data.allQuantifiersSeen)) { 
+                         backpointer, from.data.allQuantifiersSeen)) { 
+#if SEARCH_CYCLE_FINGERPRINT!=0
+  this->data.ancestors = childAncestors(from);
+#endif
   memcpy(this->quantifierMonotonicities, from.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -234,9 +244,13 @@ SearchNode::SearchNode(const SearchNode& from, const uint64_t& newHash,
 SearchNode::SearchNode(const SearchNode& from, const Tree& tree,
                  const uint8_t& newIndex, const uint32_t& backpointer)
     : data(mkSearchNodeData(from.data.factHash, newIndex, from.data.truth, 
-                         from.data.deleteMask, tree.wordAndSense(newIndex), 
-                         tree.wordAndSense(tree.governor(newIndex)).word, backpointer,
+                         from.data.deleteMask, tree.wordAndSense(newIndex), backpointer,
                          from.data.allQuantifiersSeen)) { 
+#if SEARCH_CYCLE_FINGERPRINT!=0
+  // An index move stands in for the node it moved from (it is expanded in
+  // place, and is never in the search history), so it inherits its ancestors.
+  this->data.ancestors = from.data.ancestors;
+#endif
   memcpy(this->quantifierMonotonicities, from.quantifierMonotonicities,
     MAX_QUANTIFIER_COUNT * sizeof(quantifier_monotonicity));
 }
@@ -282,6 +296,366 @@ SearchNode SearchNode::deletion(const uint32_t& myIndexInHistory,
   return rtn;
 }
 
+// ----------------------------------------------
+// STATE COST MAP
+// ----------------------------------------------
+
+//
+// StateCostMap::StateCostMap()
+//
+StateCostMap::StateCostMap(const uint32_t& initialCapacity) : count(0) {
+  uint64_t capacity = 16;
+  while (capacity < 2 * ((uint64_t) initialCapacity)) { capacity <<= 1; }
+  mask = capacity - 1;
+  entries = (state_cost*) malloc(capacity * sizeof(state_cost));
+  memset(entries, 0xFF, capacity * sizeof(state_cost));
+}
+
+//
+// StateCostMap::~StateCostMap()
+//
+StateCostMap::~StateCostMap() {
+  free(entries);
+}
+
+//
+// StateCostMap::improves()
+//
+bool StateCostMap::improves(const SearchNode& node, const float& cost) {
+  return improves(node.factHash(), node.stateKey(), cost);
+}
+
+//
+// StateCostMap::improves(factHash, state)
+//
+bool StateCostMap::improves(const uint64_t& factHash, const uint64_t& state,
+                            const float& cost) {
+  const uint64_t i = slot(factHash, state);
+  if (entries[i].state == STATE_COST_EMPTY) {
+    // (case: a new state)
+    if (2 * (count + 1) > mask + 1) {
+      grow();
+      const uint64_t j = slot(factHash, state);
+      entries[j].factHash = factHash;
+      entries[j].state = state;
+      entries[j].cost = cost;
+    } else {
+      entries[i].factHash = factHash;
+      entries[i].state = state;
+      entries[i].cost = cost;
+    }
+    count += 1;
+    return true;
+  } else if (cost < entries[i].cost) {
+    // (case: a cheaper path to a known state)
+    entries[i].cost = cost;
+    return true;
+  } else {
+    // (case: dominated)
+    return false;
+  }
+}
+
+//
+// StateCostMap::isStale()
+//
+bool StateCostMap::isStale(const SearchNode& node, const float& cost) const {
+  const uint64_t i = slot(node.factHash(), node.stateKey());
+  return entries[i].state != STATE_COST_EMPTY && entries[i].cost < cost;
+}
+
+//
+// StateCostMap::grow()
+//
+void StateCostMap::grow() {
+  state_cost* oldEntries = entries;
+  const uint64_t oldCapacity = mask + 1;
+  mask = 2 * oldCapacity - 1;
+  entries = (state_cost*) malloc((mask + 1) * sizeof(state_cost));
+  memset(entries, 0xFF, (mask + 1) * sizeof(state_cost));
+  for (uint64_t i = 0; i < oldCapacity; ++i) {
+    if (oldEntries[i].state != STATE_COST_EMPTY) {
+      entries[slot(oldEntries[i].factHash, oldEntries[i].state)] = oldEntries[i];
+    }
+  }
+  free(oldEntries);
+}
+
+//
+// StateCostMap::dump()
+//
+void StateCostMap::dump(std::vector<state_cost>* states) const {
+  states->reserve(states->size() + count);
+  for (uint64_t i = 0; i <= mask; ++i) {
+    if (entries[i].state != STATE_COST_EMPTY) {
+      states->push_back(entries[i]);
+    }
+  }
+}
+
+//
+// StateCostMap::load()
+//
+void StateCostMap::load(const std::vector<state_cost>& states) {
+  for (auto iter = states.begin(); iter != states.end(); ++iter) {
+    improves(iter->factHash, iter->state, iter->cost);
+  }
+}
+
+// ----------------------------------------------
+// PREMISE REACHABILITY
+// ----------------------------------------------
+
+//
+// ReachableWords::ReachableWords()
+//
+ReachableWords::ReachableWords(const BidirectionalGraph& graph,
+                               const vector<word>& targets,
+                               const float& maxCost) {
+  vector<word> stack;
+  for (auto iter = targets.begin(); iter != targets.end(); ++iter) {
+    if (*iter < graph.vocabSize() && words.insert(*iter).second) {
+      stack.push_back(*iter);
+    }
+  }
+  while (!stack.empty()) {
+    const word top = stack.back();
+    stack.pop_back();
+    // (a token mutates from an edge's sink to its source, so the words which
+    //  can mutate into this word are the sinks of its outgoing edges)
+    uint32_t numEdges;
+    const edge* edges = graph.outgoingEdgesFast(top, &numEdges);
+    for (uint32_t edgeI = 0; edgeI < numEdges; ++edgeI) {
+      if (edges[edgeI].cost > maxCost) { continue; }
+      if (words.insert(edges[edgeI].sink).second) {
+        stack.push_back(edges[edgeI].sink);
+      }
+    }
+  }
+}
+
+//
+// ReachableWords::maxEdgeCost()
+//
+float ReachableWords::maxEdgeCost(const SynSearchCosts& costs, const float& costThreshold) {
+  // (a mutation costs its edge cost times the cost of its type and
+  //  transition; see searchLoop())
+  float minTransitionCost = numeric_limits<float>::infinity();
+  for (uint8_t i = 0; i <= FUNCTION_INDEPENDENCE; ++i) {
+    minTransitionCost = min(minTransitionCost,
+        min(costs.transitionCostFromTrue[i], costs.transitionCostFromFalse[i]));
+  }
+  float minMutationCost = numeric_limits<float>::infinity();
+  for (uint8_t i = 0; i < NUM_MUTATION_TYPES; ++i) {
+    minMutationCost = min(minMutationCost, costs.mutationLexicalCost[i] + minTransitionCost);
+  }
+  if (minMutationCost <= 0.0f) { return numeric_limits<float>::infinity(); }
+  return costThreshold / minMutationCost;
+}
+
+//
+// premiseTargets()
+//
+vector<word> premiseTargets(const Graph& graph,
+                            const vector<Tree*>& premises,
+                            const vector<AlignmentSimilarity>& alignments) {
+  vector<word> targets;
+  for (auto treeIter = premises.begin(); treeIter != premises.end(); ++treeIter) {
+    for (uint8_t i = 0; i < (*treeIter)->length; ++i) {
+      targets.push_back((*treeIter)->word(i));
+    }
+  }
+  for (auto alignIter = alignments.begin(); alignIter != alignments.end(); ++alignIter) {
+    const vector<alignment_instance> instances = alignIter->asVector();
+    for (auto instance = instances.begin(); instance != instances.end(); ++instance) {
+      targets.push_back(instance->target);
+    }
+  }
+  targets.erase(std::remove_if(targets.begin(), targets.end(),
+      [&graph](const word& w) -> bool { return w == INVALID_WORD || w >= graph.vocabSize(); }),
+      targets.end());
+  std::sort(targets.begin(), targets.end());
+  targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+  return targets;
+}
+
+// ----------------------------------------------
+// SEARCH CHECKPOINT
+// ----------------------------------------------
+
+/** The first bytes of a serialized checkpoint: "NLCP" */
+#define CHECKPOINT_MAGIC   0x50434C4E
+#define CHECKPOINT_VERSION 3
+
+/**
+ * The search configuration a checkpoint was written with. A checkpoint is
+ * a raw dump of the search's nodes, and is only readable with the same
+ * configuration.
+ */
+inline uint32_t checkpointConfig() {
+  return (SEARCH_FULL_MEMORY != 0 ? 0x1 : 0x0) |
+         (SEARCH_DOMINANCE_FILTER != 0 ? 0x2 : 0x0) |
+         (((uint32_t) SEARCH_CYCLE_FINGERPRINT) << 2) |
+         (((uint32_t) SEARCH_CYCLE_MEMORY) << 3) |
+         (((uint32_t) MAX_FUZZY_MATCHES) << 8) |
+         (((uint32_t) sizeof(SearchNode)) << 16);
+}
+
+template<typename T>
+inline void appendRaw(string* blob, const T& value) {
+  blob->append((const char*) &value, sizeof(T));
+}
+
+template<typename T>
+inline void appendVector(string* blob, const vector<T>& values) {
+  appendRaw(blob, (uint64_t) values.size());
+  if (!values.empty()) {
+    blob->append((const char*) values.data(), values.size() * sizeof(T));
+  }
+}
+
+template<typename T>
+inline bool readRaw(const char** cursor, const char* end, T* value) {
+  if (end - *cursor < (int64_t) sizeof(T)) { return false; }
+  memcpy(value, *cursor, sizeof(T));
+  *cursor += sizeof(T);
+  return true;
+}
+
+template<typename T>
+inline bool readVector(const char** cursor, const char* end, vector<T>* values) {
+  uint64_t size;
+  if (!readRaw(cursor, end, &size)) { return false; }
+  if (size > (uint64_t) (end - *cursor) / sizeof(T)) { return false; }
+  values->resize(size);
+  // (the elements are copied into an aligned buffer, and then assigned, as
+  //  search nodes can't be written to with memcpy)
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type buffer;
+  for (uint64_t i = 0; i < size; ++i) {
+    memcpy(&buffer, *cursor + i * sizeof(T), sizeof(T));
+    (*values)[i] = *reinterpret_cast<const T*>(&buffer);
+  }
+  *cursor += size * sizeof(T);
+  return true;
+}
+
+//
+// syn_search_checkpoint::queryKey()
+//
+uint64_t syn_search_checkpoint::queryKey(const Tree& query,
+                                         const bool& assumedInitialTruth) {
+  return (((query.hash() * 31) + query.length) << 1) |
+         (assumedInitialTruth ? 0x1 : 0x0);
+}
+
+//
+// syn_search_checkpoint::serialize()
+//
+void syn_search_checkpoint::serialize(string* blob) const {
+  blob->clear();
+  blob->reserve(64 + history.size() * sizeof(SearchNode) +
+                (fringe.size() + matches.size()) * sizeof(ScoredSearchNode) +
+                bestCosts.size() * sizeof(StateCostMap::state_cost) +
+                memory.size() * sizeof(uint64_t));
+  appendRaw(blob, (uint32_t) CHECKPOINT_MAGIC);
+  appendRaw(blob, (uint32_t) CHECKPOINT_VERSION);
+  appendRaw(blob, checkpointConfig());
+  appendRaw(blob, key);
+  appendRaw(blob, ticks);
+  appendRaw(blob, closestSoftAlignment);
+  appendRaw(blob, closestSoftAlignmentScore);
+  for (uint8_t i = 0; i < MAX_FUZZY_MATCHES; ++i) {
+    appendRaw(blob, closestSoftAlignmentScores[i]);
+    appendRaw(blob, closestSoftAlignmentSearchCosts[i]);
+  }
+  appendVector(blob, history);
+  appendVector(blob, fringe);
+  appendVector(blob, matches);
+  appendVector(blob, bestCosts);
+  appendVector(blob, memory);
+}
+
+//
+// syn_search_checkpoint::deserialize()
+//
+bool syn_search_checkpoint::deserialize(const string& blob) {
+  const char* cursor = blob.data();
+  const char* end = blob.data() + blob.size();
+  uint32_t magic, version, config;
+  bool ok = readRaw(&cursor, end, &magic) && magic == CHECKPOINT_MAGIC &&
+            readRaw(&cursor, end, &version) && version == CHECKPOINT_VERSION &&
+            readRaw(&cursor, end, &config) && config == checkpointConfig() &&
+            readRaw(&cursor, end, &key) &&
+            readRaw(&cursor, end, &ticks) &&
+            readRaw(&cursor, end, &closestSoftAlignment) &&
+            readRaw(&cursor, end, &closestSoftAlignmentScore);
+  for (uint8_t i = 0; ok && i < MAX_FUZZY_MATCHES; ++i) {
+    ok = readRaw(&cursor, end, &closestSoftAlignmentScores[i]) &&
+         readRaw(&cursor, end, &closestSoftAlignmentSearchCosts[i]);
+  }
+  ok = ok &&
+       readVector(&cursor, end, &history) &&
+       readVector(&cursor, end, &fringe) &&
+       readVector(&cursor, end, &matches) &&
+       readVector(&cursor, end, &bestCosts) &&
+       readVector(&cursor, end, &memory) &&
+       cursor == end;
+  if (!ok) {
+    clear();
+  }
+  return ok;
+}
+
+//
+// syn_search_checkpoint::clear()
+//
+void syn_search_checkpoint::clear() {
+  key = 0;
+  ticks = 0;
+  history.clear();
+  fringe.clear();
+  matches.clear();
+  bestCosts.clear();
+  memory.clear();
+  closestSoftAlignment = 0;
+  closestSoftAlignmentScore = -std::numeric_limits<float>::infinity();
+  for (uint8_t i = 0; i < MAX_FUZZY_MATCHES; ++i) {
+    closestSoftAlignmentScores[i] = 0.0f;
+    closestSoftAlignmentSearchCosts[i] = 0.0f;
+  }
+}
+
+//
+// syn_search_checkpoint::writeTo()
+//
+bool syn_search_checkpoint::writeTo(const char* path) const {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) { return false; }
+  string blob;
+  serialize(&blob);
+  const bool ok = fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+  return (fclose(file) == 0) && ok;
+}
+
+//
+// syn_search_checkpoint::readFrom()
+//
+bool syn_search_checkpoint::readFrom(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    clear();
+    return false;
+  }
+  string blob;
+  char buffer[65536];
+  size_t numRead;
+  while ((numRead = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    blob.append(buffer, numRead);
+  }
+  fclose(file);
+  return deserialize(blob);
+}
+
 // ----------------------------------------------
 // DEPENDENCY TREE
 // ----------------------------------------------
@@ -624,6 +998,115 @@ uint64_t Tree::hash() const {
   value ^= hashQuantifiers(this->quantifierMonotonicities);
   return value;
 }
+
+//
+// Read the lines of the next CoNLL tree from the input, skipping metadata
+// lines; the last comment line read is set as the tree's marker. A tree with
+// too many lines is returned empty. Returns false at the end of the input.
+//
+bool readConllTree(FILE* input, char** line, size_t* capacity, string* conll,
+                   string* marker) {
+  conll->clear();
+  marker->clear();
+  uint32_t numLines = 0;
+  ssize_t length;
+  while ((length = getline(line, capacity, input)) >= 0) {
+    const char* text = *line;
+    if (text[0] == '#') { marker->assign(text, length); continue; }
+    if (text[0] == '%') { continue; }
+    if (text[0] == '\n' || text[0] == '\r' || length == 0) {
+      if (numLines == 0) { continue; }  // (blank lines between trees)
+      numLines += 1;  // (the blank line counts toward the length, as in readTreeFromStdin())
+      break;
+    }
+    numLines += 1;
+    conll->append(text, length);
+    if (text[length - 1] != '\n') { conll->push_back('\n'); }
+  }
+  if (numLines >= MAX_FACT_LENGTH) { conll->clear(); }
+  return numLines > 0;
+}
+
+//
+// hashTrees()
+//
+uint64_t hashTrees(FILE* input, uint32_t numThreads,
+                   const std::function<void(const uint64_t*,const uint64_t&)>& output,
+                   uint64_t* numSkipped) {
+  if (numThreads == 0) { numThreads = max(1u, thread::hardware_concurrency()); }
+  char* line = NULL;
+  size_t capacity = 0;
+  // (fill a batch of trees, reusing its strings, along with the sentence each
+  //  tree is from; returns the number read)
+  string marker;
+  string lastMarker;
+  uint64_t sentence = 0;
+  auto readBatch = [input, &line, &capacity, &marker, &lastMarker, &sentence](
+      vector<string>* trees, vector<uint64_t>* sentences) -> uint64_t {
+    uint64_t size = 0;
+    while (size < trees->size() &&
+           readConllTree(input, &line, &capacity, &(*trees)[size], &marker)) {
+      if (marker.empty() || marker != lastMarker) { sentence += 1; }
+      lastMarker.swap(marker);
+      (*sentences)[size] = sentence;
+      size += 1;
+    }
+    return size;
+  };
+
+  vector<string> batch(HASH_TREES_BATCH_SIZE);
+  vector<string> next(HASH_TREES_BATCH_SIZE);
+  vector<uint64_t> batchSentences(HASH_TREES_BATCH_SIZE);
+  vector<uint64_t> nextSentences(HASH_TREES_BATCH_SIZE);
+  vector<uint64_t> hashes(HASH_TREES_BATCH_SIZE);
+  vector<uint8_t> valid(HASH_TREES_BATCH_SIZE);
+  btree::btree_set<uint64_t> sentenceHashes;
+  uint64_t outputSentence = 0;
+  uint64_t numHashed = 0;
+  *numSkipped = 0;
+  uint64_t batchSize = readBatch(&batch, &batchSentences);
+  while (batchSize > 0) {
+    // Hash the batch, while the next batch is read
+    vector<thread> threads;
+    for (uint32_t t = 0; t < numThreads; ++t) {
+      const uint64_t begin = batchSize * t / numThreads;
+      const uint64_t end = batchSize * (t + 1) / numThreads;
+      threads.push_back(thread([&batch, &hashes, &valid, begin, end]() -> void {
+        for (uint64_t i = begin; i < end; ++i) {
+          valid[i] = false;
+          if (batch[i].empty()) { continue; }
+          const Tree tree(batch[i]);
+          if (tree.length == 0) { continue; }
+          hashes[i] = tree.hash();
+          valid[i] = hashes[i] != 0;  // (HashCorpus only keeps hashes > 0)
+        }
+      }));
+    }
+    const uint64_t nextSize = readBatch(&next, &nextSentences);
+    for (auto iter = threads.begin(); iter != threads.end(); ++iter) { iter->join(); }
+    // Output the hashes, in order, once per sentence
+    uint64_t numValid = 0;
+    for (uint64_t i = 0; i < batchSize; ++i) {
+      if (!valid[i]) { continue; }
+      if (batchSentences[i] != outputSentence) {
+        outputSentence = batchSentences[i];
+        sentenceHashes.clear();
+      }
+      if (sentenceHashes.insert(hashes[i]).second) {
+        hashes[numValid] = hashes[i];
+        numValid += 1;
+      }
+    }
+    output(hashes.data(), numValid);
+    numHashed += numValid;
+    *numSkipped += batchSize - numValid;
+    batch.swap(next);
+    batchSentences.swap(nextSentences);
+    batchSize = nextSize;
+  }
+  free(line);
+  return numHashed;
+}
   
 //
 // Tree::updateHashFromMutation()
@@ -766,131 +1249,142 @@ void Tree::topologicalSort(uint8_t* buffer, const bool& ignoreQuantifiers) const
   buffer[bufferLength] = 255;
 }
   
+//
+// alignment_token_table::alignment_token_table()
+//
+alignment_token_table::alignment_token_table(const Tree& tree, const Graph& graph)
+    : length(tree.length) {
+  // Padding
+  for (uint8_t i = 0; i < MAX_QUERY_LENGTH + 2 * ALIGNMENT_TABLE_PADDING; ++i) {
+    words[i] = INVALID_WORD;
+    tags[i] = '?';
+  }
+  // Tokens
+  const SearchNode treeNode(tree);
+  for (uint8_t i = 0; i < length; ++i) {
+    const ::word w = tree.data[i].word;
+    const char tag = tree.data[i].posTag;
+    words[i + ALIGNMENT_TABLE_PADDING] = w;
+    tags[i + ALIGNMENT_TABLE_PADDING] = tag;
+    polarities[i] = tree.polarityAt(treeNode, i);
+    isKeyword[i] = (tag == 'n' || tag == 'v' || tag == 'j') && w != BE.word;
+    // (gloss fingerprint)
+    glosses[i] = graph.gloss(w);
+    glossLengths[i] = strlen(glosses[i]);
+    glossPrefixes[i] = 0;
+    for (uint8_t k = 0; k < 3 && glosses[i][k] != '\0'; ++k) {
+      glossPrefixes[i] |= ((uint32_t) ((uint8_t) glosses[i][k])) << (8 * k);
+    }
+  }
+}
+
+//
+// The number of characters of two glosses which have to match for
+// a prefix match. Note that this intentionally wraps around (i.e.,
+// compares the entire gloss) for glosses of length less than 2.
+//
+inline size_t glossPrefixMatchLength(const uint16_t& a, const uint16_t& b) {
+  const size_t shortest = (a < b ? a : b);
+  return (3 < shortest - 2) ? shortest - 2 : 3;
+}
+
 //
 // Tree::alignToPremise()
 //
 AlignmentSimilarity Tree::alignToPremise(const Tree& premise, const Graph& graph) const {
+  const alignment_token_table hypothesisTokens(*this, graph);
+  const alignment_token_table premiseTokens(premise, graph);
+  return alignToPremise(hypothesisTokens, premiseTokens);
+}
+
+//
+// Tree::alignToPremise()
+//
+AlignmentSimilarity Tree::alignToPremise(const alignment_token_table& hypothesis,
+                                         const alignment_token_table& premise) {
   // The alignments
   vector<alignment_instance> alignments;
-
-  // Get the polarities at each token of the hypothesis / premise
-  // (hypothesis)
-  SearchNode hypNode(*this);
-  monotonicity* hypPolarities = (monotonicity*) malloc(this->length * sizeof(monotonicity));
-  for (uint8_t hypI = 0; hypI < this->length; ++hypI) {
-    hypPolarities[hypI] = this->polarityAt(hypNode, hypI);
-  }
-  // (premise)
-  SearchNode premNode(premise);
-  monotonicity* premPolarities = (monotonicity*) malloc(premise.length * sizeof(monotonicity));
-  for (uint8_t premI = 0; premI < premise.length; ++premI) {
-    premPolarities[premI] = premise.polarityAt(premNode, premI);
-  }
+  alignments.reserve(hypothesis.length);
 
   // The list of premise words already aligned to
-  // (initially, all false)
-  bool* alreadyAlignedInPremise = (bool*) malloc(premise.length * sizeof(bool));
-  memset(alreadyAlignedInPremise, 0, premise.length * sizeof(bool));
-  bool* alreadyAlignedInHypothesis = (bool*) malloc(this->length * sizeof(bool));
-  memset(alreadyAlignedInHypothesis, 0, this->length * sizeof(bool));
-  int16_t* premiseForHypothesis = (int16_t*) malloc(this->length * sizeof(int16_t));
-  for (uint8_t i = 0; i < this->length; ++i) {
-    premiseForHypothesis[i] = -1;
+  // (initially, all false; only keywords are ever considered)
+  bool alreadyAlignedInPremise[MAX_QUERY_LENGTH];
+  memset(alreadyAlignedInPremise, 0, sizeof(alreadyAlignedInPremise));
+  bool alreadyAlignedInHypothesis[MAX_QUERY_LENGTH];
+  memset(alreadyAlignedInHypothesis, 0, sizeof(alreadyAlignedInHypothesis));
+  // (padded on either side, so neighbors can be looked up safely)
+  int16_t premiseForHypothesisData[MAX_QUERY_LENGTH + 2 * ALIGNMENT_TABLE_PADDING];
+  for (uint8_t i = 0; i < MAX_QUERY_LENGTH + 2 * ALIGNMENT_TABLE_PADDING; ++i) {
+    premiseForHypothesisData[i] = -1;
   }
+  int16_t* premiseForHypothesis = premiseForHypothesisData + ALIGNMENT_TABLE_PADDING;
 
   // The function to loop over alignment candidates
   // This is an O(n^2) loop each time, but 'n' is just the size of
   // the sentence.
 #define ALIGN_MATCH_LOOP(__align_condition__) \
-  for (uint8_t hypI = 0; hypI < this->length; ++hypI) { \
-    if (alreadyAlignedInHypothesis[hypI]) { continue; } \
-    char hypTag = this->data[hypI].posTag; \
-    char hypLastTag = hypI == 0 ? '?' : this->data[hypI - 1].posTag; \
-    char hypLastLastTag = hypI < 2 ? '?' : this->data[hypI - 2].posTag; \
-    char hypNextTag = (hypI == this->length - 1) ? '?' : this->data[hypI + 1].posTag; \
-    char hypNextNextTag = (hypI > this->length - 3) ? '?' : this->data[hypI + 2].posTag; \
-    ::word hypWord = this->data[hypI].word; \
-    if (hypWord == BE.word) { \
-      alreadyAlignedInHypothesis[hypI] = true; \
-      continue; \
-    } \
-    ::word hypLastWord = hypI == 0 ? INVALID_WORD : this->data[hypI - 1].word; \
-    ::word hypLastLastWord = hypI < 2 ? INVALID_WORD : this->data[hypI - 2].word; \
-    ::word hypNextWord = (hypI == this->length - 1) ? INVALID_WORD : this->data[hypI + 1].word; \
-    ::word hypNextNextWord = (hypI > this->length - 3) ? INVALID_WORD : this->data[hypI + 2].word; \
-    monotonicity hypPolarity = hypPolarities[hypI]; \
-    switch (hypTag) { \
-      case 'n': case 'v': case 'j': \
-        for (uint8_t premI = 0; premI < premise.length; ++premI) { \
-          if (alreadyAlignedInPremise[premI]) { continue; } \
-          if (alreadyAlignedInHypothesis[hypI]) { continue; } \
-          char premTag = premise.data[premI].posTag; \
-          if (premTag != 'n' && premTag != 'v' && premTag != 'j') { continue; } \
-          char premLastTag = premI == 0 ? '?' : premise.data[premI - 1].posTag; \
-          char premLastLastTag = premI < 2 ? '?' : premise.data[premI - 2].posTag; \
-          char premNextTag = (premI == premise.length - 1) ? '?' : premise.data[premI + 1].posTag; \
-          char premNextNextTag = (premI > premise.length - 3) ? '?' : premise.data[premI + 2].posTag; \
-          ::word premWord = premise.data[premI].word; \
-          if (premWord == BE.word) { \
-            alreadyAlignedInPremise[premI] = true; \
-            continue; \
-          } \
-          ::word premLastWord = premI == 0 ? INVALID_WORD : premise.data[premI - 1].word; \
-          ::word premLastLastWord = premI < 2 ? INVALID_WORD : premise.data[premI - 2].word; \
-          ::word premNextWord = (premI == premise.length - 1) ? INVALID_WORD : premise.data[premI + 1].word; \
-          ::word premNextNextWord = (premI > premise.length - 3) ? INVALID_WORD : premise.data[premI + 2].word; \
-          monotonicity premPolarity = premPolarities[premI]; \
-          if (__align_condition__) { \
-            alreadyAlignedInPremise[premI] = true; \
-            alreadyAlignedInHypothesis[hypI] = true; \
-            premiseForHypothesis[hypI] = premI; \
-            alignments.emplace_back( \
-                hypI, \
-                premWord, \
-                premPolarity); \
-          } \
-        } \
-      default: \
-        continue; \
+  for (uint8_t hypI = 0; hypI < hypothesis.length; ++hypI) { \
+    if (alreadyAlignedInHypothesis[hypI] || !hypothesis.isKeyword[hypI]) { continue; } \
+    for (uint8_t premI = 0; premI < premise.length; ++premI) { \
+      if (alreadyAlignedInPremise[premI] || !premise.isKeyword[premI]) { continue; } \
+      const ::word premWord = premise.word(premI); \
+      const monotonicity premPolarity = premise.polarities[premI]; \
+      if (__align_condition__) { \
+        alreadyAlignedInPremise[premI] = true; \
+        alreadyAlignedInHypothesis[hypI] = true; \
+        premiseForHypothesis[hypI] = premI; \
+        alignments.emplace_back( \
+            hypI, \
+            premWord, \
+            premPolarity); \
+        break; \
+      } \
     } \
   }
 
   // Group 1: Exact match and variants
   // Pass 1.1: Exact match (with polarity + POS)
-  ALIGN_MATCH_LOOP(premWord == hypWord && premTag == hypTag && premPolarity == hypPolarity)
+  ALIGN_MATCH_LOOP(premWord == hypothesis.word(hypI) &&
+                   premise.tag(premI) == hypothesis.tag(hypI) &&
+                   premPolarity == hypothesis.polarities[hypI])
   // Pass 1.2: Exact match (without polarity)
-  ALIGN_MATCH_LOOP(premWord == hypWord && premTag == hypTag)
+  ALIGN_MATCH_LOOP(premWord == hypothesis.word(hypI) &&
+                   premise.tag(premI) == hypothesis.tag(hypI))
   // Pass 1.3: Exact match (without POS)
-  ALIGN_MATCH_LOOP(premWord == hypWord)
+  ALIGN_MATCH_LOOP(premWord == hypothesis.word(hypI))
   // Pass 1.4: Prefix match
-  ALIGN_MATCH_LOOP(strncmp(graph.gloss(premWord), graph.gloss(hypWord),
-        max(3, min(strlen(graph.gloss(premWord)), strlen(graph.gloss(hypWord))) - 2)) == 0);
+  // (the fingerprint is a quick reject; every prefix match covers at least
+  //  the first three characters)
+  ALIGN_MATCH_LOOP(premise.glossPrefixes[premI] == hypothesis.glossPrefixes[hypI] &&
+                   strncmp(premise.glosses[premI], hypothesis.glosses[hypI],
+                           glossPrefixMatchLength(premise.glossLengths[premI],
+                                                  hypothesis.glossLengths[hypI])) == 0);
   
   // Group 2: Neighbors
   // Pass 2.1: NN or JJ left attachment
-  ALIGN_MATCH_LOOP(hypI < this->length - 1 && premI < premise.length - 1 &&
+  ALIGN_MATCH_LOOP(hypI < hypothesis.length - 1 && premI < premise.length - 1 &&
                    premiseForHypothesis[hypI + 1] == (premI + 1) &&
-                   hypTag == premTag)
+                   hypothesis.tag(hypI) == premise.tag(premI))
   // Pass 2.2: NN or JJ right attachment
   ALIGN_MATCH_LOOP(hypI > 0 && premI > 0 &&
                    premiseForHypothesis[hypI - 1] == (premI - 1) &&
-                   hypTag == premTag)
+                   hypothesis.tag(hypI) == premise.tag(premI))
   // Pass 2.3:    premise: "? MATCHED" or "MATCHED ?" or "MATCHED of _?_"
   //           -> hypothesis: "MATCHED of _?_"
-  ALIGN_MATCH_LOOP(hypI < this->length - 2 &&
-                   hypLastWord == WOF.word &&
+  ALIGN_MATCH_LOOP(hypI < hypothesis.length - 2 &&
+                   hypothesis.word(hypI - 1) == WOF.word &&
                    (
                       ( premI > 0 && premiseForHypothesis[hypI-2] == premI - 1) ||
                       ( premI < premise.length - 1 && 
                         premiseForHypothesis[hypI-2] == premI + 1) ||
                       ( premI < premise.length - 2 && 
                         premiseForHypothesis[hypI-2] == premI - 2 &&
-                        premLastLastWord == WOF.word)
+                        premise.word(premI - 2) == WOF.word)
                    ))
   // Pass 2.4:    premise: "MATCHED of _?_"
   //           -> hypothesis: "_?_ MATCHED" or "MATCHED _?_"
   ALIGN_MATCH_LOOP(premI > 1 &&
-                   premLastWord == WOF.word &&
+                   premise.word(premI - 1) == WOF.word &&
                    (
                       ( hypI > 0 && premiseForHypothesis[hypI-1] == premI - 2) ||
                       ( hypI < premise.length - 1 && 
@@ -899,79 +1393,70 @@ AlignmentSimilarity Tree::alignToPremise(const Tree& premise, const Graph& graph
   // Pass 2.5:    premise: "_?_ of MATCHED"
   //           -> hypothesis: "_?_ MATCHED"
   ALIGN_MATCH_LOOP(premI < premise.length - 2 &&
-                   premNextWord == WOF.word &&
-                   hypI < this->length - 1 &&
+                   premise.word(premI + 1) == WOF.word &&
+                   hypI < hypothesis.length - 1 &&
                    premiseForHypothesis[hypI + 1] == premI + 2)
   // Pass 2.6:    premise: "_?_ of MATCHED"
   //           -> hypothesis: "_?_ of MATCHED"
   ALIGN_MATCH_LOOP(premI < premise.length - 2 &&
-                   premNextWord == WOF.word &&
-                   hypI < this->length - 2 &&
-                   hypNextWord == WOF.word &&
+                   premise.word(premI + 1) == WOF.word &&
+                   hypI < hypothesis.length - 2 &&
+                   hypothesis.word(hypI + 1) == WOF.word &&
                    premiseForHypothesis[hypI + 2] == premI + 2)
+#undef ALIGN_MATCH_LOOP
   
   // Group 3: Constrained match
   // (get keyphrases in the premise)
-  vector<uint8_t> premiseKeywords;
+  uint8_t premiseKeywords[MAX_QUERY_LENGTH];
+  uint8_t numPremiseKeywords = 0;
   for (uint8_t premI = 0; premI < premise.length; ++premI) {
-    if (!alreadyAlignedInPremise[premI]) {
-      switch (premise.data[premI].posTag) {
-        case 'n': case 'v': case 'j': 
-          if (premise.data[premI].word == BE.word) {
-            alreadyAlignedInPremise[premI] = true;
-            continue;
-          }
-          premiseKeywords.push_back(premI); break;
-      }
+    if (!alreadyAlignedInPremise[premI] && premise.isKeyword[premI]) {
+      premiseKeywords[numPremiseKeywords] = premI;
+      numPremiseKeywords += 1;
     }
   }
   // (get keyphrases in the concusion)
-  vector<uint8_t> hypothesisKeywords;
-  for (uint8_t hypI = 0; hypI < this->length; ++hypI) {
-    if (!alreadyAlignedInHypothesis[hypI]) {
-      switch (this->data[hypI].posTag) {
-        case 'n': case 'v': case 'j': 
-          if (this->data[hypI].word == BE.word) {
-            alreadyAlignedInHypothesis[hypI] = true;
-            continue;
-          }
-          hypothesisKeywords.push_back(hypI); break;
-      }
+  uint8_t hypothesisKeywords[MAX_QUERY_LENGTH];
+  uint8_t numHypothesisKeywords = 0;
+  for (uint8_t hypI = 0; hypI < hypothesis.length; ++hypI) {
+    if (!alreadyAlignedInHypothesis[hypI] && hypothesis.isKeyword[hypI]) {
+      hypothesisKeywords[numHypothesisKeywords] = hypI;
+      numHypothesisKeywords += 1;
     }
   }
   // Pass 3.1: Squished between two other alignments
   for (uint8_t hypAlignI = 1; 
-       hypAlignI < (hypothesisKeywords.size() < 2 ? 0 : hypothesisKeywords.size() - 1); 
+       hypAlignI < (numHypothesisKeywords < 2 ? 0 : numHypothesisKeywords - 1); 
        ++hypAlignI) {
-    auto nextPremiseKeyword =
-      find(premiseKeywords.begin(), premiseKeywords.end(),
+    const uint8_t* nextPremiseKeyword =
+      find(premiseKeywords, premiseKeywords + numPremiseKeywords,
            premiseForHypothesis[hypothesisKeywords[hypAlignI + 1]]);
-    auto lastPremiseKeyword =
-      find(premiseKeywords.begin(), premiseKeywords.end(),
+    const uint8_t* lastPremiseKeyword =
+      find(premiseKeywords, premiseKeywords + numPremiseKeywords,
            premiseForHypothesis[hypothesisKeywords[hypAlignI - 1]]);
-    if (nextPremiseKeyword != premiseKeywords.end() &&
-        lastPremiseKeyword != premiseKeywords.end() &&
+    if (nextPremiseKeyword != premiseKeywords + numPremiseKeywords &&
+        lastPremiseKeyword != premiseKeywords + numPremiseKeywords &&
         *nextPremiseKeyword == *lastPremiseKeyword + 2) {
       uint8_t premI = premiseKeywords[*nextPremiseKeyword - 1];
       uint8_t hypI  = hypothesisKeywords[hypAlignI];
-      if (this->data[hypI].posTag == premise.data[premI].posTag) {
+      if (hypothesis.tag(hypI) == premise.tag(premI)) {
         alreadyAlignedInPremise[premI] = true;
         alreadyAlignedInHypothesis[hypI] = true;
         premiseForHypothesis[hypI] = premI;
         alignments.emplace_back(
             hypI,
-            premise.data[premI].word,
-            premPolarities[premI]);
+            premise.word(premI),
+            premise.polarities[premI]);
       }
     }
   }
   // Pass 3.2: Squished at the beginning or end
-  if (hypothesisKeywords.size() > 0 && premiseKeywords.size() > 0) {
+  if (numHypothesisKeywords > 0 && numPremiseKeywords > 0) {
     if (!alreadyAlignedInHypothesis[hypothesisKeywords[0]] &&
         !alreadyAlignedInPremise[premiseKeywords[0]]) {
       // first premise and conclusion keywords are not aligned
       bool align = false;
-      if (hypothesisKeywords.size() == 1 || premiseKeywords.size() == 1) {
+      if (numHypothesisKeywords == 1 || numPremiseKeywords == 1) {
         // align if this is the last remaining alignment
         align = true;
       } else if (premiseForHypothesis[hypothesisKeywords[1]] == premiseKeywords[1]) {
@@ -982,48 +1467,33 @@ AlignmentSimilarity Tree::alignToPremise(const Tree& premise, const Graph& graph
         alreadyAlignedInPremise[premiseKeywords[0]] = true;
         alignments.emplace_back(
             hypothesisKeywords[0],
-            premise.data[premiseKeywords[0]].word,
-            premPolarities[premiseKeywords[0]]);
+            premise.word(premiseKeywords[0]),
+            premise.polarities[premiseKeywords[0]]);
       }
     }
   }
 
   // Pass 4: unaligned hypotheses
-  for (uint8_t hypI = 0; hypI < this->length; ++hypI) {
-    if (!alreadyAlignedInHypothesis[hypI]) {
-      char hypTag = this->data[hypI].posTag;
-      monotonicity hypPolarity = hypPolarities[hypI];
-      switch (hypTag) {
-        case 'n': case 'v': case 'j':
-          assert (this->data[hypI].word != BE.word);
-          alreadyAlignedInHypothesis[hypI] = true;
-          alignments.emplace_back(
-              hypI,
-              INVALID_WORD,
-              hypPolarity);
-      }
+  for (uint8_t hypI = 0; hypI < hypothesis.length; ++hypI) {
+    if (!alreadyAlignedInHypothesis[hypI] && hypothesis.isKeyword[hypI]) {
+      alreadyAlignedInHypothesis[hypI] = true;
+      alignments.emplace_back(
+          hypI,
+          INVALID_WORD,
+          hypothesis.polarities[hypI]);
     }
   }
           
   // Count unaligned premises
   uint8_t unalignedPremiseWords = 0;
   for (uint8_t premI = 0; premI < premise.length; ++premI) {
-    char premTag = premise.data[premI].posTag;
-    if (premTag != 'n' && premTag != 'v' && premTag != 'j') { continue; }
-    if (alreadyAlignedInPremise[premI]) { continue; }
-    if (premise.data[premI].word == BE.word) { continue; }
-    unalignedPremiseWords += 1;
-  }
-
-  // Clean up
-  free(hypPolarities);
-  free(premPolarities);
-  free(alreadyAlignedInPremise);
-  free(alreadyAlignedInHypothesis);
-  free(premiseForHypothesis);
+    if (premise.isKeyword[premI] && !alreadyAlignedInPremise[premI]) {
+      unalignedPremiseWords += 1;
+    }
+  }
+
   // Return
   return AlignmentSimilarity(alignments, unalignedPremiseWords);
-
 }
 
 
@@ -1051,10 +1521,11 @@ inline bool polarityMatches(const monotonicity& a, const monotonicity& b, const
 //
 double AlignmentSimilarity::score(const Tree& tree, const bool& initTruth) const {
   double score = this->unalignedPremiseKeywords * COUNT_UNALIGNABLE_PREMISE + BIAS;
+  const SearchNode treeNode(tree);
   for (auto iter = alignments.begin(); iter != alignments.end(); ++iter) {
     if (iter->index < tree.length) {
       // Get variables
-      monotonicity polarityAtI = tree.polarityAt(SearchNode(tree), iter->index);
+      monotonicity polarityAtI = tree.polarityAt(treeNode, iter->index);
       bool wantDelete = false;
       if (iter->target == INVALID_WORD) {
         wantDelete = true;
@@ -1085,10 +1556,11 @@ void AlignmentSimilarity::printFeatures(const Tree& tree) const {
   uint16_t countAlignable = 0;
   uint16_t countUnalignableConclusion = 0;
   uint16_t countInexact = 0;
+  const SearchNode treeNode(tree);
   for (auto iter = alignments.begin(); iter != alignments.end(); ++iter) {
     if (iter->index < tree.length) {
       // Get variables
-      monotonicity polarityAtI = tree.polarityAt(SearchNode(tree), iter->index);
+      monotonicity polarityAtI = tree.polarityAt(treeNode, iter->index);
       bool wantDelete = false;
       if (iter->target == INVALID_WORD) {
         wantDelete = true;
@@ -1211,6 +1683,132 @@ void AlignmentSimilarity::debugPrint(const Tree& hypothesis, const Graph& graph)
   }
 }
 
+//
+// AlignmentMatrix::AlignmentMatrix()
+//
+AlignmentMatrix::AlignmentMatrix(const Tree& tree,
+                                 const vector<AlignmentSimilarity>& alignments)
+    : length(tree.length),
+      numPremises(min(alignments.size(), (size_t) MAX_FUZZY_MATCHES)) {
+  memset(targets, 0, sizeof(targets));
+  memset(targetPolarities, 0, sizeof(targetPolarities));
+  memset(isAligned, 0, sizeof(isAligned));
+  // Compute the words and polarities of the tree, once
+  const SearchNode treeNode(tree);
+  for (uint8_t i = 0; i < length; ++i) {
+    words[i] = tree.word(i);
+    polarities[i] = tree.polarityAt(treeNode, i);
+  }
+  // Fill the matrix
+  for (uint8_t premI = 0; premI < MAX_FUZZY_MATCHES; ++premI) {
+    if (premI >= numPremises) {
+      baseScores[premI] = -std::numeric_limits<float>::infinity();
+      continue;
+    }
+    const AlignmentSimilarity& alignment = alignments[premI];
+    baseScores[premI] =
+      alignment.unalignedPremiseKeywords * COUNT_UNALIGNABLE_PREMISE + BIAS;
+    for (auto iter = alignment.alignments.begin();
+         iter != alignment.alignments.end(); ++iter) {
+      if (iter->index >= length) {
+        // error: an alignment is larger than the tree
+        fprintf(stderr, "WARNING: alignment is larger than premise tree!\n");
+        continue;
+      }
+      if (isAligned[iter->index][premI] != 0.0f) {
+        // (only the first instance at an index is updated by a mutation)
+        repeatedInstances.push_back(make_pair(premI, *iter));
+        continue;
+      }
+      targets[iter->index][premI] = iter->target;
+      targetPolarities[iter->index][premI] = iter->targetPolarity;
+      isAligned[iter->index][premI] = 1.0f;
+    }
+  }
+}
+
+//
+// AlignmentMatrix::score()
+//
+void AlignmentMatrix::score(const bool& initTruth, float* scores) const {
+  for (uint8_t premI = 0; premI < MAX_FUZZY_MATCHES; ++premI) {
+    double score = baseScores[premI];
+    for (uint8_t i = 0; i < length; ++i) {
+      if (isAligned[i][premI] == 0.0f) { continue; }
+      score += instanceScore(i, targets[i][premI], targetPolarities[i][premI], initTruth);
+    }
+    scores[premI] = score;
+  }
+  for (auto iter = repeatedInstances.begin(); iter != repeatedInstances.end(); ++iter) {
+    const alignment_instance& instance = iter->second;
+    scores[iter->first] += instanceScore(instance.index, instance.target,
+                                         instance.targetPolarity, initTruth);
+  }
+}
+
+//
+// AlignmentMatrix::instanceScore()
+//
+float AlignmentMatrix::instanceScore(const uint8_t& index, const uint32_t& target,
+                                     const uint8_t& targetPolarity,
+                                     const bool& initTruth) const {
+  if (words[index] == target &&
+      polarityMatches(polarities[index], (monotonicity) targetPolarity, initTruth)) {
+    // case: exact match
+    return COUNT_ALIGNED + COUNT_ALIGNABLE;
+  } else if (target == INVALID_WORD) {
+    // case: unaligned hypothesis
+    return COUNT_UNALIGNABLE_CONCLUSION;
+  } else {
+    return COUNT_ALIGNABLE + COUNT_INEXACT;
+  }
+}
+
+//
+// AlignmentMatrix::updateScores()
+//
+#pragma GCC push_options  // matches pop_options below
+#pragma GCC optimize ("tree-vectorize")
+void AlignmentMatrix::updateScores(const float* scores,
+                                   float* updated,
+                                   const uint8_t& index,
+                                   const ::word& oldWord,
+                                   const ::word& newWord,
+                                   const monotonicity& oldPolarity,
+                                   const monotonicity& newPolarity,
+                                   const bool& oldTruth,
+                                   const bool& newTruth) const {
+  assert (index < MAX_QUERY_LENGTH);
+  // The score deltas, which only depend on whether this is a deletion.
+  // See AlignmentSimilarity::updateScore() for the (branching) logic.
+  const bool isDelete = (newWord == INVALID_WORD);
+  const float brokeMatch = isDelete
+    ? (-COUNT_ALIGNED - COUNT_ALIGNABLE + COUNT_UNALIGNABLE_PREMISE)
+    : (-COUNT_ALIGNED + COUNT_INEXACT);
+  const float madeMatch = isDelete
+    ? (-COUNT_UNALIGNABLE_CONCLUSION)
+    : (COUNT_ALIGNED - COUNT_INEXACT);
+  // A row of the matrix
+  const uint32_t* rowTargets = targets[index];
+  const uint8_t*  rowPolarities = targetPolarities[index];
+  const float*    rowIsAligned = isAligned[index];
+  const uint8_t oldIsUp = (oldPolarity == MONOTONE_UP);
+  const uint8_t newIsUp = (newPolarity == MONOTONE_UP);
+  // Update every premise at once
+  for (uint8_t premI = 0; premI < MAX_FUZZY_MATCHES; ++premI) {
+    const uint8_t targetIsUp = (rowPolarities[premI] == MONOTONE_UP);
+    // (see polarityMatches())
+    const uint8_t oldMatches = (oldWord == rowTargets[premI]) &
+      ((oldIsUp & targetIsUp) | ((oldPolarity == rowPolarities[premI]) == oldTruth));
+    const uint8_t newMatches = (newWord == rowTargets[premI]) &
+      ((newIsUp & targetIsUp) | ((newPolarity == rowPolarities[premI]) == newTruth));
+    updated[premI] = scores[premI] + rowIsAligned[premI] * (
+        ((float) (oldMatches & (newMatches ^ 1))) * brokeMatch +
+        ((float) ((oldMatches ^ 1) & newMatches)) * madeMatch);
+  }
+}
+#pragma GCC pop_options  // matches push_options above
+
 
 // ----------------------------------------------
 // NATURAL LOGIC
@@ -9,6 +9,8 @@
 #include "Graph.h"
 #include "knheap/knheap.h"
 #include "btree_set.h"
+#include "btree_map.h"
+#include "FactDB.h"
 #include "Models.h"
 
 // Ensure definitions
@@ -21,6 +23,36 @@
 #ifndef SEARCH_FULL_MEMORY
   #define SEARCH_FULL_MEMORY 0
 #endif
+#ifndef SEARCH_DOMINANCE_FILTER
+  #define SEARCH_DOMINANCE_FILTER 0
+#endif
+#ifndef SEARCH_PREMISE_PRUNING
+  #define SEARCH_PREMISE_PRUNING 0
+#endif
+#ifndef NEGATION_SEARCH_MARGIN
+  #define NEGATION_SEARCH_MARGIN 0.45
+#endif
+#ifndef FAST_SEARCH_MAX_VARIANTS
+  #define FAST_SEARCH_MAX_VARIANTS 64
+#endif
+#ifndef FACT_COUNT_BONUS
+  #define FACT_COUNT_BONUS 0.0
+#endif
+
+// Cycle detection fingerprints: each search node carries a 26 bit rolling
+// fingerprint of its last SEARCH_CYCLE_MEMORY ancestors, in the spare bits
+// of its syn_path_data.
+#define SEARCH_CYCLE_ANCESTOR_BITS 26
+#if SEARCH_CYCLE_MEMORY!=0 && SEARCH_FULL_MEMORY==0
+  #define SEARCH_CYCLE_FINGERPRINT 1
+  #if SEARCH_CYCLE_MEMORY > 13
+    #error "SEARCH_CYCLE_MEMORY must be at most 13"
+  #endif
+  /** The number of bits of the ancestor fingerprint allotted to each ancestor. */
+  #define SEARCH_CYCLE_FINGERPRINT_BITS (SEARCH_CYCLE_ANCESTOR_BITS / SEARCH_CYCLE_MEMORY)
+#else
+  #define SEARCH_CYCLE_FINGERPRINT 0
+#endif
 
 // Conditional includes
 #if TWO_PASS_HASH!=0
@@ -30,6 +62,8 @@
 class Tree;
 class SearchNode;
 class AlignmentSimilarity;
+class LandmarkOracle;
+struct alignment_token_table;
 
 // ----------------------------------------------
 // NATURAL LOGIC
@@ -430,6 +464,7 @@ struct dependency_edge alignas(8) {
  */
 class Tree {
  friend class SearchNode;
+ friend struct alignment_token_table;
  public:
   /**
    * Construct a Tree from a stripped-down CoNLL format.
@@ -770,6 +805,14 @@ class Tree {
    */
   AlignmentSimilarity alignToPremise(const Tree& premise, const Graph& graph) const;
 
+  /**
+   * @see alignToPremise(Tree&, Graph&), but from precomputed token tables.
+   * This is useful when aligning a single hypothesis against many premises,
+   * as the hypothesis' table only has to be computed once.
+   */
+  static AlignmentSimilarity alignToPremise(const alignment_token_table& hypothesis,
+                                            const alignment_token_table& premise);
+
   /**
    * The number of words in this dependency graph
    */
@@ -827,6 +870,30 @@ class Tree {
   }
 };
 
+/**
+ * Hash a stream of CoNLL trees, as hash_tree does one at a time, on many
+ * threads. Trees are separated by blank lines; comment ('#') and metadata
+ * ('%') lines are skipped. The trees are read in batches, and each batch is
+ * parsed and hashed in parallel while the next batch is read.
+ *
+ * Consecutive trees following the same comment line (e.g., "# 42", as
+ * HashCorpus writes before each entailment of sentence 42) are taken to be
+ * from the same sentence, and each hash is output once per sentence.
+ *
+ * @param input The stream to read trees from.
+ * @param numThreads The number of threads to hash with; 0 uses every core.
+ * @param output Called with the hashes of each batch, in the order the trees
+ *               were read. Trees which are empty, too long, hash to 0
+ *               (which HashCorpus drops too), or hash the same as an
+ *               earlier tree of their sentence are left out.
+ * @param numSkipped [output] The number of trees left out.
+ *
+ * @return The number of trees hashed.
+ */
+uint64_t hashTrees(FILE* input, uint32_t numThreads,
+                   const std::function<void(const uint64_t*,const uint64_t&)>& output,
+                   uint64_t* numSkipped);
+
 
 
 // ----------------------------------------------
@@ -834,6 +901,50 @@ class Tree {
 // ----------------------------------------------
 
 
+/**
+ * The number of padding entries on either side of the word and tag arrays
+ * in an alignment_token_table.
+ */
+#define ALIGNMENT_TABLE_PADDING 2
+
+/**
+ * A precomputed view of the tokens of a {@link Tree}, as used by
+ * Tree::alignToPremise(). This caches the words, POS tags, and polarities of
+ * the tree, along with the gloss of every token and a fingerprint of the
+ * first few characters of that gloss (for the prefix match pass).
+ *
+ * The word and tag arrays are padded on either side with INVALID_WORD and '?'
+ * respectively, so that the neighbors of a token can be read without any
+ * bounds checks.
+ */
+struct alignment_token_table {
+  alignment_token_table(const Tree& tree, const Graph& graph);
+
+  /** The word at the given index, or INVALID_WORD if just out of bounds. */
+  inline ::word word(const int16_t& index) const {
+    return words[index + ALIGNMENT_TABLE_PADDING];
+  }
+
+  /** The POS tag at the given index, or '?' if just out of bounds. */
+  inline char tag(const int16_t& index) const {
+    return tags[index + ALIGNMENT_TABLE_PADDING];
+  }
+
+  /** The length of the underlying tree. */
+  uint8_t      length;
+  ::word       words[MAX_QUERY_LENGTH + 2 * ALIGNMENT_TABLE_PADDING];
+  char         tags[MAX_QUERY_LENGTH + 2 * ALIGNMENT_TABLE_PADDING];
+  monotonicity polarities[MAX_QUERY_LENGTH];
+  /** True if this is an alignable word: a noun, verb, or adjective other than 'be'. */
+  bool         isKeyword[MAX_QUERY_LENGTH];
+  /** The gloss of each token. */
+  const char*  glosses[MAX_QUERY_LENGTH];
+  /** The length of the gloss of each token. */
+  uint16_t     glossLengths[MAX_QUERY_LENGTH];
+  /** The first three characters of each gloss, zero padded. */
+  uint32_t     glossPrefixes[MAX_QUERY_LENGTH];
+};
+
 /**
  * An actual alignment. This is just a triple of the index,
  * the bonus if matched, and the penalty if mismatched.
@@ -916,11 +1027,95 @@ class AlignmentSimilarity {
   void debugPrint(const Tree& hypothesis, const Graph& graph) const;
 
  private:
+  friend class AlignmentMatrix;
   const std::vector<alignment_instance> alignments;
   const uint8_t unalignedPremiseKeywords;
   const ::word NULL_WORD;
 };
 
+/**
+ * A dense compilation of up to MAX_FUZZY_MATCHES {@link AlignmentSimilarity}
+ * objects against a single query tree.
+ *
+ * The alignment targets and target polarities are laid out as a
+ * [token index x premise] matrix, so that the search can update the score of
+ * every candidate premise in a single, branch-free (and vectorizable) pass per
+ * child, rather than scanning each alignment's instance list in turn.
+ * The polarities of the unmutated tree are computed once, when the matrix
+ * is built.
+ *
+ * Like AlignmentSimilarity::updateScore(), only the first alignment instance
+ * for a given token index of a premise is taken into account when updating
+ * scores. Like AlignmentSimilarity::score(), every instance counts towards
+ * the initial score.
+ */
+class AlignmentMatrix {
+ public:
+  AlignmentMatrix(const Tree& tree,
+                  const std::vector<AlignmentSimilarity>& alignments);
+
+  /**
+   * Compute the score of every premise against the tree this matrix was built
+   * from. This is equivalent to AlignmentSimilarity::score(); entries past
+   * the number of premises are set to negative infinity.
+   *
+   * @param initTruth The assumed truth of the tree.
+   * @param scores [output] An array of length MAX_FUZZY_MATCHES to fill.
+   */
+  void score(const bool& initTruth, float* scores) const;
+
+  /**
+   * The dense analogue of AlignmentSimilarity::updateScore(), applied to every
+   * premise at once.
+   *
+   * @param scores The current scores of each premise, of length
+   *               MAX_FUZZY_MATCHES.
+   * @param updated [output] The updated scores; this may alias scores.
+   */
+  void updateScores(const float* scores,
+                    float* updated,
+                    const uint8_t& index,
+                    const ::word& oldWord,
+                    const ::word& newWord,
+                    const monotonicity& oldPolarity,
+                    const monotonicity& newPolarity,
+                    const bool& oldTruth,
+                    const bool& newTruth) const;
+
+  /** The polarity of the token at the given index in the unmutated tree. */
+  inline monotonicity polarityAt(const uint8_t& index) const {
+    return polarities[index];
+  }
+
+  /** The number of premises compiled into this matrix. */
+  inline uint8_t size() const { return numPremises; }
+
+ private:
+  /** The contribution of one alignment instance to the initial score. */
+  float instanceScore(const uint8_t& index, const uint32_t& target,
+                      const uint8_t& targetPolarity, const bool& initTruth) const;
+
+  /** The target word for each [token, premise] pair. */
+  uint32_t targets[MAX_QUERY_LENGTH][MAX_FUZZY_MATCHES];
+  /** The target polarity for each [token, premise] pair. */
+  uint8_t  targetPolarities[MAX_QUERY_LENGTH][MAX_FUZZY_MATCHES];
+  /** 1.0 if the premise has an alignment at the given token, else 0.0. */
+  float    isAligned[MAX_QUERY_LENGTH][MAX_FUZZY_MATCHES];
+  /** The score of each premise before any alignments are counted. */
+  float    baseScores[MAX_FUZZY_MATCHES];
+  /** The words of the unmutated tree. */
+  ::word   words[MAX_QUERY_LENGTH];
+  /** The polarities of the unmutated tree. */
+  monotonicity polarities[MAX_QUERY_LENGTH];
+  /**
+   * The alignment instances at an index which already has one, with the
+   * premise they belong to. These only count towards the initial score.
+   */
+  std::vector<std::pair<uint8_t,alignment_instance> > repeatedInstances;
+  uint8_t  length;
+  uint8_t  numPremises;
+};
+
 
 
 // ----------------------------------------------
@@ -942,8 +1137,9 @@ struct alignas(24) syn_path_data {  // 192 bits total
               currentWord:VOCABULARY_ENTROPY,  // 24  // vv           vv
               currentSense:SENSE_ENTROPY,      // 5
               deleteMask:MAX_QUERY_LENGTH,     // 39
-              backpointer:28;                  // 28
-  word        governor:VOCABULARY_ENTROPY;     // 24
+              backpointer:25,                  // 25
+              kbHit:1,                         // 1
+              ancestors:SEARCH_CYCLE_ANCESTOR_BITS;  // 26
   uint8_t     index:6;                         // 6
   bool        truth:1,                         // 1
               allQuantifiersSeen:1;            // 1   // ^^ + 16 bytes ^^
@@ -954,8 +1150,7 @@ struct alignas(24) syn_path_data {  // 192 bits total
            index == rhs.index &&
            truth == rhs.truth &&
            currentWord == rhs.currentWord &&
-           currentSense == rhs.currentSense &&
-           governor == rhs.governor;
+           currentSense == rhs.currentSense;
   }
 #ifdef __GNUG__
 } __attribute__((packed));
@@ -1042,6 +1237,37 @@ class SearchNode {
 #endif
   }
 
+#if SEARCH_CYCLE_FINGERPRINT!=0
+  /**
+   * A small, never zero, fingerprint of this node's state.
+   * Two nodes which are equal according to operator== always have the same
+   * fingerprint.
+   */
+  inline uint32_t fingerprint() const {
+    const uint64_t key = data.factHash ^ (((uint64_t) data.deleteMask) << 8) ^
+                         (data.index << 1) ^ data.truth;
+    const uint32_t fingerprint = (key * 0x9E3779B97F4A7C15l) >> (64 - SEARCH_CYCLE_FINGERPRINT_BITS);
+    return fingerprint == 0 ? 1 : fingerprint;
+  }
+
+  /**
+   * Returns a bitmask of which of this node's last SEARCH_CYCLE_MEMORY
+   * ancestors have the same fingerprint as the given node -- usually a child
+   * of this node, which can never equal this node itself. Bit 0 is this
+   * node's parent, bit 1 its grandparent, and so forth.
+   * This only looks at the two nodes, but may have false positives.
+   */
+  inline uint32_t ancestorsWithFingerprintOf(const SearchNode& child) const {
+    const uint32_t theirs = child.fingerprint();
+    const uint32_t mask = (uint32_t) ((1l << SEARCH_CYCLE_FINGERPRINT_BITS) - 1);
+    uint32_t matches = 0;
+    for (uint8_t i = 0; i < SEARCH_CYCLE_MEMORY; ++i) {
+      matches |= ((((uint64_t) data.ancestors) >> (i * SEARCH_CYCLE_FINGERPRINT_BITS) & mask) == theirs) << i;
+    }
+    return matches;
+  }
+#endif
+
   /** Returns the hash of the current fact. */
   inline uint64_t factHash() const { return data.factHash; }
   
@@ -1056,8 +1282,11 @@ class SearchNode {
   /** Returns index of the current token being mutated. */
   inline uint8_t tokenIndex() const { return data.index; }
   
-  /** Returns governor of the current token. */
-  inline ::word governor() const { return data.governor; }
+  /** Returns governor of the current token, which is always the tree's. */
+  inline ::word governor(const Tree& tree) const {
+    const uint8_t governorIndex = tree.governor(data.index);
+    return governorIndex == TREE_ROOT ? TREE_ROOT_WORD : tree.word(governorIndex);
+  }
   
   /** Returns whether a given word has been deleted*/
   inline bool isDeleted(const uint8_t& index) const { 
@@ -1069,6 +1298,30 @@ class SearchNode {
   
   /** Returns the truth state of this node. */
   inline bool truthState() const { return data.truth; }
+
+  /**
+   * Returns true if this node's fact was found in the knowledge base. This
+   * is only set for nodes in the true state, and only once the node has been
+   * looked up (see setKBHit()); a fresh node is never a hit.
+   */
+  inline bool isKBHit() const { return data.kbHit; }
+
+  /** Record whether this node's fact was found in the knowledge base. */
+  inline void setKBHit(const bool& hit) { data.kbHit = hit; }
+
+  /**
+   * The state of this node not captured by its fact hash: the deletions,
+   * the current token index and sense, the truth state, and whether all the
+   * quantifiers have been seen. Two nodes with the same fact hash and
+   * state key are expanded identically.
+   */
+  inline uint64_t stateKey() const {
+    return ((uint64_t) data.deleteMask) |
+           (((uint64_t) data.index) << MAX_QUERY_LENGTH) |
+           (((uint64_t) data.truth) << (MAX_QUERY_LENGTH + 6)) |
+           (((uint64_t) data.allQuantifiersSeen) << (MAX_QUERY_LENGTH + 7)) |
+           (((uint64_t) data.currentSense) << (MAX_QUERY_LENGTH + 8));
+  }
   
   /** Project the lexical relation through this node's quantifiers */
   natlog_relation projectLexicalRelation( const SearchNode& currentNode,
@@ -1107,7 +1360,7 @@ class SearchNode {
     // Compute the new hash
     const uint64_t newHash = tree.updateHashFromMutation(
         this->factHash(), this->tokenIndex(), nodeToken.word,
-        this->governor(), edge.source
+        this->governor(tree), edge.source
       );
     const tagged_word newToken = getTaggedWord(
         edge.source,
@@ -1166,6 +1419,19 @@ class SearchNode {
   /** The data stored in this path */
   syn_path_data data;
 
+#if SEARCH_CYCLE_FINGERPRINT!=0
+  /**
+   * The ancestor fingerprints (syn_path_data::ancestors) of a child of the
+   * given node: the fingerprints of its last SEARCH_CYCLE_MEMORY ancestors,
+   * SEARCH_CYCLE_FINGERPRINT_BITS each, with the parent in the lowest bits.
+   * An empty slot is zero.
+   */
+  static inline uint32_t childAncestors(const SearchNode& parent) {
+    return (uint32_t) (((((uint64_t) parent.data.ancestors) << SEARCH_CYCLE_FINGERPRINT_BITS) |
+                        parent.fingerprint()) & ((1l << SEARCH_CYCLE_ANCESTOR_BITS) - 1));
+  }
+#endif
+
 #if MAX_FUZZY_MATCHES > 0
   /** 
    * The alignment score of this search node to each of the candidate
@@ -1187,6 +1453,9 @@ struct ScoredSearchNode {
   SearchNode node;
   /** The score for this Search Node */
   float cost;
+
+  /** Create an empty scored search node; e.g., to be read into */
+  ScoredSearchNode() : cost(0.0f) { }
   
 #if MAX_FUZZY_MATCHES > 0
   /** Create a new scored search node, with new fuzzy scores. */
@@ -1207,6 +1476,129 @@ struct ScoredSearchNode {
 
 };
 
+/**
+ * A compact open addressing hash map from a search state (its fact hash and
+ * state key) to the lowest cost it has been pushed onto the fringe with.
+ * This gives the search decrease-key semantics without a decrease-key heap:
+ * a push which does not improve on the recorded cost is dropped, and a pop
+ * whose cost has since been improved upon is stale and can be skipped.
+ */
+class StateCostMap {
+ public:
+  /** Create an empty map, with room for at least the given number of states */
+  StateCostMap(const uint32_t& initialCapacity = 1024);
+  ~StateCostMap();
+
+  /**
+   * Record that this node was reached with the given cost.
+   *
+   * @return True if this is the cheapest the node's state has been reached;
+   *         false if it has been reached at least as cheaply before, in which
+   *         case the map is not changed.
+   */
+  bool improves(const SearchNode& node, const float& cost);
+
+  /**
+   * Returns true if this node's state has been reached more cheaply than the
+   * given cost; i.e., a node popped at this cost is superseded.
+   */
+  bool isStale(const SearchNode& node, const float& cost) const;
+
+  /** The number of distinct states in the map */
+  inline uint64_t size() const { return count; }
+
+  /** A state in the map, and the lowest cost it has been reached with */
+  struct state_cost {
+    uint64_t factHash;
+    uint64_t state;
+    float    cost;
+  };
+
+  /** Append every state in the map to the given vector, in no particular order */
+  void dump(std::vector<state_cost>* states) const;
+
+  /** Add the given states to the map; the inverse of dump() */
+  void load(const std::vector<state_cost>& states);
+
+ private:
+  /** @see improves(const SearchNode&, const float&) */
+  bool improves(const uint64_t& factHash, const uint64_t& state, const float& cost);
+
+  /** Find the slot for the given state: either its entry, or an empty slot */
+  inline uint64_t slot(const uint64_t& factHash, const uint64_t& state) const {
+    uint64_t i = (factHash ^ (state * 0x9E3779B97F4A7C15l)) & mask;
+    while (entries[i].state != STATE_COST_EMPTY &&
+           (entries[i].factHash != factHash || entries[i].state != state)) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  /** Double the capacity of the map */
+  void grow();
+
+  static const uint64_t STATE_COST_EMPTY = ~((uint64_t) 0);
+
+  state_cost* entries;
+  uint64_t mask;
+  uint64_t count;
+};
+
+/**
+ * The words from which one of a set of target words (e.g., the words of the
+ * premises, and the alignment targets) can be reached by a sequence of
+ * mutations, found by a reverse search over the mutation graph from the
+ * targets.
+ *
+ * A search with no main knowledge base can skip mutating a token into any
+ * other word: every remaining token of a premise it finds must be a
+ * premise word, and so the mutated token could only ever be deleted again.
+ */
+class ReachableWords {
+ public:
+  /**
+   * Find the words which can reach a target word.
+   *
+   * @param graph The mutation graph, with its outgoing edges.
+   * @param targets The words to be reached. Words outside the graph's
+   *                vocabulary are ignored.
+   * @param maxCost The largest edge cost of a mutation to consider. The
+   *                search scores a node by the cost of the mutation into
+   *                it, so this bounds each step of a sequence rather than
+   *                its total; see maxEdgeCost(). By default, every edge is
+   *                considered.
+   */
+  ReachableWords(const BidirectionalGraph& graph,
+                 const std::vector<word>& targets,
+                 const float& maxCost = std::numeric_limits<float>::infinity());
+
+  /** Returns true if a target can be reached from this word */
+  inline bool contains(const word& w) const { return words.find(w) != words.end(); }
+
+  /** The number of words which can reach a target (including the targets) */
+  inline uint64_t size() const { return words.size(); }
+
+  /**
+   * The largest edge cost of a mutation which a search can take without
+   * going over its cost threshold (see syn_search_options::costThreshold),
+   * or infinity if some mutation is free.
+   */
+  static float maxEdgeCost(const SynSearchCosts& costs, const float& costThreshold);
+
+ private:
+  btree::btree_set<word> words;
+};
+
+/**
+ * The words a search over premises only can be pruned toward: the words of
+ * the premises, and the targets of the alignments, sorted and without
+ * duplicates. Words outside the graph's vocabulary (e.g., the INVALID_WORD
+ * target of a soft alignment) are left out.
+ */
+std::vector<word> premiseTargets(const Graph& graph,
+                                 const std::vector<Tree*>& premises,
+                                 const std::vector<AlignmentSimilarity>& alignments);
+
 
 // ----------------------------------------------
 // Threadsafe Int
@@ -1259,6 +1651,48 @@ struct syn_search_options {
   // 
   /** If true, only run entailment from the true state. */
   bool skipNegationSearch;
+  /**
+   * If true, the premises of the query are added to the knowledge base for
+   * good, if it accepts new facts (see MutableFactDB).
+   */
+  bool addPremisesToKB;
+  /**
+   * Only run entailment from the false state if the search from the true
+   * state found no path with at least this confidence (at most 0.5, for a
+   * free path). Above 0.5, both searches are always run.
+   */
+  float negationSearchMargin;
+  /**
+   * The number of deletion variants of the query to look up with
+   * FastSearch() before running a full search; 0 skips the fast search.
+   */
+  uint32_t maxFastSearchVariants;
+  /**
+   * The number of results to return, cheapest first. The path of each
+   * result is only built if it is returned. 0 returns every result.
+   */
+  uint32_t maxResults;
+  /**
+   * If not NULL, the words which can reach a premise word. Mutations into
+   * any other word are skipped, unless the search has a main knowledge base.
+   */
+  const ReachableWords* premiseWords;
+  /**
+   * If not NULL, a bound on the graph cost of mutating a word into one of
+   * goalWords. Mutations into a word which the landmarks show can't reach a
+   * goal word are skipped, unless the search has a main knowledge base.
+   * This is checked after premiseWords, if both are given; the goal words
+   * are summarized once per search (see LandmarkOracle::summarizeGoals()).
+   */
+  const LandmarkOracle* landmarks;
+  /** The words to bound the distance to with landmarks; e.g., premise words */
+  std::vector<word> goalWords;
+  /**
+   * The cost taken off a match per unit of the log of the number of times
+   * its fact was seen (see FactDB::count()), so that facts seen often are
+   * preferred. A match never costs less than 0.
+   */
+  float factCountBonus;
 
   /**
    * Create the input options for a Search.
@@ -1286,6 +1720,13 @@ struct syn_search_options {
     this->checkFringe = checkFringe;
     this->silent = silent;
     this->skipNegationSearch = false;
+    this->addPremisesToKB = false;
+    this->negationSearchMargin = NEGATION_SEARCH_MARGIN;
+    this->maxFastSearchVariants = FAST_SEARCH_MAX_VARIANTS;
+    this->maxResults = 0;
+    this->premiseWords = NULL;
+    this->landmarks = NULL;
+    this->factCountBonus = FACT_COUNT_BONUS;
   }
 
   syn_search_options() {
@@ -1295,24 +1736,35 @@ struct syn_search_options {
     this->checkFringe =         true;
     this->silent =              false;
     this->skipNegationSearch =  false;
+    this->addPremisesToKB =     false;
+    this->negationSearchMargin = NEGATION_SEARCH_MARGIN;
+    this->maxFastSearchVariants = FAST_SEARCH_MAX_VARIANTS;
+    this->maxResults =          0;
+    this->premiseWords =        NULL;
+    this->landmarks =           NULL;
+    this->factCountBonus =      FACT_COUNT_BONUS;
   }
 };
 
 /**
- * A single search path.
+ * A single search path, from the premise found (first) back to the query
+ * (last). The nodes on the path are stored in the
+ * syn_search_response which owns the path; see
+ * syn_search_response::pathNode().
  */
 struct syn_search_path {
-  std::vector<SearchNode> nodeSequence;
+  /** The offset of this path's first entry in syn_search_response::pathNodes */
+  uint32_t begin;
+  /** The number of nodes on the path */
+  uint32_t length;
+  /** The cost of the path */
   float cost;
 
-  syn_search_path(const std::vector<SearchNode>& nodeSequence,
+  syn_search_path(const uint32_t& begin, const uint32_t& length,
                   const float& cost)
-                  : nodeSequence(nodeSequence), cost(cost) { }
-       
-  inline SearchNode operator[](const uint64_t& i) { return nodeSequence[i]; }
-  inline SearchNode front() { return nodeSequence.front(); }
-  inline SearchNode back() { return nodeSequence.back(); }
-  inline uint64_t size() const { return nodeSequence.size(); }
+                  : begin(begin), length(length), cost(cost) { }
+
+  inline uint64_t size() const { return length; }
 };
 
 /**
@@ -1321,11 +1773,26 @@ struct syn_search_path {
 struct syn_search_response {
   std::vector<syn_search_path> paths;
   std::vector<feature_vector> featurizedPaths;
+  /**
+   * Every node on any of the paths. Paths found by the same search share
+   * most of their nodes, and each node is only stored once.
+   */
+  std::vector<SearchNode> nodes;
+  /**
+   * For each path in turn, the index in nodes of each node on the path; an
+   * index rather than a delta from the node before it, so that any node of
+   * a path (e.g., its premise) is read directly.
+   */
+  std::vector<uint32_t> pathNodes;
+  /** The number of results found, including those not returned as paths */
+  uint64_t numResults = 0;
   uint8_t closestSoftAlignment = MAX_FUZZY_MATCHES;
   float closestSoftAlignmentScores[MAX_FUZZY_MATCHES];
   float closestSoftAlignmentScore = -std::numeric_limits<float>::infinity();
   float closestSoftAlignmentSearchCosts[MAX_FUZZY_MATCHES];
   uint64_t totalTicks;
+  /** The knowledge base lookups made by the search */
+  kb_lookup_stats kbStats;
     
   /**
    * Initialize some values while creating a new syn_search_response
@@ -1338,6 +1805,153 @@ struct syn_search_response {
   }
 
   inline uint64_t size() const { return paths.size(); }
+
+  /** The i'th node of the given path; 0 is the premise found. */
+  inline const SearchNode& pathNode(const uint64_t& pathI, const uint64_t& i) const {
+    return nodes[pathNodes[paths[pathI].begin + i]];
+  }
+  /** The premise found by the given path. */
+  inline const SearchNode& front(const uint64_t& pathI) const {
+    return pathNode(pathI, 0);
+  }
+  /** The query at the end of the given path. */
+  inline const SearchNode& back(const uint64_t& pathI) const {
+    return pathNode(pathI, paths[pathI].length - 1);
+  }
+  /** Copy out the nodes of the given path; e.g., to print it. */
+  std::vector<SearchNode> nodeSequence(const uint64_t& pathI) const {
+    std::vector<SearchNode> path;
+    path.reserve(paths[pathI].length);
+    for (uint32_t i = 0; i < paths[pathI].length; ++i) {
+      path.push_back(pathNode(pathI, i));
+    }
+    return path;
+  }
+};
+
+/**
+ * A snapshot of a search which ran out of ticks, from which the search can
+ * be resumed with more ticks; see SynSearch(). This is everything the
+ * search has done so far: its history, its fringe, the states it has
+ * already reached, and the matches it has found.
+ *
+ * A checkpoint can be serialized to a compact binary blob, to be kept in
+ * memory or written to disk. The blob is only readable by a binary built
+ * with the same search configuration (SearchNode layout, memory and
+ * dominance settings) as the one which wrote it.
+ */
+struct syn_search_checkpoint {
+  /** The query and initial truth this is a search of; @see queryKey() */
+  uint64_t key;
+  /** The number of ticks the search has run for */
+  uint64_t ticks;
+  /** The nodes popped so far, including the start node at index 0 */
+  std::vector<SearchNode> history;
+  /** The nodes still on the fringe, in no particular order */
+  std::vector<ScoredSearchNode> fringe;
+  /** The matches found so far; their paths point into history */
+  std::vector<ScoredSearchNode> matches;
+  /** The cheapest cost each state was pushed with (SEARCH_DOMINANCE_FILTER) */
+  std::vector<StateCostMap::state_cost> bestCosts;
+  /**
+   * The states expanded so far (SEARCH_FULL_MEMORY), sorted. This is more
+   * than the history holds: index moves are expanded without a history slot.
+   */
+  std::vector<uint64_t> memory;
+  uint8_t closestSoftAlignment;
+  float closestSoftAlignmentScore;
+  float closestSoftAlignmentScores[MAX_FUZZY_MATCHES];
+  float closestSoftAlignmentSearchCosts[MAX_FUZZY_MATCHES];
+
+  syn_search_checkpoint() : key(0), ticks(0), closestSoftAlignment(0),
+      closestSoftAlignmentScore(-std::numeric_limits<float>::infinity()) { }
+
+  /** Returns true if there is no search to resume from this checkpoint */
+  inline bool empty() const { return history.empty(); }
+
+  /** Empty this checkpoint, as if it were newly created */
+  void clear();
+
+  /** Returns true if the search could still find something if resumed */
+  inline bool resumable() const { return !fringe.empty(); }
+
+  /**
+   * The key identifying a search of the given query from the given truth
+   * state; a checkpoint can only be resumed by a search with the same key.
+   */
+  static uint64_t queryKey(const Tree& query, const bool& assumedInitialTruth);
+
+  /** Serialize this checkpoint, replacing the contents of the given blob */
+  void serialize(std::string* blob) const;
+
+  /**
+   * Read a checkpoint written by serialize().
+   * @return False if the blob is malformed, or was written by a binary with a
+   *         different search configuration. The checkpoint is then empty.
+   */
+  bool deserialize(const std::string& blob);
+
+  /** Write the serialized checkpoint to a file; false on an I/O error */
+  bool writeTo(const char* path) const;
+
+  /** Read a checkpoint written by writeTo(); @see deserialize() */
+  bool readFrom(const char* path);
+};
+
+/**
+ * The facts visited by a search, from which the search can be matched
+ * against any number of premise sets without being re-run; e.g., to check
+ * the same hypothesis against the premises of each candidate answer.
+ * This is a "search once, match many" alternative to running SynSearch()
+ * with each premise set as its auxKB.
+ *
+ * For each fact hash visited, this records the cheapest visit to it (true
+ * visits before false visits), and the index of the visiting node in the
+ * search history, which is kept to build the paths of the matches.
+ */
+struct syn_search_explored {
+  /** The cheapest visit to a fact */
+  struct visit {
+    /** The cost of the node which visited the fact */
+    float    cost;
+    /** The index of the node in the history */
+    uint32_t historyIndex;
+    /** The truth state of the node */
+    bool     truth;
+  };
+
+  /** The nodes visited by the search, indexed by visit::historyIndex */
+  std::vector<SearchNode> history;
+  /** The best visit to each fact hash */
+  btree::btree_map<uint64_t,visit> facts;
+  /** The truth the search assumed of its query */
+  bool assumedInitialTruth;
+  /** The number of words in the query */
+  uint8_t queryLength;
+  /** The number of ticks the search ran for */
+  uint64_t totalTicks;
+
+  syn_search_explored() : assumedInitialTruth(true), queryLength(0), totalTicks(0) { }
+
+  /** Record that the given node was visited at the given index, with the given cost */
+  void record(const SearchNode& node, const float& cost, const uint32_t& historyIndex);
+
+  /**
+   * Match the explored facts against each of the given premise sets. This
+   * finds the same premises the search would have, had the premise set
+   * been its auxKB (barring the fringe check, which only considered the
+   * nodes which were matches or alignments for the search itself).
+   *
+   * @param premiseSets The premise fact hashes to look for, per set.
+   * @param maxResults The number of paths to return per premise set,
+   *                   cheapest first; 0 returns every match.
+   *
+   * @return A response per premise set, in the same order. A premise set
+   *         is hit if its response has any paths.
+   */
+  std::vector<syn_search_response> match(
+      const std::vector<btree::btree_set<uint64_t> >& premiseSets,
+      const uint32_t& maxResults = 0) const;
 };
 
 ///**
@@ -1351,18 +1965,83 @@ struct syn_search_response {
 
 /**
  * The entry method for starting a new search.
+ *
+ * @param checkpoint If not NULL, the search is resumed from this checkpoint
+ *                   (if it is not empty, and is a search of the same query),
+ *                   running for opts.maxTicks more ticks. When the search
+ *                   loop finishes, the checkpoint is overwritten with the
+ *                   state of the search, so that it can be resumed again.
+ * @param explored If not NULL, every fact the search visits (in this call,
+ *                 if it is resumed) is recorded here, to be matched against
+ *                 premise sets afterwards.
  */
 syn_search_response SynSearch(
     const Graph* mutationGraph,
-    const btree::btree_set<uint64_t>* mainKB,
+    const FactDB* mainKB,
     const btree::btree_set<uint64_t>& auxKB,
     const Tree* input,
     const SynSearchCosts* costs,
     const bool& assumedInitialTruth,
     const syn_search_options& opts,
-    const std::vector<AlignmentSimilarity>& softAlignments
+    const std::vector<AlignmentSimilarity>& softAlignments,
+    syn_search_checkpoint* checkpoint = NULL,
+    syn_search_explored* explored = NULL
     );
 
+/** @see SynSearch(), but with the main knowledge base in memory */
+inline syn_search_response SynSearch(
+    const Graph* mutationGraph,
+    const btree::btree_set<uint64_t>* mainKB,
+    const btree::btree_set<uint64_t>& auxKB,
+    const Tree* input,
+    const SynSearchCosts* costs,
+    const bool& assumedInitialTruth,
+    const syn_search_options& opts,
+    const std::vector<AlignmentSimilarity>& softAlignments,
+    syn_search_checkpoint* checkpoint = NULL,
+    syn_search_explored* explored = NULL
+    ) {
+  const BTreeFactDB kb(mainKB, false);
+  return SynSearch(mutationGraph, &kb, auxKB, input, costs,
+                   assumedInitialTruth, opts, softAlignments, checkpoint,
+                   explored);
+}
+
+/**
+ * Look up the query, and the facts it follows from by deletions alone, in
+ * the knowledge bases, without running a search. The deletions are those
+ * the search would take: each is a valid natural logic deletion of a
+ * subtree, taken from the tokens in the order the search visits them. Up to
+ * opts.maxFastSearchVariants variants are looked up, fewest deletions first,
+ * in a single batch.
+ *
+ * This answers exact matches and pure deletions without the setup of a
+ * full search; if it finds nothing, a full SynSearch() should be run.
+ * The response has no ticks, and no soft alignment scores.
+ */
+syn_search_response FastSearch(
+    const Graph* mutationGraph,
+    const FactDB* mainKB,
+    const btree::btree_set<uint64_t>& auxKB,
+    const Tree* input,
+    const SynSearchCosts* costs,
+    const bool& assumedInitialTruth,
+    const syn_search_options& opts);
+
+/** @see FastSearch(), but with the main knowledge base in memory */
+inline syn_search_response FastSearch(
+    const Graph* mutationGraph,
+    const btree::btree_set<uint64_t>* mainKB,
+    const btree::btree_set<uint64_t>& auxKB,
+    const Tree* input,
+    const SynSearchCosts* costs,
+    const bool& assumedInitialTruth,
+    const syn_search_options& opts) {
+  const BTreeFactDB kb(mainKB, false);
+  return FastSearch(mutationGraph, &kb, auxKB, input, costs,
+                    assumedInitialTruth, opts);
+}
+
 /** @see SynSearch(), but with no soft alignments*/
 inline syn_search_response SynSearch(
     const Graph* mutationGraph,
@@ -1385,10 +2064,13 @@ inline syn_search_response SynSearch(
     const SynSearchCosts* costs,
     const bool& assumedInitialTruth,
     const syn_search_options& opts,
-    const std::vector<AlignmentSimilarity>& softAlignments
+    const std::vector<AlignmentSimilarity>& softAlignments,
+    syn_search_checkpoint* checkpoint = NULL,
+    syn_search_explored* explored = NULL
     ) {
   return SynSearch(mutationGraph, mainKB, btree::btree_set<uint64_t>(), 
-      input, costs, assumedInitialTruth, opts, softAlignments);
+      input, costs, assumedInitialTruth, opts, softAlignments, checkpoint,
+      explored);
 }
 
 /** @see SynSearch(), but with only one knowledge base and no soft alignments */
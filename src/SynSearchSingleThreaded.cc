@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <thread>
 
 #include "SynSearch.h"
+#include "LandmarkOracle.h"
 #include "Utils.h"
+#include "btree_map.h"
 
 using namespace std;
 
@@ -11,6 +14,9 @@ using namespace std;
 // SEARCH ALGORITHM
 // ----------------------------------------------
 
+/** The smallest fringe worth checking with an extra thread */
+#define FRINGE_CHECK_MIN_CHUNK 65536
+
 
 inline uint64_t memoryItem(const uint64_t& fact, const uint8_t& currentIndex,
                            const bool& truth) {
@@ -18,6 +24,43 @@ inline uint64_t memoryItem(const uint64_t& fact, const uint8_t& currentIndex,
   return (fact << 9) | currentIndexShifted | (truth ? 1l : 0l);
 } 
 
+#if SEARCH_CYCLE_FINGERPRINT!=0
+//
+// Returns true if this child of the given (popped) node is the same as one of
+// the node's last SEARCH_CYCLE_MEMORY ancestors; a child is never the same as
+// its own parent. The ancestor fingerprints stored in the parent rule out
+// nearly every candidate without touching the history; the history is only
+// read, up to the furthest ancestor with a matching fingerprint, when a
+// fingerprint matches.
+// Index moves are not in the history, so an ancestor which was expanded at a
+// different index than the one it was stored at is moved to that index
+// before comparing.
+//
+inline bool repeatsAncestor(const SearchNode& node, const SearchNode& parent,
+                            const SearchNode* history, const Tree& tree) {
+  uint32_t candidates = parent.ancestorsWithFingerprintOf(node);
+  if (candidates == 0) { return false; }
+  // (a fingerprint matched; walk the history up to the last candidate)
+  const SearchNode& storedParent = history[node.getBackpointer()];
+  uint32_t ancestor = storedParent.getBackpointer();
+  uint8_t expandedIndex = storedParent.tokenIndex();
+  while (candidates != 0) {
+    const SearchNode& stored = history[ancestor];
+    if (candidates & 0x1) {
+      if (stored.tokenIndex() == expandedIndex
+            ? stored == node
+            : SearchNode(stored, tree, expandedIndex, ancestor) == node) {
+        return true;
+      }
+    }
+    candidates >>= 1;
+    expandedIndex = stored.tokenIndex();
+    ancestor = stored.getBackpointer();
+  }
+  return false;
+}
+#endif
+
 
 //
 // -----------
@@ -31,29 +74,32 @@ inline uint64_t searchLoop(
     std::function<void(const ScoredSearchNode)> enqueue,
     std::function<const bool (ScoredSearchNode*)> dequeue,
     std::function<void(const ScoredSearchNode&)> registerVisited,
+    std::function<void(ScoredSearchNode*, const uint32_t&)> lookupChildren,
     SearchNode* history, uint64_t& historySize,
+    btree::btree_set<uint64_t>* fullMemory,
     const SynSearchCosts* costs, const syn_search_options& opts,
-    const vector<AlignmentSimilarity>& softAlignments,
+    const AlignmentMatrix& softAlignments,
     const Graph* graph, const Tree& tree) {
 
   // Variables
-  uint64_t ticks = 0;
+  // (a resumed search starts with the history of the ticks it has run)
+  uint64_t ticks = historySize - 1;
   uint8_t  dependentIndices[8];
   natlog_relation  dependentRelations[8];
   ScoredSearchNode* scoredNode = (ScoredSearchNode*) alloca(sizeof(ScoredSearchNode));
   featurized_edge features;
-  // (initialize the memory)
-#if SEARCH_FULL_MEMORY!=0
-  btree::btree_set<uint64_t> fullMemory;
-#else
-#if SEARCH_CYCLE_MEMORY!=0
-  uint8_t memorySize = 0;
-  SearchNode memory[SEARCH_CYCLE_MEMORY];
-#endif
-#endif
+  // (the children of the current node; these are looked up in the KB
+  //  together, and then pushed)
+  ScoredSearchNode* children = (ScoredSearchNode*) alloca((MAX_BRANCHOUT + 8) * sizeof(ScoredSearchNode));
+  uint32_t numChildren = 0;
+  // (the landmarks' costs to the goal words, summarized once for the query)
+  landmark_goals goals;
+  if (opts.landmarks != NULL) { goals = opts.landmarks->summarizeGoals(opts.goalWords); }
   // (initialize the scores array)
+#if MAX_FUZZY_MATCHES > 0
   float currentNodeSoftAlignmentScores[MAX_FUZZY_MATCHES];
   float childNodeSoftAlignmentScores[MAX_FUZZY_MATCHES];
+#endif
 
   // Compute quantifiers
   const int16_t numQuantifiers = tree.getNumQuantifiers();
@@ -72,12 +118,19 @@ inline uint64_t searchLoop(
   tree.topologicalSort(topologicalOrder);
 
   // Main Loop
-  while (ticks < opts.maxTicks && dequeue(scoredNode)) {
+  // (index moves cost nothing, and so rather than being pushed onto the
+  //  fringe they are expanded in place, without taking a tick or a slot in
+  //  the history; their children point back to the node they moved from)
+  bool expandIndexMove = false;
+  uint32_t myIndex = 0;
+  while (expandIndexMove || (ticks < opts.maxTicks && dequeue(scoredNode))) {
     // ---
     // POP NODE
     // ---
 
     // Register the dequeue'd element
+    const bool isIndexMove = expandIndexMove;
+    expandIndexMove = false;
     const SearchNode& node = scoredNode->node;
     // (handle the memory: e.g., duplicate visits)
 #if SEARCH_FULL_MEMORY!=0
@@ -86,35 +139,29 @@ inline uint64_t searchLoop(
         node.tokenIndex(), 
         true);
 //        node.truthState());  // note[gabor] should we consider true and false states different?
-    if (fullMemory.find(fullMemoryItem) != fullMemory.end()) {
+    if (fullMemory->find(fullMemoryItem) != fullMemory->end()) {
       continue;  // Prohibit duplicate visits
     }
-    fullMemory.insert(fullMemoryItem);
-#else
-#if SEARCH_CYCLE_MEMORY!=0
-    // ??? [gabor May 2015 was wondering]
-    assert (node.getBackpointer() < historySize);
-    memory[0] = history[node.getBackpointer()];
-    memorySize = 1;
-    for (uint8_t i = 1; i < SEARCH_CYCLE_MEMORY; ++i) {
-      assert (i > 0);
-      if (memory[i - 1].getBackpointer() != 0) {
-        assert (memory[i - 1].getBackpointer() < historySize);
-        memory[i] = history[memory[i - 1].getBackpointer()];
-        memorySize = i + 1;
-      }
-    }
-    const SearchNode& parent = history[node.getBackpointer()];
-#endif
+    fullMemory->insert(fullMemoryItem);
 #endif
     // (handle soft alignments)
 #if MAX_FUZZY_MATCHES > 0
-    memcpy(currentNodeSoftAlignmentScores, node.softAlignmentScores(), MAX_FUZZY_MATCHES * sizeof(float));
+    if (!isIndexMove) {  // (an index move keeps the scores of the node it moved from)
+      memcpy(currentNodeSoftAlignmentScores, node.softAlignmentScores(), MAX_FUZZY_MATCHES * sizeof(float));
+    }
     memcpy(childNodeSoftAlignmentScores, currentNodeSoftAlignmentScores, MAX_FUZZY_MATCHES * sizeof(float));
+    // (the polarity of the current token; this is shared by all children
+    //  which do not touch a quantifier)
+    const monotonicity nodePolarity = softAlignments.size() > 0
+      ? tree.polarityAt(node, node.tokenIndex()) : MONOTONE_INVALID;
 #endif
     
     // Register visited
-    registerVisited(*scoredNode);
+    // (an index move has the same fact, truth and alignments as the node it
+    //  moved from, which has already been visited)
+    if (!isIndexMove) {
+      registerVisited(*scoredNode);
+    }
 
     // Collect info on whether this was a quantifier
     const uint8_t tokenIndex = node.tokenIndex();
@@ -131,31 +178,33 @@ inline uint64_t searchLoop(
     }
 
     // Update history
-    const uint32_t myIndex = historySize;
-    // >> debug (warning: very verbose!)
-//    vector<SearchNode> path;
-//    path.push_back(node);
-//    if (node.getBackpointer() != 0) {
-//      SearchNode head = node;
-//      while (head.getBackpointer() != 0) {
-//        path.push_back(head);
-//        head = history[head.getBackpointer()];
+    if (!isIndexMove) {
+      myIndex = historySize;
+      // >> debug (warning: very verbose!)
+//      vector<SearchNode> path;
+//      path.push_back(node);
+//      if (node.getBackpointer() != 0) {
+//        SearchNode head = node;
+//        while (head.getBackpointer() != 0) {
+//          path.push_back(head);
+//          head = history[head.getBackpointer()];
+//        }
 //      }
-//    }
-//    fprintf(stderr, "%u>> %s = %s (points to %u; nextQuant=%d; truth=%u; index=%u)\n", 
-//      myIndex, toString(*graph, tree, node).c_str(),
-//      kbGloss(*graph, tree, path).c_str(),
-//      node.getBackpointer(), nextQuantifierTokenIndex,
-//      node.truthState(), node.tokenIndex());
-    // << end debug 
-    assert (myIndex < (opts.maxTicks + 1));  // + 1 to allow for the root
-    history[myIndex] = node;
-    historySize += 1;
-    ticks += 1;
-    assert (historySize == (ticks + 1));
-    if (!opts.silent && ticks % 100000 == 0) {
-      printTime("[%c] "); 
-      fprintf(stderr, "  |Search Progress| ticks=%luK\n", ticks / 1000);
+//      fprintf(stderr, "%u>> %s = %s (points to %u; nextQuant=%d; truth=%u; index=%u)\n", 
+//        myIndex, toString(*graph, tree, node).c_str(),
+//        kbGloss(*graph, tree, path).c_str(),
+//        node.getBackpointer(), nextQuantifierTokenIndex,
+//        node.truthState(), node.tokenIndex());
+      // << end debug 
+      assert (myIndex < (opts.maxTicks + 1));  // + 1 to allow for the root
+      history[myIndex] = node;
+      historySize += 1;
+      ticks += 1;
+      assert (historySize == (ticks + 1));
+      if (!opts.silent && ticks % 100000 == 0) {
+        printTime("[%c] "); 
+        fprintf(stderr, "  |Search Progress| ticks=%luK\n", ticks / 1000);
+      }
     }
     
     // ---
@@ -180,6 +229,14 @@ inline uint64_t searchLoop(
       if (edge.source_sense != 0 && edge.sink_sense != nodeToken.sense) { 
         continue; 
       }
+      // (ignore mutations into words which can't lead to a premise)
+      if (opts.premiseWords != NULL && !opts.premiseWords->contains(edge.source)) {
+        continue;
+      }
+      if (opts.landmarks != NULL &&
+          isinf(opts.landmarks->lowerBound(edge.source, goals))) {
+        continue;
+      }
       // (ignore meronym edges if not a location)
       if ( (edge.type == MERONYM || edge.type == HOLONYM) &&
            !tree.isLocation(tokenIndex) ) {
@@ -219,6 +276,9 @@ inline uint64_t searchLoop(
         continue; 
       }
       const float cost = mutationCost * edge.cost;
+      if (cost > opts.costThreshold) {
+        continue;
+      }
 
       // (create child)
       SearchNode mutatedChild  // not const; we may mutate it below
@@ -240,46 +300,40 @@ inline uint64_t searchLoop(
       }
       // (push child)
       // ((check memory))
-#if SEARCH_FULL_MEMORY!=0
-#else
-#if SEARCH_CYCLE_MEMORY!=0
-      bool isNewChild = true;
-      for (uint8_t i = 0; i < memorySize; ++i) {
-        isNewChild &= (mutatedChild != memory[i]);
-      }
-      if (isNewChild) {
-#endif
+#if SEARCH_CYCLE_FINGERPRINT!=0
+      if (!repeatsAncestor(mutatedChild, node, history, tree)) {
 #endif
       // ((update alignment scores))
-      for (uint8_t alignI = 0; alignI < MAX_FUZZY_MATCHES; ++alignI) {
-        if (alignI < softAlignments.size()) {
-          childNodeSoftAlignmentScores[alignI] = softAlignments[alignI].updateScore(
-              currentNodeSoftAlignmentScores[alignI],
-              mutatedChild.tokenIndex(),
-              edge.sink,
-              edge.source,
-              tree.polarityAt(node, node.tokenIndex()),
-              tree.polarityAt(mutatedChild, mutatedChild.tokenIndex()),
-              node.truthState(),
-              newTruthValue);
-        }
+#if MAX_FUZZY_MATCHES > 0
+      if (softAlignments.size() > 0) {
+        softAlignments.updateScores(
+            currentNodeSoftAlignmentScores,
+            childNodeSoftAlignmentScores,
+            mutatedChild.tokenIndex(),
+            edge.sink,
+            edge.source,
+            nodePolarity,
+            quantifierIndex >= 0  // only quantifier mutations change polarity
+              ? tree.polarityAt(mutatedChild, mutatedChild.tokenIndex())
+              : nodePolarity,
+            node.truthState(),
+            newTruthValue);
       }
+#endif
       // ((perform push))
       assert(!isinf(cost));
       assert(cost == cost);  // NaN check
       assert(cost >= 0.0);
       assert(mutatedChild.incomingFeatures.transitionTaken != 7);
 #if MAX_FUZZY_MATCHES > 0
-      enqueue(ScoredSearchNode(mutatedChild, cost, childNodeSoftAlignmentScores));
+      children[numChildren] = ScoredSearchNode(mutatedChild, cost, childNodeSoftAlignmentScores);
 #else 
-      enqueue(ScoredSearchNode(mutatedChild, cost));
+      children[numChildren] = ScoredSearchNode(mutatedChild, cost);
 #endif
+      numChildren += 1;
       assert(mutatedChild.incomingFeatures.transitionTaken != 7);
-#if SEARCH_FULL_MEMORY!=0
-#else
-#if SEARCH_CYCLE_MEMORY!=0
+#if SEARCH_CYCLE_FINGERPRINT!=0
       }
-#endif
 #endif
       // Short-circuit the search if branching factor is too large
       numEdgesTaken += 1;
@@ -308,7 +362,7 @@ inline uint64_t searchLoop(
             tree, node, tree.relation(dependentIndex),
             tree.word(dependentIndex), node.truthState(), &newTruthValue,
             &features);
-      if (!isinf(cost)) {
+      if (!isinf(cost) && cost <= opts.costThreshold) {
         // (create child)
         SearchNode deletedChild 
           = node.deletion(myIndex, newTruthValue, tree, dependentIndex);
@@ -318,19 +372,22 @@ inline uint64_t searchLoop(
         assert(deletedChild.incomingFeatures.insertionTaken != 255);
         assert(deletedChild.word() < graph->vocabSize());
         // ((update alignment scores))
-        for (uint8_t alignI = 0; alignI < MAX_FUZZY_MATCHES; ++alignI) {
-          if (alignI < softAlignments.size()) {
-            childNodeSoftAlignmentScores[alignI] = softAlignments[alignI].updateScore(
-                currentNodeSoftAlignmentScores[alignI],
-                deletedChild.tokenIndex(),
-                node.word(),
-                INVALID_WORD,
-                tree.polarityAt(node, node.tokenIndex()),
-                tree.polarityAt(deletedChild, deletedChild.tokenIndex()),
-                node.truthState(),
-                newTruthValue);
-          }
+#if MAX_FUZZY_MATCHES > 0
+        if (softAlignments.size() > 0) {
+          softAlignments.updateScores(
+              currentNodeSoftAlignmentScores,
+              childNodeSoftAlignmentScores,
+              deletedChild.tokenIndex(),
+              node.word(),
+              INVALID_WORD,
+              nodePolarity,
+              tree.isQuantifier(dependentIndex)  // only deleting a quantifier changes polarity
+                ? tree.polarityAt(deletedChild, deletedChild.tokenIndex())
+                : nodePolarity,
+              node.truthState(),
+              newTruthValue);
         }
+#endif
         // (push child)
 //        fprintf(stderr, "  push deletion %s\n", toString(*graph, tree, deletedChild).c_str());
         assert(!isinf(cost));
@@ -338,13 +395,22 @@ inline uint64_t searchLoop(
         assert(cost >= 0.0);
         assert(deletedChild.incomingFeatures.insertionTaken != 255);
 #if MAX_FUZZY_MATCHES > 0
-        enqueue(ScoredSearchNode(deletedChild, cost, childNodeSoftAlignmentScores));
+        children[numChildren] = ScoredSearchNode(deletedChild, cost, childNodeSoftAlignmentScores);
 #else 
-        enqueue(ScoredSearchNode(deletedChild, cost));
+        children[numChildren] = ScoredSearchNode(deletedChild, cost);
 #endif
+        numChildren += 1;
         assert(deletedChild.incomingFeatures.insertionTaken != 255);
       }
     }  // end children loop
+
+    // Look up the children in the KB, and push them
+    assert (numChildren <= MAX_BRANCHOUT + 8);
+    lookupChildren(children, numChildren);
+    for (uint32_t childI = 0; childI < numChildren; ++childI) {
+      enqueue(children[childI]);
+    }
+    numChildren = 0;
     
     // ---
     // HANDLE INDICES
@@ -371,12 +437,9 @@ inline uint64_t searchLoop(
         assert(indexMovedChild.incomingFeatures.mutationTaken == 31);
         assert(indexMovedChild.incomingFeatures.transitionTaken == 7);
         assert(indexMovedChild.incomingFeatures.insertionTaken == 255);
-        // (push child)
-#if MAX_FUZZY_MATCHES > 0
-        enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost, currentNodeSoftAlignmentScores));
-#else
-        enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost));
-#endif
+        // (expand child in place)
+        scoredNode->node = indexMovedChild;
+        expandIndexMove = true;
       }
   
     } else if (nextQuantifierTokenIndex >= 0) {
@@ -397,11 +460,8 @@ inline uint64_t searchLoop(
           assert(indexMovedChild.incomingFeatures.mutationTaken == 31);
           assert(indexMovedChild.incomingFeatures.transitionTaken == 7);
           assert(indexMovedChild.incomingFeatures.insertionTaken == 255);
-#if MAX_FUZZY_MATCHES > 0
-          enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost, currentNodeSoftAlignmentScores));
-#else
-          enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost));
-#endif
+          scoredNode->node = indexMovedChild;
+          expandIndexMove = true;
         }
       } else {
         // (case: still mutating quantifiers)
@@ -409,11 +469,8 @@ inline uint64_t searchLoop(
         assert(indexMovedChild.incomingFeatures.mutationTaken == 31);
         assert(indexMovedChild.incomingFeatures.transitionTaken == 7);
         assert(indexMovedChild.incomingFeatures.insertionTaken == 255);
-#if MAX_FUZZY_MATCHES > 0
-        enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost, currentNodeSoftAlignmentScores));
-#else
-        enqueue(ScoredSearchNode(indexMovedChild, scoredNode->cost));
-#endif
+        scoredNode->node = indexMovedChild;
+        expandIndexMove = true;
       }
     }  // end quantifier push conditional
   }  // end search loop
@@ -428,18 +485,337 @@ inline uint64_t searchLoop(
 
 
 
+//
+// Add the paths of the cheapest of the given matches to the response.
+// The nodes are shared between paths: each history entry is only added to
+// the response once.
+//
+void addPaths(const vector<ScoredSearchNode>& matches,
+              const SearchNode* history,
+              const bool& assumedInitialTruth,
+              const uint32_t& maxResults,
+              syn_search_response* response,
+              std::function<void(const uint64_t&)> onPath) {
+  // (stable, so that ties are returned in the order they were found)
+  vector<uint32_t> matchOrder(matches.size());
+  for (uint32_t i = 0; i < matches.size(); ++i) { matchOrder[i] = i; }
+  std::stable_sort(matchOrder.begin(), matchOrder.end(),
+      [&matches](const uint32_t& a, const uint32_t& b) -> bool {
+        return matches[a].cost < matches[b].cost;
+      });
+  if (maxResults > 0 && matchOrder.size() > maxResults) {
+    matchOrder.resize(maxResults);
+  }
+  btree::btree_map<uint32_t,uint32_t> historyToNode;
+  response->numResults = matches.size();
+  response->paths.reserve(matchOrder.size());
+  response->featurizedPaths.reserve(matchOrder.size());
+  for (auto iter = matchOrder.begin(); iter != matchOrder.end(); ++iter) {
+    const ScoredSearchNode& match = matches[*iter];
+    const uint32_t begin = response->pathNodes.size();
+    // (get the complete path)
+    feature_vector myFeatures;
+    myFeatures.increment(match.node.incomingFeatures, assumedInitialTruth);
+    response->pathNodes.push_back(response->nodes.size());
+    response->nodes.push_back(match.node);
+    uint32_t backpointer = match.node.getBackpointer();
+    while (backpointer != 0) {
+      const SearchNode& head = history[backpointer];
+      auto existing = historyToNode.find(backpointer);
+      if (existing == historyToNode.end()) {
+        historyToNode[backpointer] = response->nodes.size();
+        response->pathNodes.push_back(response->nodes.size());
+        response->nodes.push_back(head);
+      } else {
+        response->pathNodes.push_back(existing->second);
+      }
+      myFeatures.increment(head.incomingFeatures, assumedInitialTruth ^ head.truthState());
+      backpointer = head.getBackpointer();
+    }
+    // (add to the results list)
+    response->paths.push_back(syn_search_path(
+          begin, response->pathNodes.size() - begin, match.cost));
+    response->featurizedPaths.push_back(myFeatures);
+    onPath(response->paths.size() - 1);
+  }
+}
+
+//
+// Returns true if the node has deleted all but one word of the query; such
+// matches are degenerate, and are not returned.
+//
+inline bool isDegenerateMatch(const SearchNode& node, const uint8_t& queryLength) {
+  uint8_t numWordsInPremise = 0;
+  for (uint8_t i = 0; i < queryLength; ++i) {
+    if (!node.isDeleted(i)) {
+      numWordsInPremise += 1;
+    }
+  }
+  return numWordsInPremise < 2;
+}
+
+//
+// The cost to return a match at: the cost of its path, less a bonus for how
+// often its fact was seen (see syn_search_options::factCountBonus).
+//
+inline float matchCost(const FactDB* kb, const uint64_t& fact, const float& cost,
+                       const float& factCountBonus) {
+  if (factCountBonus <= 0.0f) { return cost; }
+  const uint32_t count = kb->count(fact);
+  return max(0.0f, cost - factCountBonus * log((float) max((uint32_t) 1, count)));
+}
+
+//
+// syn_search_explored::record()
+//
+void syn_search_explored::record(const SearchNode& node, const float& cost,
+                                 const uint32_t& historyIndex) {
+  const bool truth = node.truthState();
+  auto existing = facts.find(node.factHash());
+  if (existing == facts.end()) {
+    visit& v = facts[node.factHash()];
+    v.cost = cost;
+    v.historyIndex = historyIndex;
+    v.truth = truth;
+  } else if ((truth && !existing->second.truth) ||
+             (truth == existing->second.truth && cost < existing->second.cost)) {
+    existing->second.cost = cost;
+    existing->second.historyIndex = historyIndex;
+    existing->second.truth = truth;
+  }
+}
+
+//
+// syn_search_explored::match()
+//
+vector<syn_search_response> syn_search_explored::match(
+    const vector<btree::btree_set<uint64_t> >& premiseSets,
+    const uint32_t& maxResults) const {
+  vector<syn_search_response> responses(premiseSets.size());
+  vector<ScoredSearchNode> matches;
+  for (uint32_t setI = 0; setI < premiseSets.size(); ++setI) {
+    syn_search_response& response = responses[setI];
+    response.totalTicks = totalTicks;
+    // (find the premises visited)
+    matches.clear();
+    const btree::btree_set<uint64_t>& premises = premiseSets[setI];
+    for (auto premise = premises.begin(); premise != premises.end(); ++premise) {
+      auto v = facts.find(*premise);
+      if (v == facts.end() || !v->second.truth) { continue; }
+      const SearchNode& node = history[v->second.historyIndex];
+      if (isDegenerateMatch(node, queryLength)) { continue; }
+      matches.push_back(ScoredSearchNode());
+      matches.back().node = node;
+      matches.back().cost = v->second.cost;
+    }
+    // (build their paths)
+    addPaths(matches, history.data(), assumedInitialTruth, maxResults,
+             &response, [](const uint64_t& pathI) -> void { });
+  }
+  return responses;
+}
+
+//
+// Move the node to the token the search would visit after its current one,
+// as the index moves in searchLoop do. Returns false if there is no such
+// token.
+//
+inline bool moveIndex(const SearchNode& node, const Tree& tree,
+                      const uint8_t* quantifierVisitOrder,
+                      const uint8_t& numQuantifiers,
+                      const uint8_t* topologicalOrder,
+                      const uint32_t& backpointer,
+                      SearchNode* moved) {
+  const uint8_t tokenIndex = node.tokenIndex();
+  int8_t nextQuantifierTokenIndex = -1;
+  for (uint8_t i = 0; i < numQuantifiers; ++i) {
+    if (quantifierVisitOrder[i] == tokenIndex) {
+      nextQuantifierTokenIndex = i < numQuantifiers - 1
+        ? quantifierVisitOrder[i + 1] : tree.root();
+    }
+  }
+  if (nextQuantifierTokenIndex < 0) {
+    // (regular order)
+    uint8_t i = 0;
+    while (topologicalOrder[i] != tokenIndex && topologicalOrder[i] != 255) {
+      i += 1;
+    }
+    const uint8_t nextIndex = topologicalOrder[i] == 255 ? 255 : topologicalOrder[i + 1];
+    if (nextIndex == 255 || node.isDeleted(nextIndex)) { return false; }
+    *moved = SearchNode(node, tree, nextIndex, backpointer);
+    return true;
+  } else {
+    // (quantifier order, and then on to the root once)
+    *moved = SearchNode(node, tree, nextQuantifierTokenIndex, backpointer);
+    if (nextQuantifierTokenIndex == tree.root()) {
+      if (moved->allQuantifiersSeen()) { return false; }
+      moved->setAllQuantifiersSeen();
+    }
+    return true;
+  }
+}
+
+//
+// The entry method for the fast tier
+//
+syn_search_response FastSearch(
+    const Graph* mutationGraph,
+    const FactDB* kb,
+    const btree::btree_set<uint64_t>& auxKB,
+    const Tree* input, const SynSearchCosts* costs,
+    const bool& assumedInitialTruth, const syn_search_options& opts) {
+  syn_search_response response;
+  response.totalTicks = 0;
+
+  // Visit order of the tokens
+  const uint8_t numQuantifiers = input->getNumQuantifiers();
+  uint8_t quantifierVisitOrder[numQuantifiers + 1];
+  uint8_t numQuantifiersSeen = 0;
+  for (uint8_t i = 0; i < input->length; ++i) {
+    if (input->isQuantifier(i)) {
+      quantifierVisitOrder[numQuantifiersSeen] = i;
+      numQuantifiersSeen += 1;
+    }
+  }
+  uint8_t topologicalOrder[input->length + 1];
+  input->topologicalSort(topologicalOrder);
+
+  // Enumerate the deletion lattice
+  // (as in the search, history[0] stands in for the root's parent, and every
+  //  node points back to the last node it was not an index move of. The
+  //  variants are enumerated breadth first, fewest deletions first)
+  vector<SearchNode> history;
+  vector<float> variantCosts;
+  SearchNode start = numQuantifiers > 0
+    ? SearchNode(*input, assumedInitialTruth, input->quantifierTokenIndex(0))
+    : SearchNode(*input, assumedInitialTruth);
+  history.push_back(start);
+  variantCosts.push_back(0.0f);
+  history.push_back(start);
+  variantCosts.push_back(0.0f);
+  btree::btree_set<uint64_t> seen;
+  seen.insert(memoryItem(start.factHash(), start.tokenIndex(), start.truthState()));
+  uint8_t dependentIndices[8];
+  natlog_relation dependentRelations[8];
+  featurized_edge features;
+  for (uint32_t variantI = 1;
+       variantI < history.size() && history.size() <= opts.maxFastSearchVariants;
+       ++variantI) {
+    SearchNode node = history[variantI];
+    bool moved = true;
+    while (moved && history.size() <= opts.maxFastSearchVariants) {
+      // (delete each dependent of the current token)
+      const uint8_t tokenIndex = node.tokenIndex();
+      uint8_t numDependents;
+      input->dependents(tokenIndex, 8, dependentIndices,
+                        dependentRelations, &numDependents);
+      for (uint8_t dependentI = 0; dependentI < numDependents; ++dependentI) {
+        const uint8_t& dependentIndex = dependentIndices[dependentI];
+        if (node.isDeleted(dependentIndex)) { continue; }
+        bool newTruthValue;
+        const float cost = costs->insertionCost(
+              *input, node, input->relation(dependentIndex),
+              input->word(dependentIndex), node.truthState(), &newTruthValue,
+              &features);
+        if (isinf(cost)) { continue; }  // (not a valid deletion)
+        SearchNode deletedChild
+          = node.deletion(variantI, newTruthValue, *input, dependentIndex);
+        deletedChild.incomingFeatures = features;
+        if (!seen.insert(memoryItem(deletedChild.factHash(),
+                                    deletedChild.tokenIndex(),
+                                    deletedChild.truthState())).second) {
+          continue;
+        }
+        history.push_back(deletedChild);
+        variantCosts.push_back(cost);
+        if (history.size() > opts.maxFastSearchVariants) { break; }
+      }
+      // (move on to the next token)
+      moved = moveIndex(node, *input, quantifierVisitOrder, numQuantifiers,
+                        topologicalOrder, variantI, &node);
+    }
+  }
+
+  // Look up the true variants in one batch
+  // (in sorted hash order, as the children in the search are)
+  vector<uint32_t> order;
+  for (uint32_t i = 1; i < history.size(); ++i) {
+    if (history[i].truthState()) { order.push_back(i); }
+  }
+  std::sort(order.begin(), order.end(),
+      [&history](const uint32_t& a, const uint32_t& b) -> bool {
+        return history[a].factHash() < history[b].factHash();
+      });
+  vector<uint64_t> facts;
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    const uint64_t fact = history[order[i]].factHash();
+    if (facts.empty() || facts.back() != fact) { facts.push_back(fact); }
+  }
+  bool found[facts.size() + 1];
+  kb->lookupBatch(facts.data(), facts.size(), found, &response.kbStats);
+  vector<ScoredSearchNode> matches;
+  uint32_t factI = 0;
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    const SearchNode& node = history[order[i]];
+    if (i > 0 && node.factHash() == history[order[i - 1]].factHash()) { continue; }
+    const bool hit = found[factI] || auxKB.find(node.factHash()) != auxKB.end();
+    factI += 1;
+    if (!hit) { continue; }
+    if (isDegenerateMatch(node, input->length)) { continue; }
+    matches.push_back(ScoredSearchNode());
+    matches.back().node = node;
+    matches.back().cost = matchCost(kb, node.factHash(), variantCosts[order[i]],
+                                    opts.factCountBonus);
+  }
+  if (!opts.silent) {
+    printTime("[%c] ");
+    fprintf(stderr, "|FAST SEARCH| %lu variants; %lu true; %lu matches\n",
+            history.size() - 1, order.size(), matches.size());
+  }
+
+  // Materialize the paths
+  addPaths(matches, history.data(), assumedInitialTruth, opts.maxResults,
+           &response, [](const uint64_t& pathI) -> void { });
+  return response;
+}
+
 //
 // The entry method for searching
 //
 syn_search_response SynSearch(
     const Graph* mutationGraph, 
-    const btree::btree_set<uint64_t>* kb,
+    const FactDB* kb,
     const btree::btree_set<uint64_t>& auxKB,
     const Tree* input, const SynSearchCosts* costs,
-    const bool& assumedInitialTruth, const syn_search_options& opts,
-    const vector<AlignmentSimilarity>& softAlignments) {
+    const bool& assumedInitialTruth, const syn_search_options& userOpts,
+    const vector<AlignmentSimilarity>& softAlignments,
+    syn_search_checkpoint* checkpoint,
+    syn_search_explored* explored) {
   syn_search_response response;
 
+  // Check for a checkpoint to resume from
+  const uint64_t queryKey = syn_search_checkpoint::queryKey(*input, assumedInitialTruth);
+  const bool resume = checkpoint != NULL && !checkpoint->empty();
+  if (resume && checkpoint->key != queryKey) {
+    printTime("[%c] ");
+    fprintf(stderr, "ERROR: Checkpoint is not for this query (key %lu; expected %lu)\n",
+            checkpoint->key, queryKey);
+    response.totalTicks = 0;
+    return response;
+  }
+  // (a resumed search runs for maxTicks on top of the ticks it has run)
+  syn_search_options opts = userOpts;
+  if (resume) {
+    opts.maxTicks = (uint64_t) userOpts.maxTicks + checkpoint->ticks < (0x1 << 25)
+      ? userOpts.maxTicks + checkpoint->ticks : (0x1 << 25);
+  }
+  // (a fact in the main KB can have any words; pruning to the premise
+  //  words is only valid without one)
+  if (!kb->empty()) {
+    opts.premiseWords = NULL;
+    opts.landmarks = NULL;
+  }
+
   // Debug print parameters
   if (opts.maxTicks >= 0x1 << 25) {
     printTime("[%c] ");
@@ -450,6 +826,16 @@ syn_search_response SynSearch(
   if (!opts.silent) {
     printTime("[%c] ");
     fprintf(stderr, "|BEGIN SEARCH| fact='%s'\n", toString(*mutationGraph, *input).c_str());
+    if (opts.premiseWords != NULL) {
+      printTime("[%c] ");
+      fprintf(stderr, "  pruning mutations to %lu words which reach a premise\n",
+              opts.premiseWords->size());
+    }
+    if (opts.landmarks != NULL) {
+      printTime("[%c] ");
+      fprintf(stderr, "  pruning mutations with %u landmarks to %lu goal words\n",
+              opts.landmarks->numLandmarks(), opts.goalWords.size());
+    }
   }
   
   // -- Helpers --
@@ -460,6 +846,13 @@ syn_search_response SynSearch(
   KNHeap<float,SearchNode>* fringe = new KNHeap<float,SearchNode>(
     std::numeric_limits<float>::infinity(),
     -std::numeric_limits<float>::infinity());
+#if SEARCH_DOMINANCE_FILTER!=0
+  // The cheapest cost each state has been pushed with
+  StateCostMap bestCosts;
+  uint64_t numDominated = 0;
+#endif
+  // The states expanded so far (SEARCH_FULL_MEMORY)
+  btree::btree_set<uint64_t> fullMemory;
   // The closeset approximate match
   uint8_t closestSoftAlignment = 0;
   float   closestSoftAlignmentScore = -std::numeric_limits<float>::infinity();
@@ -470,20 +863,59 @@ syn_search_response SynSearch(
     closestSoftAlignmentSearchCosts[i] = 0.0f;
   }
   // The database lookup function
-  // (the matches found)
-  vector<syn_search_path>& matches = response.paths;
-  vector<feature_vector>& featurizedPaths = response.featurizedPaths;
+  // (the matches found; their paths are only materialized once the search
+  //  is done, for the results which are returned)
+  vector<ScoredSearchNode> matches;
+  btree::btree_set<uint64_t> matchedFacts;
   // (the lookup function)
-  std::function<bool(uint64_t)> lookupFn = [&kb,&auxKB](const uint64_t& value) -> bool {
-    return kb->find(value) != kb->end() || auxKB.find(value) != auxKB.end();
+  std::function<bool(uint64_t)> lookupFn = [&kb,&auxKB,&response](const uint64_t& value) -> bool {
+    return kb->lookup(value, &response.kbStats) || auxKB.find(value) != auxKB.end();
+  };
+  // (look up all the children of a node at once, marking the hits on the
+  //  nodes themselves. Only true children can be matches. Their distinct
+  //  facts are looked up in sorted order as one batch, so that the probes'
+  //  cache misses overlap rather than following each other; see
+  //  FactDB::lookupBatch())
+  auto lookupChildren = [&kb,&auxKB,&response](ScoredSearchNode* children,
+                                              const uint32_t& numChildren) -> void {
+    uint64_t facts[numChildren];
+    uint32_t numFacts = 0;
+    for (uint32_t i = 0; i < numChildren; ++i) {
+      if (children[i].node.truthState()) {
+        facts[numFacts] = children[i].node.factHash();
+        numFacts += 1;
+      }
+    }
+    if (numFacts == 0) { return; }
+    std::sort(facts, facts + numFacts);
+    numFacts = std::unique(facts, facts + numFacts) - facts;
+    bool found[numFacts];
+    kb->lookupBatch(facts, numFacts, found, &response.kbStats);
+    for (uint32_t i = 0; i < numFacts; ++i) {
+      if (!found[i]) { found[i] = auxKB.find(facts[i]) != auxKB.end(); }
+    }
+    for (uint32_t i = 0; i < numChildren; ++i) {
+      SearchNode& node = children[i].node;
+      if (node.truthState()) {
+        node.setKBHit(found[std::lower_bound(facts, facts + numFacts, node.factHash()) - facts]);
+      }
+    }
   };
+  // (the fringe nodes visited when checking the fringe; these follow the
+  //  history in the explored facts)
+  vector<SearchNode> fringeVisited;
   // (register a node as visited)
-  auto registerVisited = [&matches,&lookupFn,&history,&mutationGraph,&input,
-                          &opts,&assumedInitialTruth,&featurizedPaths,
+  auto registerVisited = [&matches,&matchedFacts,&input,&opts,&kb,
+                          &explored,&historySize,&fringeVisited,
                           &closestSoftAlignment,&closestSoftAlignmentScore,
                           &closestSoftAlignmentScores,&closestSoftAlignmentSearchCosts]
         (const ScoredSearchNode& scoredNode) -> void {
     const SearchNode& node = scoredNode.node;
+    // Record the visit
+    // (a node is visited just before it is added to the history)
+    if (explored != NULL) {
+      explored->record(node, scoredNode.cost, historySize + fringeVisited.size());
+    }
     // Check the soft alignments
 #if MAX_FUZZY_MATCHES > 0
 //    if (node.truthState()) {  // matches in the negative context don't count
@@ -512,96 +944,110 @@ syn_search_response SynSearch(
 //    }
 #endif
     
-    if (node.truthState() && lookupFn(node.factHash())) {
+    if (node.truthState() && node.isKBHit()) {
 
       // Make sure nodes are unique
-      bool unique = true;
-      for (auto iter = matches.begin(); iter != matches.end(); ++iter) {
-        vector<SearchNode> path = iter->nodeSequence;
-        SearchNode otherEntry = path.front();
-        if (otherEntry.factHash() == node.factHash()) {
-          unique = false;
-        }
-      }
+      const bool unique = (matchedFacts.find(node.factHash()) == matchedFacts.end());
 
       // Make sure nodes are more than one word (this is degenerate)
-      uint8_t numWordsInPremise = 0;
-      for (uint8_t i = 0; i < input->length; ++i) {
-        if (!node.isDeleted(i)) {
-          numWordsInPremise += 1;
-        }
-      }
-      const bool degenerate = (numWordsInPremise < 2);
+      const bool degenerate = isDegenerateMatch(node, input->length);
 
       // Add the node
       if (unique && !degenerate) {
-        // Add this path to the result
-        // (get the complete path)
-        vector<SearchNode> path;
-        feature_vector myFeatures;
-        myFeatures.increment(node.incomingFeatures, assumedInitialTruth);
-        path.push_back(node);
-        if (node.getBackpointer() != 0) {
-          SearchNode head = node;
-          while (head.getBackpointer() != 0) {
-            head = history[head.getBackpointer()];
-            path.push_back(head);
-            myFeatures.increment(head.incomingFeatures, assumedInitialTruth ^ head.truthState());
-          }
-        }
-        // (add to the results list)
-        if (!opts.silent) {
-          printTime("[%c] "); 
-          fprintf(stderr, "  found premise: %s {hash: %lu; points to: %u}\n", 
-              kbGloss(*mutationGraph, *input, path).c_str(),
-              path.front().factHash(), path.front().getBackpointer());
-        }
-        matches.push_back(syn_search_path(path, scoredNode.cost));
-        featurizedPaths.push_back(myFeatures);
+        matchedFacts.insert(node.factHash());
+        matches.push_back(scoredNode);
+        matches.back().cost = matchCost(kb, node.factHash(), scoredNode.cost,
+                                        opts.factCountBonus);
       }
     }
   };
 
   // -- Run Search --
-  // Enqueue the first element
-  SearchNode start;
-  // (compute quantifiers)
-  if (!opts.silent) { printTime("[%c] "); }
-  if (input->getNumQuantifiers() > 0) {
-    // (case: there are quantifiers in the sentence)
-    start = SearchNode(*input, assumedInitialTruth, input->quantifierTokenIndex(0));
-    if (!opts.silent) {
-      fprintf(stderr, "  %u quantifier(s); starting on index %u\n", 
-          input->getNumQuantifiers(), input->quantifierTokenIndex(0));
+  // (compile the soft alignments against the input)
+  const AlignmentMatrix alignmentMatrix(*input, softAlignments);
+  if (resume) {
+    // Restore the search from the checkpoint
+    std::copy(checkpoint->history.begin(), checkpoint->history.end(), history);
+    historySize = checkpoint->history.size();
+    for (auto iter = checkpoint->fringe.begin(); iter != checkpoint->fringe.end(); ++iter) {
+      fringe->insert(iter->cost, iter->node);
     }
-  } else {
-    // (case: no quantifiers in sentence)
-    start = SearchNode(*input, assumedInitialTruth);
+    matches = checkpoint->matches;
+    for (auto iter = matches.begin(); iter != matches.end(); ++iter) {
+      matchedFacts.insert(iter->node.factHash());
+    }
+#if SEARCH_DOMINANCE_FILTER!=0
+    bestCosts.load(checkpoint->bestCosts);
+#endif
+    fullMemory.insert(checkpoint->memory.begin(), checkpoint->memory.end());
+    closestSoftAlignment = checkpoint->closestSoftAlignment;
+    closestSoftAlignmentScore = checkpoint->closestSoftAlignmentScore;
+    memcpy(closestSoftAlignmentScores, checkpoint->closestSoftAlignmentScores, MAX_FUZZY_MATCHES * sizeof(float));
+    memcpy(closestSoftAlignmentSearchCosts, checkpoint->closestSoftAlignmentSearchCosts, MAX_FUZZY_MATCHES * sizeof(float));
     if (!opts.silent) {
-      fprintf(stderr, "  no quantifiers; starting at root=%u\n", input->root());
+      printTime("[%c] ");
+      fprintf(stderr, "  resuming from checkpoint: ticks=%lu; fringe=%lu; matches=%lu\n",
+          checkpoint->ticks, checkpoint->fringe.size(), matches.size());
     }
-  }
-  // (compute fuzzy scores for soft alignment)
-#if MAX_FUZZY_MATCHES > 0
-  float fuzzyScores[MAX_FUZZY_MATCHES];
-  for (uint8_t i = 0; i < MAX_FUZZY_MATCHES; ++i) {
-    if (i < softAlignments.size()) {
-      fuzzyScores[i] = softAlignments[i].score(*input, assumedInitialTruth);
+  } else {
+    // Enqueue the first element
+    SearchNode start;
+    // (compute quantifiers)
+    if (!opts.silent) { printTime("[%c] "); }
+    if (input->getNumQuantifiers() > 0) {
+      // (case: there are quantifiers in the sentence)
+      start = SearchNode(*input, assumedInitialTruth, input->quantifierTokenIndex(0));
+      if (!opts.silent) {
+        fprintf(stderr, "  %u quantifier(s); starting on index %u\n", 
+            input->getNumQuantifiers(), input->quantifierTokenIndex(0));
+      }
     } else {
-      fuzzyScores[i] = -std::numeric_limits<float>::infinity();
+      // (case: no quantifiers in sentence)
+      start = SearchNode(*input, assumedInitialTruth);
+      if (!opts.silent) {
+        fprintf(stderr, "  no quantifiers; starting at root=%u\n", input->root());
+      }
     }
-  }
-  start.setFuzzyScores(fuzzyScores);
+    // (compute fuzzy scores for soft alignment)
+#if MAX_FUZZY_MATCHES > 0
+    float fuzzyScores[MAX_FUZZY_MATCHES];
+    alignmentMatrix.score(assumedInitialTruth, fuzzyScores);
+    start.setFuzzyScores(fuzzyScores);
+#endif
+    // (look up the node in the KB)
+    start.setKBHit(start.truthState() && lookupFn(start.factHash()));
+    // (add the node to the fringe)
+    fringe->insert(0.0f, start);
+#if SEARCH_DOMINANCE_FILTER!=0
+    bestCosts.improves(start, 0.0f);
 #endif
-  // (add the node to the fringe)
-  fringe->insert(0.0f, start);
 
-  // (to the history)
-  history[0] = start;
-  historySize += 1;
+    // (to the history)
+    history[0] = start;
+    historySize += 1;
+  }
 
   // Run Search
   response.totalTicks = searchLoop(
+#if SEARCH_DOMINANCE_FILTER!=0
+    // Insert to fringe, if the child is not dominated
+    [&fringe,&bestCosts,&numDominated](const ScoredSearchNode& elem) -> void { 
+      if (bestCosts.improves(elem.node, elem.cost)) {
+        fringe->insert(elem.cost, elem.node);
+      } else {
+        numDominated += 1;
+      }
+    },
+    // Pop from fringe, skipping nodes superseded by a cheaper push
+    [&fringe,&bestCosts](ScoredSearchNode* output) -> bool { 
+      do {
+        if (fringe->isEmpty()) { return false; }
+        if (fringe->getSize() > 10000000) { return false; }
+        fringe->deleteMin(&(output->cost), &(output->node));
+      } while (bestCosts.isStale(output->node, output->cost));
+      return true;
+    },
+#else
     // Insert to fringe
     [&fringe](const ScoredSearchNode& elem) -> void { 
       fringe->insert(elem.cost, elem.node);
@@ -613,31 +1059,151 @@ syn_search_response SynSearch(
       fringe->deleteMin(&(output->cost), &(output->node));
       return true;
     },
+#endif
     // Register visited
     registerVisited,
+    // Look up children
+    lookupChildren,
     // Other crap
-    history, historySize, costs, opts, 
-    softAlignments,
+    history, historySize, &fullMemory, costs, opts, 
+    alignmentMatrix,
     mutationGraph, *input
     );
+#if SEARCH_DOMINANCE_FILTER!=0
+  if (!opts.silent) {
+    printTime("[%c] ");
+    fprintf(stderr, "  dominance filter: %lu states; dropped %lu pushes\n",
+        bestCosts.size(), numDominated);
+  }
+#endif
+
+  // Save a checkpoint to resume the search from
+  // (this is taken before the fringe is checked, which does not change the
+  //  fringe, but does register the nodes it finds as visited)
+  if (checkpoint != NULL) {
+    checkpoint->key = queryKey;
+    checkpoint->ticks = response.totalTicks;
+    checkpoint->history.assign(history, history + historySize);
+    const uint32_t fringeSize = fringe->getSize();
+    KNElement<float,SearchNode>* fringeElements = (KNElement<float,SearchNode>*)
+      malloc(fringeSize * sizeof(KNElement<float,SearchNode>));
+    fringe->copyTo(fringeElements);
+    checkpoint->fringe.resize(fringeSize);
+    for (uint32_t i = 0; i < fringeSize; ++i) {
+      checkpoint->fringe[i].node = fringeElements[i].value;
+      checkpoint->fringe[i].cost = fringeElements[i].key;
+    }
+    free(fringeElements);
+    checkpoint->matches = matches;
+    checkpoint->bestCosts.clear();
+#if SEARCH_DOMINANCE_FILTER!=0
+    bestCosts.dump(&checkpoint->bestCosts);
+#endif
+    checkpoint->memory.assign(fullMemory.begin(), fullMemory.end());
+    checkpoint->closestSoftAlignment = closestSoftAlignment;
+    checkpoint->closestSoftAlignmentScore = closestSoftAlignmentScore;
+    memcpy(checkpoint->closestSoftAlignmentScores, closestSoftAlignmentScores, MAX_FUZZY_MATCHES * sizeof(float));
+    memcpy(checkpoint->closestSoftAlignmentSearchCosts, closestSoftAlignmentSearchCosts, MAX_FUZZY_MATCHES * sizeof(float));
+  }
 
   // Check the fringe for known facts
-  if (opts.checkFringe && response.paths.empty()) {
+  if (opts.checkFringe && matches.empty()) {
     if (!opts.silent) {
       printTime("[%c] ");
       fprintf(stderr, "  |Checking Fringe| size=%u\n", fringe->getSize());
     }
+    // (dump the fringe in bulk; only membership matters, so there is no
+    //  need to pop it in order)
+    const uint32_t fringeSize = fringe->getSize();
+    KNElement<float,SearchNode>* fringeElements = (KNElement<float,SearchNode>*)
+      malloc(fringeSize * sizeof(KNElement<float,SearchNode>));
+    fringe->copyTo(fringeElements);
+    // (find the nodes which would change the response when visited, in
+    //  parallel chunks. These are KB hits, and nodes which improve on the
+    //  best soft alignment found so far. The nodes' KB hit bits were set when
+    //  they were pushed, so this does not touch the KB)
+    auto isCandidate = [&](const KNElement<float,SearchNode>& elem) -> bool {
+      const SearchNode& node = elem.value;
+#if SEARCH_DOMINANCE_FILTER!=0
+      if (bestCosts.isStale(node, elem.key)) { return false; }
+#endif
+      if (node.truthState() && node.isKBHit()) { return true; }
+#if MAX_FUZZY_MATCHES > 0
+      for (uint8_t alignI = 0; alignI < MAX_FUZZY_MATCHES; ++alignI) {
+        if (node.softAlignmentScores()[alignI] > closestSoftAlignmentScores[alignI] + 1e-7) {
+          return true;
+        }
+      }
+#endif
+      return false;
+    };
+    uint32_t numThreads = fringeSize / FRINGE_CHECK_MIN_CHUNK + 1;
+    if (numThreads > thread::hardware_concurrency()) {
+      numThreads = thread::hardware_concurrency();
+    }
+    if (numThreads < 1) { numThreads = 1; }
+    const uint32_t chunkSize = fringeSize / numThreads + 1;
+    vector<uint32_t> candidates[numThreads];
+    auto findCandidates = [&](const uint32_t threadI) -> void {
+      const uint32_t end = min((threadI + 1) * chunkSize, fringeSize);
+      for (uint32_t i = threadI * chunkSize; i < end; ++i) {
+        if (isCandidate(fringeElements[i])) { candidates[threadI].push_back(i); }
+      }
+    };
+    if (numThreads == 1) {
+      findCandidates(0);
+    } else {
+      vector<thread> threads;
+      for (uint32_t threadI = 0; threadI < numThreads; ++threadI) {
+        threads.push_back(thread(findCandidates, threadI));
+      }
+      for (auto iter = threads.begin(); iter != threads.end(); ++iter) {
+        iter->join();
+      }
+    }
+    // (merge the candidates, and visit them in order of cost)
+    vector<uint32_t> merged;
+    for (uint32_t threadI = 0; threadI < numThreads; ++threadI) {
+      merged.insert(merged.end(), candidates[threadI].begin(), candidates[threadI].end());
+    }
+    std::sort(merged.begin(), merged.end(),
+        [fringeElements](const uint32_t& a, const uint32_t& b) -> bool {
+          return fringeElements[a].key < fringeElements[b].key;
+        });
     ScoredSearchNode* scoredNode = (ScoredSearchNode*) alloca(sizeof(ScoredSearchNode));
-    while(!fringe->isEmpty()) {
-      fringe->deleteMin(&(scoredNode->cost), &(scoredNode->node));
+    for (auto iter = merged.begin(); iter != merged.end(); ++iter) {
+      scoredNode->cost = fringeElements[*iter].key;
+      scoredNode->node = fringeElements[*iter].value;
       registerVisited(*scoredNode);
+      if (explored != NULL) { fringeVisited.push_back(scoredNode->node); }
     }
+    free(fringeElements);
     if (!opts.silent) {
       printTime("[%c] ");
-      fprintf(stderr, "    Done\n");
+      fprintf(stderr, "    Done (%lu candidates; %u threads)\n", merged.size(), numThreads);
     }
   }
 
+  // Materialize the paths of the cheapest matches
+  addPaths(matches, history, assumedInitialTruth, opts.maxResults, &response,
+      [&](const uint64_t& pathI) -> void {
+        if (!opts.silent) {
+          printTime("[%c] "); 
+          fprintf(stderr, "  found premise: %s {hash: %lu; points to: %u}\n", 
+              kbGloss(*mutationGraph, *input, response.nodeSequence(pathI)).c_str(),
+              response.front(pathI).factHash(), response.front(pathI).getBackpointer());
+        }
+      });
+
+  // Save the explored facts
+  if (explored != NULL) {
+    explored->history.assign(history, history + historySize);
+    explored->history.insert(explored->history.end(), fringeVisited.begin(), fringeVisited.end());
+    explored->assumedInitialTruth = assumedInitialTruth;
+    explored->queryLength = input->length;
+    explored->totalTicks = response.totalTicks;
+  }
+
   // Clean up
   free(history);
   delete fringe;
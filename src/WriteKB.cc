@@ -2,63 +2,90 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <string>
 
 using namespace std;
 
-#define CHUNK_SIZE 1048576
+/** The memory to sort facts in, if not given with -m */
+#define DEFAULT_MEMORY_MB 1024
+
+/**
+ * Add every hash in the given text to the sorter: a hash (a decimal uint64_t)
+ * at the start of each line, optionally followed by a tab and anything else;
+ * e.g., the sentence index HashCorpus writes.
+ *
+ * @return The number of lines read.
+ */
+uint64_t readHashes(FILE* input, ExternalFactSorter* sorter) {
+  char* line = NULL;
+  size_t capacity = 0;
+  uint64_t numLines = 0;
+  while (getline(&line, &capacity, input) >= 0) {
+    char* end;
+    const uint64_t hash = strtoul(line, &end, 10);
+    if (end == line) { continue; }  // (a blank line)
+    sorter->add(hash);
+    numLines += 1;
+  }
+  free(line);
+  return numLines;
+}
 
 /*
  * Reads a sequence of text lines representing hashed facts
- * (uint64_t values), and writes the corresponding values to a text file
- * in a way that can be read by readKB(string)
+ * (uint64_t values), and writes them as a sorted knowledge base, which can
+ * be memory mapped by readKB(string).
+ * The facts are read from each of the given files in turn -- e.g., the shards
+ * of a corpus hashed by parallel HashCorpus jobs -- or else from stdin. They
+ * are sorted in bounded memory, spilling sorted runs to disk next to the
+ * knowledge base, and the runs are merged as the knowledge base is written.
+ *
+ * Usage: write_kb [-m megabytes] [-j threads] filename [input ...]
  */
 int32_t main( int32_t argc, char *argv[] ) {
-  if (argc < 2) {
-    fprintf(stderr, "usage: write_kb filename\n");
-    exit(1);
+  uint64_t memoryMB = DEFAULT_MEMORY_MB;
+  uint32_t numThreads = 0;
+  int32_t argI = 1;
+  while (argI + 1 < argc && argv[argI][0] == '-' && argv[argI][1] != '\0') {
+    if (string(argv[argI]) == "-m") {
+      memoryMB = strtoul(argv[argI + 1], NULL, 10);
+    } else if (string(argv[argI]) == "-j") {
+      numThreads = strtoul(argv[argI + 1], NULL, 10);
+    } else {
+      break;
+    }
+    argI += 2;
   }
-
-  // Create output file
-  char* filename = argv[1];
-  FILE* file;
-  file = fopen(filename, "wb");
-  if (file == NULL) {
-    fprintf(stderr, "Can't open KB file for writing: %s!\n", filename);
+  if (argI >= argc) {
+    fprintf(stderr, "usage: write_kb [-m megabytes] [-j threads] filename [input ...]\n");
     exit(1);
   }
+  char* filename = argv[argI];
+  argI += 1;
 
-  // Read from stdin, write to buffer
-  char line[256];
-  uint64_t* buffer = (uint64_t*) malloc(CHUNK_SIZE * sizeof(uint64_t));
-  uint64_t index = 0;
-  memset(line, 0, sizeof(line));
-  while (!cin.fail()) {
-    // Parse the line
-    cin.getline(line, 255);
-    if (line[0] == '\0') { continue; }
-    // Convert the line to an integer
-    const uint64_t hash = strtoul(line, NULL, 10);
-    buffer[index] = hash;
-    index += 1;
-    // Optionally write the chunk
-    if (index == CHUNK_SIZE) {
-      fwrite(buffer, CHUNK_SIZE * sizeof(uint64_t), 1, file);
-      index = 0;
+  // Read the facts
+  ExternalFactSorter sorter(string(filename), memoryMB * 1024 * 1024, numThreads);
+  if (argI >= argc) {
+    readHashes(stdin, &sorter);
+  }
+  for (; argI < argc; ++argI) {
+    FILE* input = string(argv[argI]) == "-" ? stdin : fopen(argv[argI], "r");
+    if (input == NULL) {
+      fprintf(stderr, "Can't read input file: %s!\n", argv[argI]);
+      exit(1);
     }
+    const uint64_t numLines = readHashes(input, &sorter);
+    fprintf(stderr, "Read %lu facts from %s\n", numLines, argv[argI]);
+    if (input != stdin) { fclose(input); }
   }
 
-  // Write the last few facts
-  fwrite(buffer, sizeof(uint64_t), index, file);
-  fclose(file);
-
-  // Re-read the knowledge base, printing out the values
-//  fprintf(stderr, "Re-reading file\n");
-//  const btree::btree_set<uint64_t> kb = readKB(filename);
-//  for ( auto iter = kb.begin(); iter != kb.end(); ++iter ) {
-//    fprintf(stderr, "contains: %lu\n", *iter);
-//  }
-//  fprintf(stderr, "DONE\n");
-
+  // Write the knowledge base
+  uint64_t numFacts = 0;
+  if (!sorter.write(filename, &numFacts)) {
+    fprintf(stderr, "Can't write KB file: %s!\n", filename);
+    exit(1);
+  }
+  fprintf(stderr, "Wrote %lu facts (%lu distinct; merged from %lu runs) to %s\n",
+          sorter.size(), numFacts, sorter.numRuns(), filename);
 }
-
-
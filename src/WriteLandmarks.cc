@@ -0,0 +1,46 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "Graph.h"
+#include "LandmarkOracle.h"
+#include "Utils.h"
+
+using namespace std;
+
+/**
+ * The default number of landmarks; each costs 8 bytes per word in the
+ * vocabulary.
+ */
+#define DEFAULT_NUM_LANDMARKS 16
+
+/*
+ * Reads the mutation graph, and writes a table of the costs between every
+ * word and a number of landmark words, to be read by ReadLandmarks() (see
+ * LANDMARK_FILE).
+ */
+int32_t main( int32_t argc, char *argv[] ) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: write_landmarks filename [num_landmarks]\n");
+    exit(1);
+  }
+  const uint32_t numLandmarks = argc > 2 ? atoi(argv[2]) : DEFAULT_NUM_LANDMARKS;
+
+  // Read the graph, with its outgoing edges
+  BidirectionalGraph graph(ReadGraph());
+
+  // Build the table
+  printTime("[%c] ");
+  fprintf(stderr, "Choosing %u landmarks over %lu words...\n",
+          numLandmarks, graph.vocabSize());
+  LandmarkOracle* oracle = LandmarkOracle::build(graph, numLandmarks);
+
+  // Write the table
+  if (!oracle->writeTo(argv[1])) {
+    fprintf(stderr, "Can't write landmark file: %s!\n", argv[1]);
+    exit(1);
+  }
+  printTime("[%c] ");
+  fprintf(stderr, "Wrote %u landmarks to %s\n", oracle->numLandmarks(), argv[1]);
+  delete oracle;
+  return 0;
+}
@@ -33,8 +33,10 @@ public class HashCorpus {
   @ArgumentParser.Option(name="offset", gloss="The index of this job, in [0, mod)")
   private static int offset = 0;
 
-  @ArgumentParser.Option(name="out.hashes", gloss="The file to write the hashed facts to", required=true)
+  @ArgumentParser.Option(name="out.hashes", gloss="The file to write the hashed facts to; required unless out.trees is set")
   private static PrintStream hashOutput = null;
+  @ArgumentParser.Option(name="out.trees", gloss="If set, write the entailed trees here as a CoNLL stream, to be hashed in bulk with `hash_tree -b`, rather than hashing them one at a time")
+  private static PrintStream treeOutput = null;
   @ArgumentParser.Option(name="out.sentences", gloss="The file to write the indexed sentences to", required=true)
   private static PrintStream sentenceOutput = null;
 
@@ -85,6 +87,9 @@ public class HashCorpus {
 
   public static void main(String[] args) throws IOException {
     ArgumentParser.fillOptions(new Class[]{HashCorpus.class, StaticResources.class}, args);
+    if (hashOutput == null && treeOutput == null) {
+      throw new IllegalArgumentException("Either out.hashes or out.trees must be set");
+    }
 
     StanfordCoreNLP pipeline = ProcessPremise.constructPipeline("depparse");
 
@@ -104,10 +109,20 @@ public class HashCorpus {
       // Write the sentence info
       sentenceOutput.println(sentenceIndex + "\t" + line.replace("\t", " "));
 
-      // Write hash(es)
+      // Write hash(es), or the trees to hash in bulk
       try {
         Set<BigInteger> hashes = new HashSet<>();
+        Set<String> dumps = new HashSet<>();
         for (SentenceFragment entailment : ProcessPremise.forwardEntailments(line, pipeline)) {
+          if (treeOutput != null) {
+            // (the sentence index marks the trees of a sentence, so that `hash_tree -b`
+            //  keeps each hash once per sentence, as the hashes set does below)
+            String dump = ProcessQuery.conllDump(entailment.parseTree, false, false);
+            if (!dump.trim().equals("") && dumps.add(dump)) {
+              treeOutput.print("# " + sentenceIndex + "\n" + dump + "\n\n");
+            }
+            continue;
+          }
           BigInteger hash = hashEntailment(entailment.parseTree);
           if (hash.compareTo(new BigInteger("0")) > 0) {
             hashes.add(hash);
@@ -133,6 +148,7 @@ public class HashCorpus {
     }
 
     sentenceOutput.close();
-    hashOutput.close();
+    if (hashOutput != null) { hashOutput.close(); }
+    if (treeOutput != null) { treeOutput.close(); }
   }
 }
@@ -51,6 +51,7 @@ public:
   void  insert(Key k, Value v);
   void  sortTo(Element *to); // sort in increasing order and empty
   //void  sortInPlace(); // in decreasing order
+  int   copyTo(Element *to) const; // copy (unsorted) and keep
 };
 
 
@@ -175,6 +176,16 @@ insert(Key k, Value v)
   data[hole].value = v;
 }
 
+// copy all elements to "to", in no particular order, without changing
+// the heap; return the number of elements copied
+template <class Key, class Value, int capacity>
+inline int BinaryHeap<Key, Value, capacity>::
+copyTo(Element *to) const
+{
+  memcpy(to, data + 1, size * sizeof(Element));
+  return size;
+}
+
 //////////////////////////////////////////////////////////////////////
 // The data structure from Knuth, "Sorting and Searching", Section 5.4.1
 template <class Key, class Value>
@@ -237,6 +248,7 @@ public:
   void insertSegment(Element *to, int sz); // insert segment beginning at to
   int  getSize() { return size; }
   Key getSupremum() { return dummy.key; }
+  int  copyTo(Element *to) const; // copy (unsorted) and keep
 };  
 
 
@@ -284,6 +296,7 @@ public:
   void  getMin(Key *key, Value *value);
   void  deleteMin(Key *key, Value *value);
   void  insert(Key key, Value value);
+  void  copyTo(KNElement<Key, Value> *to) const; // copy (unsorted) and keep
 };
 
 template <class Key, class Value>
@@ -310,6 +323,27 @@ inline int KNHeap<Key, Value>::getSize() const
     ((buffer1 + KNBufferSize1) - minBuffer1); 
 }
 
+// copy all elements to "to", which must have room for getSize() elements,
+// in no particular order and without changing the heap
+template <class Key, class Value>
+void KNHeap<Key, Value>::copyTo(KNElement<Key, Value> *to) const
+{
+  Element *pos = to;
+  // buffer1 and the insert heap
+  const int sz1 = getSize1();
+  memcpy(pos, minBuffer1, sz1 * sizeof(Element));
+  pos += sz1;
+  pos += insertHeap.copyTo(pos);
+  // the delete buffers and trees of every level
+  for (int i = 0;  i < KNLevels;  i++) {
+    const int sz2 = getSize2(i);
+    memcpy(pos, minBuffer2[i], sz2 * sizeof(Element));
+    pos += sz2;
+    pos += tree[i].copyTo(pos);
+  }
+  assert(pos - to == getSize());
+}
+
 template <class Key, class Value>
 inline void  KNHeap<Key, Value>::getMin(Key *key, Value *value) {
   Key key1 = minBuffer1->key;
@@ -564,6 +598,26 @@ insertSegment(Element *to, int sz)
 }
 
 
+// copy all elements to "to", in no particular order, without changing
+// the tree; return the number of elements copied
+// (every segment is sentinel terminated, and empty segments point to dummy)
+template <class Key, class Value>
+int KNLooserTree<Key, Value>::
+copyTo(Element *to) const
+{
+  const Key sup = dummy.key;
+  Element *pos = to;
+  for (int i = 0;  i < k;  i++) {
+    for (const Element *e = current[i];  e->key != sup;  e++) {
+      *pos = *e;
+      pos++;
+    }
+  }
+  assert(pos - to == size);
+  return pos - to;
+}
+
+
 // free an empty segment
 template <class Key, class Value>
 void KNLooserTree<Key, Value>::
@@ -1,13 +1,44 @@
 #include <limits.h>
+#include <algorithm>
 #include <bitset>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "gtest/gtest.h"
 
 #include "FactDB.h"
+#include "btree_map.h"
 
 using namespace std;
 using namespace btree;
 
+/**
+ * A fixture for tests which write a knowledge base (or a log) to a
+ * temporary file. The file, and any files derived from its name, are
+ * removed after the test.
+ */
+class FactDBFileTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    strcpy(path, "/tmp/naturalli_kbXXXXXX");
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+  }
+
+  virtual void TearDown() {
+    unlink(path);
+    unlink((string(path) + ".merged").c_str());
+    unlink((string(path) + ".log").c_str());
+    unlink((string(path) + ".log.merged").c_str());
+  }
+
+  char path[32];
+};
+
 //
 // Read From Memory
 //
@@ -22,3 +53,513 @@ TEST(FactDBTest, ReadFromIntStream) {
   EXPECT_FALSE(kb->find(45l) != kb->end());
   delete kb;
 }
+
+//
+// Wrap an in-memory set
+//
+TEST(FactDBTest, BTreeFactDB) {
+  btree_set<uint64_t> facts;
+  facts.insert(42l);
+  const BTreeFactDB kb(&facts, false);
+  EXPECT_EQ(1, kb.size());
+  EXPECT_FALSE(kb.empty());
+  EXPECT_TRUE(kb.contains(42l));
+  EXPECT_FALSE(kb.contains(43l));
+}
+
+//
+// Write a sorted KB, and map it back in
+//
+TEST_F(FactDBFileTest, WriteAndMapSortedKB) {
+  vector<uint64_t> facts = { 44l, 42l, 0xFFFFFFFFFFFFFFFFl, 42l, 7l };
+  ASSERT_TRUE(writeSortedKB(&facts, path));
+  EXPECT_EQ(4, facts.size());  // (deduplicated)
+  MappedFactDB* kb = MappedFactDB::open(path);
+  ASSERT_FALSE(kb == NULL);
+  EXPECT_EQ(4, kb->size());
+  EXPECT_TRUE(kb->verify());
+  EXPECT_TRUE(kb->contains(7l));
+  EXPECT_TRUE(kb->contains(42l));
+  EXPECT_TRUE(kb->contains(44l));
+  EXPECT_TRUE(kb->contains(0xFFFFFFFFFFFFFFFFl));
+  EXPECT_FALSE(kb->contains(0l));
+  EXPECT_FALSE(kb->contains(43l));
+  EXPECT_FALSE(kb->contains(45l));
+  for (uint64_t i = 1; i < kb->size(); ++i) {
+    EXPECT_LT(kb->facts()[i - 1], kb->facts()[i]);
+  }
+  delete kb;
+  // (readKB maps it too)
+  const FactDB* read = readKB(string(path));
+  EXPECT_EQ(4, read->size());
+  EXPECT_TRUE(read->contains(42l));
+  delete read;
+  // (a truncated KB can't be mapped)
+  ASSERT_EQ(0, truncate(path, sizeof(kb_header) + 8));
+  EXPECT_TRUE(MappedFactDB::open(path) == NULL);
+}
+
+//
+// An empty sorted KB
+//
+TEST_F(FactDBFileTest, WriteAndMapEmptyKB) {
+  vector<uint64_t> facts;
+  ASSERT_TRUE(writeSortedKB(&facts, path));
+  MappedFactDB* kb = MappedFactDB::open(path);
+  ASSERT_FALSE(kb == NULL);
+  EXPECT_TRUE(kb->empty());
+  EXPECT_FALSE(kb->contains(42l));
+  delete kb;
+}
+
+//
+// Read the raw (unsorted) KB format
+//
+TEST_F(FactDBFileTest, ReadRawKB) {
+  const uint64_t stream[] = { 44l, 42l, 43l };
+  FILE* file = fopen(path, "w");
+  ASSERT_FALSE(file == NULL);
+  ASSERT_EQ(3, fwrite(stream, sizeof(uint64_t), 3, file));
+  fclose(file);
+  const FactDB* kb = readKB(string(path));
+  EXPECT_EQ(3, kb->size());
+  EXPECT_TRUE(kb->contains(43l));
+  EXPECT_FALSE(kb->contains(45l));
+  delete kb;
+}
+
+//
+// The number of times each fact was seen, and dropping rare facts
+//
+TEST_F(FactDBFileTest, FactCounts) {
+  vector<uint64_t> facts = { 44l, 42l, 7l, 42l, 44l, 42l };
+  ASSERT_TRUE(writeSortedKB(&facts, path));
+  // (every fact)
+  MappedFactDB* kb = MappedFactDB::open(path);
+  ASSERT_FALSE(kb == NULL);
+  EXPECT_TRUE(kb->verify());
+  EXPECT_TRUE(kb->hasCounts());
+  EXPECT_EQ(3, kb->size());
+  EXPECT_EQ(1, kb->count(7l));
+  EXPECT_EQ(3, kb->count(42l));
+  EXPECT_EQ(2, kb->count(44l));
+  EXPECT_EQ(0, kb->count(43l));
+  delete kb;
+  // (facts seen at least twice)
+  kb = MappedFactDB::open(path, 2);
+  ASSERT_FALSE(kb == NULL);
+  EXPECT_EQ(2, kb->size());
+  EXPECT_EQ(1, kb->numDropped());
+  EXPECT_FALSE(kb->contains(7l));
+  EXPECT_EQ(0, kb->count(7l));
+  EXPECT_TRUE(kb->contains(42l));
+  EXPECT_TRUE(kb->contains(44l));
+  uint64_t numVisited = 0;
+  kb->forEach([&numVisited](const uint64_t& fact) -> void {
+    EXPECT_NE(7l, fact);
+    numVisited += 1;
+  });
+  EXPECT_EQ(2, numVisited);
+  delete kb;
+  const FactDB* read = readKB(string(path), 3);
+  EXPECT_EQ(1, read->size());
+  EXPECT_TRUE(read->contains(42l));
+  EXPECT_FALSE(read->contains(44l));
+  delete read;
+  // (a raw KB counts each occurrence of a fact)
+  const uint64_t stream[] = { 44l, 42l, 43l, 42l };
+  FILE* file = fopen(path, "wb");
+  ASSERT_EQ(4, fwrite(stream, sizeof(uint64_t), 4, file));
+  fclose(file);
+  read = readKB(string(path), 2);
+  EXPECT_EQ(1, read->size());
+  EXPECT_TRUE(read->contains(42l));
+  EXPECT_FALSE(read->contains(43l));
+  delete read;
+}
+
+//
+// A KB with only a filter in memory, verified against the file
+//
+TEST_F(FactDBFileTest, TieredKB) {
+  vector<uint64_t> facts;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 5000; ++i) {  // (ten pages)
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    facts.push_back(value);
+  }
+  ASSERT_TRUE(writeSortedKB(&facts, path));
+  const TieredFactDB kb(MappedFactDB::open(path), 10);
+  EXPECT_EQ(facts.size(), kb.size());
+  EXPECT_LT(kb.residentBytes(), facts.size() * 2);
+  kb_lookup_stats stats;
+  for (uint64_t i = 0; i < facts.size(); ++i) {
+    EXPECT_TRUE(kb.lookup(facts[i], &stats)) << "fact=" << facts[i];
+    EXPECT_FALSE(kb.contains(facts[i] + 1));
+    EXPECT_FALSE(kb.contains(facts[i] - 1));
+  }
+  EXPECT_FALSE(kb.contains(0l));
+  EXPECT_FALSE(kb.contains(0xFFFFFFFFFFFFFFFFl));
+  // (every fact is verified on disk; most others never get that far)
+  EXPECT_EQ(facts.size(), stats.lookups);
+  EXPECT_EQ(facts.size(), stats.diskVerifications);
+  for (uint64_t i = 0; i < facts.size(); ++i) {
+    EXPECT_FALSE(kb.lookup(facts[i] ^ 0x5555l, &stats));
+  }
+  EXPECT_EQ(2 * facts.size(), stats.lookups);
+  EXPECT_EQ(stats.filterHits, stats.diskVerifications);
+  EXPECT_LT(stats.diskVerifications, facts.size() + facts.size() / 20);
+}
+
+//
+// Add facts to a KB, and merge them in
+//
+TEST_F(FactDBFileTest, MutableKB) {
+  btree_set<uint64_t>* base = new btree_set<uint64_t>();
+  base->insert(42l);
+  MutableFactDB* kb = new MutableFactDB(new BTreeFactDB(base, true), path, 1000);
+  EXPECT_EQ(1, kb->size());
+  const shared_ptr<const FactDB> before = kb->snapshot();
+  // (added facts are seen right away, but not by an earlier snapshot)
+  EXPECT_EQ(2, kb->add({ 42l, 43l, 44l, 43l }));
+  EXPECT_TRUE(kb->contains(42l));
+  EXPECT_TRUE(kb->contains(43l));
+  EXPECT_TRUE(kb->contains(44l));
+  EXPECT_FALSE(kb->contains(45l));
+  EXPECT_EQ(3, kb->size());
+  EXPECT_EQ(2, kb->deltaSize());
+  EXPECT_FALSE(before->contains(43l));
+  EXPECT_EQ(1, before->size());
+  // (merging keeps every fact)
+  kb->merge();
+  EXPECT_EQ(1, kb->numMerges());
+  EXPECT_EQ(0, kb->deltaSize());
+  EXPECT_EQ(3, kb->size());
+  EXPECT_TRUE(kb->contains(43l));
+  EXPECT_FALSE(before->contains(43l));
+  EXPECT_EQ(0, kb->add({ 43l }));
+  EXPECT_EQ(1, kb->add({ 45l }));
+  delete kb;
+  // (the log was cut down to the facts added since the merge)
+  struct stat info;
+  ASSERT_EQ(0, stat(path, &info));
+  EXPECT_EQ(sizeof(uint64_t), info.st_size);
+  // (the merge is reopened in place of the base, and the log is replayed)
+  kb = new MutableFactDB(new BTreeFactDB(new btree_set<uint64_t>(), true), path, 1000);
+  EXPECT_EQ(4, kb->size());
+  EXPECT_EQ(1, kb->deltaSize());
+  EXPECT_TRUE(kb->contains(42l));
+  EXPECT_TRUE(kb->contains(43l));
+  EXPECT_TRUE(kb->contains(44l));
+  EXPECT_TRUE(kb->contains(45l));
+  delete kb;
+}
+
+//
+// Add facts one at a time, each seen by the snapshots after it
+//
+TEST_F(FactDBFileTest, MutableKBLayers) {
+  MutableFactDB* kb = new MutableFactDB(new BTreeFactDB(new btree_set<uint64_t>(), true), path, 100000);
+  vector<shared_ptr<const FactDB> > snapshots;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(1, kb->add({ 1000 - i }));
+    if (i % 100 == 0) { snapshots.push_back(kb->snapshot()); }
+  }
+  EXPECT_EQ(1000, kb->deltaSize());
+  EXPECT_EQ(1000, kb->size());
+  for (uint64_t i = 1; i <= 1000; ++i) { EXPECT_TRUE(kb->contains(i)); }
+  EXPECT_FALSE(kb->contains(0l));
+  EXPECT_FALSE(kb->contains(1001l));
+  // (the facts are walked in order, across the layers)
+  uint64_t last = 0;
+  kb->snapshot()->forEachSorted([&last](const uint64_t& fact, const uint32_t& count) -> void {
+    EXPECT_EQ(last + 1, fact);
+    last = fact;
+  });
+  EXPECT_EQ(1000, last);
+  // (an earlier snapshot is never changed)
+  for (uint64_t s = 0; s < snapshots.size(); ++s) {
+    EXPECT_EQ(s * 100 + 1, snapshots[s]->size());
+    EXPECT_TRUE(snapshots[s]->contains(1000 - s * 100));
+    EXPECT_FALSE(snapshots[s]->contains(1000 - s * 100 - 1));
+  }
+  delete kb;
+}
+
+//
+// Merge added facts into a sorted KB, keeping its counts
+//
+TEST_F(FactDBFileTest, MutableKBMergeKeepsCounts) {
+  const string logPath = string(path) + ".log";
+  vector<uint64_t> facts = { 44l, 42l, 7l, 42l, 44l, 42l };
+  ASSERT_TRUE(writeSortedKB(&facts, path));
+  MutableFactDB* kb = new MutableFactDB(MappedFactDB::open(path), logPath.c_str(), 1000);
+  EXPECT_EQ(2, kb->add({ 43l, 50l }));
+  kb->merge();
+  EXPECT_EQ(1, kb->numMerges());
+  EXPECT_EQ(5, kb->size());
+  EXPECT_TRUE(kb->contains(43l));
+  EXPECT_TRUE(kb->contains(50l));
+  delete kb;
+  // (the merged KB is a sorted KB, with the base's counts)
+  MappedFactDB* merged = MappedFactDB::open((logPath + ".merged").c_str());
+  ASSERT_FALSE(merged == NULL);
+  EXPECT_TRUE(merged->verify());
+  EXPECT_TRUE(merged->hasCounts());
+  EXPECT_EQ(5, merged->size());
+  EXPECT_EQ(1, merged->count(7l));
+  EXPECT_EQ(3, merged->count(42l));
+  EXPECT_EQ(1, merged->count(43l));
+  EXPECT_EQ(2, merged->count(44l));
+  EXPECT_EQ(1, merged->count(50l));
+  delete merged;
+  EXPECT_NE(0, access((logPath + ".merged.tmp").c_str(), F_OK));
+}
+
+//
+// Merge in the background, while adding facts
+//
+TEST_F(FactDBFileTest, MutableKBBackgroundMerge) {
+  MutableFactDB* kb = new MutableFactDB(new BTreeFactDB(new btree_set<uint64_t>(), true), path, 100);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(1, kb->add({ i * 7 }));
+  }
+  for (uint32_t wait = 0; wait < 100 && kb->numMerges() == 0; ++wait) {
+    usleep(10000);
+  }
+  EXPECT_LT(0, kb->numMerges());
+  EXPECT_EQ(1000, kb->size());
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(kb->contains(i * 7));
+    EXPECT_FALSE(kb->contains(i * 7 + 1));
+  }
+  delete kb;
+}
+
+//
+// Sort more facts than fit in memory into a KB
+//
+TEST_F(FactDBFileTest, ExternalSortKB) {
+  vector<uint64_t> expected;
+  btree_map<uint64_t,uint32_t> counts;
+  uint64_t numFacts = 0;
+  {
+    ExternalFactSorter sorter(string(path), 1000 * sizeof(uint64_t), 2);
+    uint64_t value = 0x9E3779B97F4A7C15l;
+    for (uint64_t i = 0; i < 10000; ++i) {
+      value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+      const uint64_t fact = i % 3 == 0 ? value : value % 1000;  // (duplicates)
+      sorter.add(fact);
+      expected.push_back(fact);
+      counts[fact] += 1;
+    }
+    EXPECT_LT(10, sorter.numRuns());
+    ASSERT_TRUE(sorter.write(path, &numFacts));
+    EXPECT_EQ(10000, sorter.size());
+  }
+  std::sort(expected.begin(), expected.end());
+  expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+  EXPECT_EQ(expected.size(), numFacts);
+  MappedFactDB* kb = MappedFactDB::open(path);
+  ASSERT_FALSE(kb == NULL);
+  EXPECT_TRUE(kb->verify());
+  ASSERT_EQ(expected.size(), kb->size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), kb->facts()));
+  // (the counts are summed across runs)
+  for (uint64_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(counts[expected[i]], kb->countAt(i));
+  }
+  delete kb;
+  // (facts must be written in order)
+  KBWriter* writer = KBWriter::open(path);
+  EXPECT_TRUE(writer->add(42l));
+  EXPECT_TRUE(writer->add(42l));
+  EXPECT_FALSE(writer->add(41l));
+  EXPECT_EQ(1, writer->size());
+  EXPECT_TRUE(writer->close());
+  delete writer;
+}
+
+//
+// Sort facts in parallel, and build a btree from them
+//
+TEST(FactDBTest, SortAndBulkBuild) {
+  vector<uint64_t> facts;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 300000; ++i) {
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    facts.push_back(value % 100000);  // (plenty of duplicates)
+  }
+  vector<uint64_t> expected(facts);
+  std::sort(expected.begin(), expected.end());
+  expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+  const uint32_t numThreads[] = { 1, 2, 3, 8 };
+  for (uint32_t i = 0; i < 4; ++i) {
+    vector<uint64_t> sorted(facts);
+    sortUniqueFacts(&sorted, numThreads[i]);
+    EXPECT_TRUE(sorted == expected) << "threads=" << numThreads[i];
+  }
+  btree_set<uint64_t>* kb = bulkBuildKB(expected);
+  EXPECT_EQ(expected.size(), kb->size());
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), kb->begin()));
+  // (appending in order leaves the nodes nearly full)
+  EXPECT_GT(kb->fullness(), 0.9);
+  delete kb;
+}
+
+//
+// Every layout of a static KB agrees with a set
+//
+TEST(FactDBTest, StaticLayoutsAgree) {
+  // (uniform facts, and clustered ones, which interpolation guesses badly)
+  vector<uint64_t> uniform;
+  vector<uint64_t> clustered;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    uniform.push_back(value);
+    clustered.push_back(i < 990 ? i * 3 : 0xFFFFFFFFFFFFFF00l + i - 990);
+  }
+  std::sort(uniform.begin(), uniform.end());
+  vector<uint64_t> queries(uniform);
+  queries.insert(queries.end(), clustered.begin(), clustered.end());
+  for (uint64_t i = 0; i < 1000; ++i) {
+    queries.push_back(uniform[i] + 1);
+    queries.push_back(i * 3 + 1);
+  }
+  queries.push_back(0l);
+  queries.push_back(0xFFFFFFFFFFFFFFFFl);
+  const kb_layout layouts[] = { KB_LAYOUT_SORTED, KB_LAYOUT_INTERPOLATION, KB_LAYOUT_EYTZINGER };
+  for (uint32_t layoutI = 0; layoutI < 3; ++layoutI) {
+    for (uint32_t count = 0; count <= 1000; count = count * 2 + 1) {
+      for (uint32_t dataI = 0; dataI < 2; ++dataI) {
+        const vector<uint64_t>& facts = dataI == 0 ? uniform : clustered;
+        const StaticFactDB kb(facts.data(), count, layouts[layoutI]);
+        EXPECT_EQ(count, kb.size());
+        for (auto query = queries.begin(); query != queries.end(); ++query) {
+          EXPECT_EQ(std::binary_search(facts.begin(), facts.begin() + count, *query),
+                    kb.contains(*query))
+            << "layout=" << layoutI << " count=" << count << " fact=" << *query;
+        }
+      }
+    }
+  }
+}
+
+//
+// An Elias-Fano compressed KB agrees with a set
+//
+TEST(FactDBTest, EliasFano) {
+  vector<uint64_t> uniform;
+  vector<uint64_t> clustered;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 5000; ++i) {
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    uniform.push_back(value);
+    clustered.push_back(i < 4990 ? i * 3 : 0xFFFFFFFFFFFFFF00l + i - 4990);
+  }
+  std::sort(uniform.begin(), uniform.end());
+  vector<uint64_t> queries(uniform);
+  queries.insert(queries.end(), clustered.begin(), clustered.end());
+  for (uint64_t i = 0; i < 5000; ++i) {
+    queries.push_back(uniform[i] + 1);
+    queries.push_back(uniform[i] - 1);
+    queries.push_back(i * 3 + 1);
+  }
+  queries.push_back(0l);
+  queries.push_back(0xFFFFFFFFFFFFFFFFl);
+  for (uint32_t count = 0; count <= 5000; count = count * 2 + 1) {
+    for (uint32_t dataI = 0; dataI < 2; ++dataI) {
+      const vector<uint64_t>& facts = dataI == 0 ? uniform : clustered;
+      const EliasFanoFactDB kb(facts.data(), count);
+      EXPECT_EQ(count, kb.size());
+      for (auto query = queries.begin(); query != queries.end(); ++query) {
+        EXPECT_EQ(std::binary_search(facts.begin(), facts.begin() + count, *query),
+                  kb.contains(*query))
+          << "count=" << count << " fact=" << *query;
+      }
+      vector<uint64_t> decoded;
+      kb.forEach([&decoded](const uint64_t& fact) -> void { decoded.push_back(fact); });
+      EXPECT_TRUE(std::equal(facts.begin(), facts.begin() + count, decoded.begin()));
+      EXPECT_EQ(count, decoded.size());
+    }
+  }
+  // (compressed)
+  const EliasFanoFactDB kb(uniform.data(), uniform.size());
+  EXPECT_LT(kb.bytesUsed(), uniform.size() * 7);
+}
+
+//
+// A Bloom filter in front of a KB
+//
+TEST(FactDBTest, BloomFilter) {
+  btree_set<uint64_t> facts;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    facts.insert(value);
+  }
+  const BloomFactDB kb(new BTreeFactDB(&facts, false), true, 10);
+  EXPECT_EQ(facts.size(), kb.size());
+  EXPECT_EQ((facts.size() * 10 + 511) / 512, kb.numBlocks());
+  // (no false negatives)
+  for (auto iter = facts.begin(); iter != facts.end(); ++iter) {
+    EXPECT_TRUE(kb.mayContain(*iter));
+    EXPECT_TRUE(kb.contains(*iter));
+  }
+  // (few false positives, and those are caught by the KB)
+  const double falsePositiveRate = kb.falsePositiveRate(100000);
+  EXPECT_GT(falsePositiveRate, 0.0);
+  EXPECT_LT(falsePositiveRate, 0.03);
+  EXPECT_FALSE(kb.contains(42l));
+  // (every fact is still there)
+  uint64_t count = 0;
+  kb.forEach([&count](const uint64_t& fact) -> void { count += 1; });
+  EXPECT_EQ(facts.size(), count);
+}
+
+//
+// Looking facts up in a batch agrees with looking them up one at a time
+//
+TEST(FactDBTest, LookupBatchAgrees) {
+  vector<uint64_t> facts;
+  uint64_t value = 0x9E3779B97F4A7C15l;
+  for (uint64_t i = 0; i < 2000; ++i) {
+    value ^= value << 13; value ^= value >> 7; value ^= value << 17;
+    facts.push_back(value);
+  }
+  std::sort(facts.begin(), facts.end());
+  // (half the queries are in the KB; more than a batch of them)
+  vector<uint64_t> queries;
+  for (uint64_t i = 0; i < 300; ++i) {
+    queries.push_back(facts[i * 5]);
+    queries.push_back(facts[i * 5] + 1);
+  }
+  queries.push_back(0l);
+  queries.push_back(0xFFFFFFFFFFFFFFFFl);
+  std::sort(queries.begin(), queries.end());
+  queries.erase(std::unique(queries.begin(), queries.end()), queries.end());
+  btree_set<uint64_t> set(facts.begin(), facts.begin() + 1000);
+  std::shared_ptr<btree_set<uint64_t> > delta(
+      new btree_set<uint64_t>(facts.begin() + 1000, facts.end()));
+  const StaticFactDB sorted(facts.data(), facts.size(), KB_LAYOUT_SORTED);
+  const StaticFactDB interpolation(facts.data(), facts.size(), KB_LAYOUT_INTERPOLATION);
+  const StaticFactDB eytzinger(facts.data(), facts.size(), KB_LAYOUT_EYTZINGER);
+  const StaticFactDB empty(facts.data(), 0, KB_LAYOUT_EYTZINGER);
+  const EliasFanoFactDB eliasFano(facts.data(), facts.size());
+  const BloomFactDB bloom(new EliasFanoFactDB(facts.data(), facts.size()), true, 10);
+  const DeltaFactDB withDelta(
+      std::shared_ptr<const FactDB>(new BTreeFactDB(&set, false)), delta);
+  const FactDB* kbs[] = { &sorted, &interpolation, &eytzinger, &empty,
+                          &eliasFano, &bloom, &withDelta };
+  for (uint32_t kbI = 0; kbI < 7; ++kbI) {
+    bool found[queries.size()];
+    kb_lookup_stats stats;
+    kbs[kbI]->lookupBatch(queries.data(), queries.size(), found, &stats);
+    for (uint32_t i = 0; i < queries.size(); ++i) {
+      EXPECT_EQ(kbs[kbI]->contains(queries[i]), found[i])
+        << "kb=" << kbI << " fact=" << queries[i];
+    }
+    EXPECT_EQ(queries.size(), stats.lookups) << "kb=" << kbI;
+  }
+}
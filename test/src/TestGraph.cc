@@ -75,3 +75,20 @@ TEST_F(MockGraphTest, CheckInvalidDeletions) {
   e.source_sense = 4;
   EXPECT_TRUE(mockGraph->containsDeletion(e));
 }
+
+// Check the outgoing edges of a bidirectional graph
+TEST_F(MockGraphTest, BidirectionalOutgoingEdges) {
+  BidirectionalGraph bidirectional(mockGraph);
+  mockGraph = NULL;  // owned by the bidirectional graph
+  uint32_t numEdges;
+  const edge* edges = bidirectional.outgoingEdgesFast(ANIMAL.word, &numEdges);
+  ASSERT_EQ(1, numEdges);
+  EXPECT_EQ(ANIMAL.word, edges[0].source);
+  EXPECT_EQ(LEMUR.word, edges[0].sink);
+  edges = bidirectional.outgoingEdgesFast(CAT.word, &numEdges);
+  ASSERT_EQ(1, numEdges);
+  EXPECT_EQ(ANIMAL.word, edges[0].sink);
+  bidirectional.outgoingEdgesFast(LEMUR.word, &numEdges);
+  EXPECT_EQ(0, numEdges);
+  EXPECT_EQ(1, bidirectional.outgoingEdges(POTTO).size());
+}
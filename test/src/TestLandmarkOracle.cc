@@ -0,0 +1,131 @@
+#include <limits.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "LandmarkOracle.h"
+#include "Models.h"
+
+using namespace std;
+
+class LandmarkOracleTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    graph = new BidirectionalGraph(ReadMockGraph());
+    // (the mock graph has four connected words: lemur, potto, animal, cat)
+    oracle = LandmarkOracle::build(*graph, 2);
+    exact = LandmarkOracle::build(*graph, 100);
+  }
+
+  virtual void TearDown() {
+    delete oracle;
+    delete exact;
+    delete graph;
+  }
+
+  BidirectionalGraph* graph;
+  LandmarkOracle* oracle;
+  LandmarkOracle* exact;
+};
+
+//
+// Check the landmarks chosen
+//
+TEST_F(LandmarkOracleTest, ChooseLandmarks) {
+  EXPECT_EQ(2, oracle->numLandmarks());
+  EXPECT_NE(oracle->landmark(0), oracle->landmark(1));
+  EXPECT_EQ(4, exact->numLandmarks());
+  EXPECT_EQ(graph->vocabSize(), exact->vocabSize());
+}
+
+//
+// The bounds should never exceed the true costs
+//
+TEST_F(LandmarkOracleTest, BoundsAreAdmissible) {
+  const word words[] = { LEMUR.word, POTTO.word, ANIMAL.word, CAT.word, HAVE.word };
+  // (lemur -> animal -> cat; lemur -> potto)
+  const float inf = numeric_limits<float>::infinity();
+  const float cost[5][5] = {
+    { 0.0f,  0.01f, 0.42f, 42.42f, inf },
+    { inf,   0.0f,  inf,   inf,    inf },
+    { inf,   inf,   0.0f,  42.0f,  inf },
+    { inf,   inf,   inf,   0.0f,   inf },
+    { inf,   inf,   inf,   inf,    0.0f } };
+  for (uint32_t a = 0; a < 5; ++a) {
+    for (uint32_t b = 0; b < 5; ++b) {
+      EXPECT_LE(oracle->lowerBound(words[a], words[b]), cost[a][b]);
+      EXPECT_GE(oracle->lowerBound(words[a], words[b]), 0.0f);
+      // (with every word a landmark, the bounds are exact)
+      if (words[a] != HAVE.word && words[b] != HAVE.word) {
+        EXPECT_FLOAT_EQ(cost[a][b], exact->lowerBound(words[a], words[b]));
+      }
+    }
+  }
+}
+
+//
+// Bound the cost to the closest of a number of words
+//
+TEST_F(LandmarkOracleTest, BoundToClosestTarget) {
+  vector<word> targets;
+  targets.push_back(CAT.word);
+  targets.push_back(POTTO.word);
+  EXPECT_FLOAT_EQ(0.01f, exact->lowerBound(LEMUR.word, targets));
+  EXPECT_FLOAT_EQ(42.0f, exact->lowerBound(ANIMAL.word, targets));
+  EXPECT_EQ(numeric_limits<float>::infinity(), exact->lowerBound(CAT.word, vector<word>()));
+  // (a word not in the table can't be mutated into, so it prunes nothing)
+  targets.push_back(INVALID_WORD);
+  EXPECT_FLOAT_EQ(0.01f, exact->lowerBound(LEMUR.word, targets));
+  EXPECT_EQ(numeric_limits<float>::infinity(),
+            exact->lowerBound(POTTO.word, vector<word>(1, INVALID_WORD)));
+}
+
+//
+// Bound the cost to the closest of a number of summarized words
+//
+TEST_F(LandmarkOracleTest, BoundToSummarizedGoals) {
+  const word words[] = { LEMUR.word, POTTO.word, ANIMAL.word, CAT.word, HAVE.word };
+  vector<word> targets;
+  targets.push_back(ANIMAL.word);
+  targets.push_back(CAT.word);
+  targets.push_back(INVALID_WORD);
+  const landmark_goals exactGoals = exact->summarizeGoals(targets);
+  const landmark_goals goals = oracle->summarizeGoals(targets);
+  for (uint32_t a = 0; a < 5; ++a) {
+    // (never tighter than the bound to each target)
+    EXPECT_LE(exact->lowerBound(words[a], exactGoals), exact->lowerBound(words[a], targets));
+    EXPECT_LE(oracle->lowerBound(words[a], goals), exact->lowerBound(words[a], targets));
+    EXPECT_GE(oracle->lowerBound(words[a], goals), 0.0f);
+  }
+  // (but it still shows which words can't reach a target)
+  EXPECT_FALSE(isinf(exact->lowerBound(LEMUR.word, exactGoals)));
+  EXPECT_EQ(numeric_limits<float>::infinity(), exact->lowerBound(POTTO.word, exactGoals));
+  EXPECT_EQ(numeric_limits<float>::infinity(), exact->lowerBound(HAVE.word, exactGoals));
+  EXPECT_EQ(numeric_limits<float>::infinity(),
+            exact->lowerBound(LEMUR.word, exact->summarizeGoals(vector<word>(1, INVALID_WORD))));
+}
+
+//
+// Write the table, and map it back in
+//
+TEST_F(LandmarkOracleTest, WriteAndMap) {
+  char path[] = "/tmp/naturalli_landmarksXXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_TRUE(exact->writeTo(path));
+  LandmarkOracle* mapped = LandmarkOracle::open(path);
+  ASSERT_FALSE(mapped == NULL);
+  EXPECT_EQ(exact->numLandmarks(), mapped->numLandmarks());
+  EXPECT_EQ(exact->vocabSize(), mapped->vocabSize());
+  EXPECT_FLOAT_EQ(42.42f, mapped->lowerBound(LEMUR.word, CAT.word));
+  EXPECT_EQ(numeric_limits<float>::infinity(), mapped->lowerBound(CAT.word, LEMUR.word));
+  delete mapped;
+  // (a truncated table can't be read)
+  ASSERT_EQ(0, truncate(path, 10));
+  EXPECT_TRUE(LandmarkOracle::open(path) == NULL);
+  unlink(path);
+}
@@ -4,6 +4,7 @@
 
 #include "gtest/gtest.h"
 #include "btree_set.h"
+#include "LandmarkOracle.h"
 #include "SynSearch.h"
 #include "Types.h"
 #include "Utils.h"
@@ -112,7 +113,7 @@ TEST_F(SearchNodeTest, InitFromTree) {
 
   SearchNode path(tree);
   EXPECT_EQ(tree.hash(), path.factHash());
-  EXPECT_EQ(TREE_ROOT_WORD, path.governor());
+  EXPECT_EQ(TREE_ROOT_WORD, path.governor(tree));
   EXPECT_EQ(getTaggedWord(43, 0, MONOTONE_INVALID), path.wordAndSense());
   EXPECT_EQ(1, path.tokenIndex());
   EXPECT_EQ(0, path.getBackpointer());
@@ -131,6 +132,107 @@ TEST_F(SearchNodeTest, AssignmentOperator) {
 //
 // Hash Mutate (quantifier)
 //
+#if SEARCH_CYCLE_FINGERPRINT!=0
+TEST_F(SearchNodeTest, AncestorFingerprints) {
+  Tree tree(string("42\t2\tnsubj\n") +
+            string("43\t0\troot\n") +
+            string("44\t2\tdobj"));
+  SearchNode root(tree);
+  // A mutation and its undo
+  SearchNode child(root, tree.updateHashFromMutation(
+        root.factHash(), 1, 43, root.governor(tree), 50),
+      getTaggedWord(50, 0, 0), true, 1);
+  SearchNode grandchild(child, tree.updateHashFromMutation(
+        child.factHash(), 1, 50, child.governor(tree), 43),
+      getTaggedWord(43, 0, 0), true, 2);
+  EXPECT_NE(root, child);
+  EXPECT_EQ(0x0, root.ancestorsWithFingerprintOf(child));
+  EXPECT_EQ(root.factHash(), grandchild.factHash());
+  EXPECT_EQ(root.fingerprint(), grandchild.fingerprint());
+  // The grandchild is checked against the child's ancestors, starting at
+  // the root (the child's parent)
+  EXPECT_EQ(0x1, child.ancestorsWithFingerprintOf(grandchild) & 0x1);
+  // Copies keep their ancestors
+  SearchNode copy = child;
+  EXPECT_EQ(child.ancestorsWithFingerprintOf(grandchild),
+            copy.ancestorsWithFingerprintOf(grandchild));
+  // ... as do nodes which move index
+  SearchNode moved(child, tree, 0, 1);
+  EXPECT_EQ(child.ancestorsWithFingerprintOf(grandchild),
+            moved.ancestorsWithFingerprintOf(grandchild));
+}
+#endif
+
+TEST_F(SearchNodeTest, KBHitNotInherited) {
+  Tree tree(string("42\t2\tnsubj\n") +
+            string("43\t0\troot\n") +
+            string("44\t2\tdobj"));
+  SearchNode root(tree);
+  EXPECT_FALSE(root.isKBHit());
+  root.setKBHit(true);
+  EXPECT_TRUE(root.isKBHit());
+  EXPECT_EQ(tree.hash(), root.factHash());
+  EXPECT_EQ(0, root.getBackpointer());
+  SearchNode copy = root;
+  EXPECT_TRUE(copy.isKBHit());
+  EXPECT_FALSE(SearchNode(root, tree, 0, 1).isKBHit());
+  EXPECT_FALSE(root.deletion(1, true, tree, 0).isKBHit());
+  EXPECT_FALSE(SearchNode(root, root.factHash(), root.wordAndSense(), true, 1).isKBHit());
+}
+
+TEST_F(SearchNodeTest, StateKeyIgnoresCostAndHistory) {
+  Tree tree(string("42\t2\tnsubj\n") +
+            string("43\t0\troot\n") +
+            string("44\t2\tdobj"));
+  SearchNode root(tree);
+  SearchNode moved(root, tree, 0, 1);
+  SearchNode movedAgain(root, tree, 0, 7);
+  EXPECT_NE(root.stateKey(), moved.stateKey());
+  EXPECT_EQ(moved.stateKey(), movedAgain.stateKey());
+  SearchNode deleted = root.deletion(1, true, tree, 0);
+  EXPECT_NE(root.stateKey(), deleted.stateKey());
+  SearchNode falseRoot(tree, false);
+  EXPECT_EQ(root.factHash(), falseRoot.factHash());
+  EXPECT_NE(root.stateKey(), falseRoot.stateKey());
+}
+
+TEST_F(SearchNodeTest, StateCostMapKeepsBestCost) {
+  Tree tree(string("42\t2\tnsubj\n") +
+            string("43\t0\troot\n") +
+            string("44\t2\tdobj"));
+  SearchNode root(tree);
+  SearchNode moved(root, tree, 0, 1);
+  StateCostMap bestCosts;
+  EXPECT_FALSE(bestCosts.isStale(root, 1.0f));
+  EXPECT_TRUE(bestCosts.improves(root, 1.0f));
+  EXPECT_FALSE(bestCosts.improves(root, 1.0f));
+  EXPECT_FALSE(bestCosts.improves(root, 2.0f));
+  EXPECT_TRUE(bestCosts.improves(moved, 2.0f));
+  EXPECT_FALSE(bestCosts.isStale(root, 1.0f));
+  EXPECT_TRUE(bestCosts.improves(root, 0.5f));
+  EXPECT_TRUE(bestCosts.isStale(root, 1.0f));
+  EXPECT_FALSE(bestCosts.isStale(moved, 2.0f));
+  EXPECT_EQ(2, bestCosts.size());
+}
+
+TEST_F(SearchNodeTest, StateCostMapGrows) {
+  Tree tree(string("42\t2\tnsubj\n") +
+            string("43\t0\troot\n") +
+            string("44\t2\tdobj"));
+  SearchNode root(tree);
+  StateCostMap bestCosts(4);
+  for (uint32_t i = 0; i < 10000; ++i) {
+    SearchNode child(root, root.factHash() + i, root.wordAndSense(), true, 1);
+    EXPECT_TRUE(bestCosts.improves(child, (float) i));
+  }
+  EXPECT_EQ(10000, bestCosts.size());
+  for (uint32_t i = 0; i < 10000; ++i) {
+    SearchNode child(root, root.factHash() + i, root.wordAndSense(), true, 1);
+    EXPECT_FALSE(bestCosts.improves(child, (float) i));
+    EXPECT_TRUE(bestCosts.isStale(child, (float) i + 1.0f));
+  }
+}
+
 TEST_F(SearchNodeTest, HashMutateQuantifier) {
   // Variables
   Tree targetTree(string("42\t2\top\t0\tq\tmonotone\t2-4\t-\t-\n") +
@@ -537,6 +639,81 @@ TEST_F(TreeTest, HashRepeatable) {
   EXPECT_EQ(t1.hash(), t2.hash());
 }
 
+//
+// Hash a stream of trees in parallel batches
+//
+TEST_F(TreeTest, HashTreesInBatches) {
+  const string trees[] = {
+    string("42\t2\tnsubj\n43\t0\troot\n44\t2\tdobj\n"),
+    string("# a comment\n42\t2\tamod\n43\t3\tnsubj\n44\t0\troot\n45\t5\tamod\n46\t3\tdobj\n"),
+    string("%maxTicks=100\n42\t2\top\n43\t0\troot\n44\t2\tdobj")
+  };
+  const uint64_t expected[] = { tree->hash(), bigTree->hash(), opTree->hash() };
+  // (more trees than fit in a batch; two of them too long to hash, counting
+  //  the blank line which ends them, as readTreeFromStdin() does)
+  string stream = "\n";
+  for (uint32_t i = 0; i < 40000; ++i) {
+    stream += trees[i % 3] + "\n\n";
+    if (i == 20000) {
+      for (uint32_t line = 0; line < MAX_FACT_LENGTH; ++line) { stream += "42\t0\troot\n"; }
+      stream += "\n";
+    }
+    if (i == 30000) {
+      for (uint32_t line = 0; line < MAX_FACT_LENGTH - 1; ++line) { stream += "42\t0\troot\n"; }
+      stream += "\n";
+    }
+  }
+  FILE* input = fmemopen((void*) stream.data(), stream.size(), "r");
+  ASSERT_FALSE(input == NULL);
+  vector<uint64_t> hashes;
+  uint64_t numSkipped = 0;
+  const uint64_t numHashed = hashTrees(input, 4,
+      [&hashes](const uint64_t* batch, const uint64_t& count) -> void {
+        hashes.insert(hashes.end(), batch, batch + count);
+      }, &numSkipped);
+  fclose(input);
+  EXPECT_EQ(40000, numHashed);
+  EXPECT_EQ(2, numSkipped);
+  ASSERT_EQ(40000, hashes.size());
+  for (uint32_t i = 0; i < hashes.size(); ++i) {
+    EXPECT_EQ(expected[i % 3], hashes[i]);
+  }
+}
+
+//
+// Hash each distinct tree of a sentence once
+//
+TEST_F(TreeTest, HashTreesOncePerSentence) {
+  const string first("42\t2\tnsubj\n43\t0\troot\n44\t2\tdobj\n");
+  const string second("42\t2\top\n43\t0\troot\n44\t2\tdobj\n");
+  const string stream =
+      "# 0\n" + first + "\n" +
+      "# 0\n" + second + "\n" +
+      "# 0\n" + first + "\n" +    // (repeated in sentence 0)
+      "# 1\n" + first + "\n" +    // (a new sentence)
+      first + "\n" +               // (unmarked trees are their own sentence)
+      first + "\n";
+  FILE* input = fmemopen((void*) stream.data(), stream.size(), "r");
+  ASSERT_FALSE(input == NULL);
+  vector<uint64_t> hashes;
+  uint64_t numSkipped = 0;
+  const uint64_t numHashed = hashTrees(input, 2,
+      [&hashes](const uint64_t* batch, const uint64_t& count) -> void {
+        hashes.insert(hashes.end(), batch, batch + count);
+      }, &numSkipped);
+  fclose(input);
+  EXPECT_EQ(5, numHashed);
+  EXPECT_EQ(1, numSkipped);
+  const Tree firstTree(first);
+  const Tree secondTree(second);
+  ASSERT_EQ(5, hashes.size());
+  EXPECT_EQ(firstTree.hash(), hashes[0]);
+  EXPECT_EQ(secondTree.hash(), hashes[1]);
+  EXPECT_EQ(firstTree.hash(), hashes[2]);
+  EXPECT_EQ(firstTree.hash(), hashes[3]);
+  EXPECT_EQ(firstTree.hash(), hashes[4]);
+}
+
 //
 // Hash Value Test
 //
@@ -974,6 +1151,26 @@ TEST_F(TreeTest, AlignConstrainedBegin) {
   EXPECT_EQ(ELECTRICITY.word, alignments.targetAt(2));
 }
 
+//
+// Align (from precomputed token tables)
+//
+TEST_F(TreeTest, AlignFromTokenTables) {
+  Tree premise(ALL_CATS_OF_FURRY_HAVE_TAILS);
+  Tree hypothesis(ALL_FUZZY_CATS_HAVE_TAILS);
+  const alignment_token_table hypothesisTokens(hypothesis, *graph);
+  EXPECT_EQ(hypothesis.length, hypothesisTokens.length);
+  EXPECT_EQ(INVALID_WORD, hypothesisTokens.word(-1));
+  EXPECT_EQ('?', hypothesisTokens.tag(hypothesis.length));
+  AlignmentSimilarity fromTrees = hypothesis.alignToPremise(premise, *graph);
+  AlignmentSimilarity fromTables = Tree::alignToPremise(
+      hypothesisTokens, alignment_token_table(premise, *graph));
+  for (uint8_t i = 0; i < hypothesis.length; ++i) {
+    EXPECT_EQ(fromTrees.targetAt(i), fromTables.targetAt(i));
+    EXPECT_EQ(fromTrees.targetPolarityAt(i), fromTables.targetPolarityAt(i));
+  }
+  EXPECT_NEAR(fromTrees.score(hypothesis), fromTables.score(hypothesis), 1e-7);
+}
+
 
 // ----------------------------------------------
 // Alignment Similarity
@@ -1101,6 +1298,80 @@ TEST_F(AlignmentSimilarityTest, UpdateScoreMatchMonoOnly) {
 }
 */
 
+#if MAX_FUZZY_MATCHES >= 3
+//
+// Alignment Matrix Score
+//
+TEST_F(AlignmentSimilarityTest, MatrixScoreMatchesSimilarity) {
+  vector<AlignmentSimilarity> alignments;
+  alignments.push_back(*hard);
+  alignments.push_back(*easy);
+  alignments.push_back(*monoMismatch);
+  AlignmentMatrix matrix(*allFurryCatsHaveTails, alignments);
+  EXPECT_EQ(3, matrix.size());
+  float scores[MAX_FUZZY_MATCHES];
+  matrix.score(true, scores);
+  EXPECT_NEAR(hard->score(*allFurryCatsHaveTails), scores[0], 1e-6);
+  EXPECT_NEAR(easy->score(*allFurryCatsHaveTails), scores[1], 1e-6);
+  EXPECT_NEAR(monoMismatch->score(*allFurryCatsHaveTails), scores[2], 1e-6);
+  for (uint8_t i = 3; i < MAX_FUZZY_MATCHES; ++i) {
+    EXPECT_TRUE(isinf(scores[i]));
+  }
+}
+
+//
+// Alignment Matrix Score, with several instances at one index
+//
+TEST_F(AlignmentSimilarityTest, MatrixScoreCountsRepeatedInstances) {
+  vector<alignment_instance> v;
+  v.emplace_back(1, FURRY.word, MONOTONE_DOWN);
+  v.emplace_back(1, FUZZY.word, MONOTONE_DOWN);
+  v.emplace_back(2, CAT.word, MONOTONE_DOWN);
+  v.emplace_back(2, INVALID_WORD, MONOTONE_DOWN);
+  vector<AlignmentSimilarity> alignments;
+  alignments.push_back(AlignmentSimilarity(v, 0));
+  alignments.push_back(*easy);
+  AlignmentMatrix matrix(*allFurryCatsHaveTails, alignments);
+  float scores[MAX_FUZZY_MATCHES];
+  for (uint8_t truth = 0; truth < 2; ++truth) {
+    matrix.score(truth, scores);
+    EXPECT_NEAR(alignments[0].score(*allFurryCatsHaveTails, truth), scores[0], 1e-6);
+    EXPECT_NEAR(alignments[1].score(*allFurryCatsHaveTails, truth), scores[1], 1e-6);
+  }
+}
+
+//
+// Alignment Matrix Update Score
+//
+TEST_F(AlignmentSimilarityTest, MatrixUpdateMatchesSimilarity) {
+  vector<AlignmentSimilarity> alignments;
+  alignments.push_back(*hard);
+  alignments.push_back(*easy);
+  alignments.push_back(*monoMismatch);
+  AlignmentMatrix matrix(*allFurryCatsHaveTails, alignments);
+  float scores[MAX_FUZZY_MATCHES];
+  float updated[MAX_FUZZY_MATCHES];
+  matrix.score(true, scores);
+  const ::word words[] = { FURRY.word, FUZZY.word, CAT.word, DOG.word, INVALID_WORD };
+  const monotonicity polarities[] = { MONOTONE_UP, MONOTONE_DOWN, MONOTONE_FLAT };
+  for (uint8_t index = 0; index < 4; ++index) {
+  for (uint8_t oldW = 0; oldW < 4; ++oldW) {
+  for (uint8_t newW = 0; newW < 5; ++newW) {
+  for (uint8_t oldP = 0; oldP < 3; ++oldP) {
+  for (uint8_t newP = 0; newP < 3; ++newP) {
+  for (uint8_t truth = 0; truth < 4; ++truth) {
+    matrix.updateScores(scores, updated, index, words[oldW], words[newW],
+        polarities[oldP], polarities[newP], truth & 0x1, truth & 0x2);
+    for (uint8_t i = 0; i < 3; ++i) {
+      EXPECT_NEAR(alignments[i].updateScore(scores[i], index,
+            words[oldW], words[newW], polarities[oldP], polarities[newP],
+            truth & 0x1, truth & 0x2),
+          updated[i], 1e-6);
+    }
+  }}}}}}
+}
+#endif
+
 // ----------------------------------------------
 // KNHeap (Priority Queue)
 // ----------------------------------------------
@@ -1240,6 +1511,37 @@ TEST_F(KNHeapTest, StressTest) {
   }
 }
 
+//
+// Fringe dump
+//
+TEST_F(KNHeapTest, CopyToKeepsEveryElement) {
+  KNHeap<float,uint32_t>& heap = *simpleHeap;
+  const uint32_t size = 100000;
+  for (uint32_t i = 0; i < size; ++i) {
+    heap.insert((float) ((i * 7919) % size), i);
+  }
+  float key;
+  uint32_t value;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    heap.deleteMin(&key, &value);
+  }
+  ASSERT_EQ(size - 1000, heap.getSize());
+  KNElement<float,uint32_t>* elements = new KNElement<float,uint32_t>[heap.getSize()];
+  heap.copyTo(elements);
+  vector<bool> seen(size, false);
+  for (int i = 0; i < heap.getSize(); ++i) {
+    EXPECT_FALSE(seen[elements[i].value]);
+    EXPECT_EQ((float) ((elements[i].value * 7919) % size), elements[i].key);
+    EXPECT_GE(elements[i].key, 1000.0f);
+    seen[elements[i].value] = true;
+  }
+  delete[] elements;
+  // (the heap is unchanged)
+  heap.deleteMin(&key, &value);
+  EXPECT_EQ(1000.0f, key);
+  EXPECT_EQ(size - 1001, heap.getSize());
+}
+
 // ----------------------------------------------
 // Natural Logic
 // ----------------------------------------------
@@ -1453,10 +1755,10 @@ TEST_F(SynSearchTest, ThreadsFinish) {
 //
 TEST_F(SynSearchTest, TickCountNoMutation) {
   syn_search_response response = SynSearch(graph, &factdb, catsHaveTails, costs, true, opts);
-#if SEARCH_FULL_MEMORY!=0
-  EXPECT_EQ(7, response.totalTicks);
+#if SEARCH_FULL_MEMORY!=0 || SEARCH_DOMINANCE_FILTER!=0
+  EXPECT_EQ(4, response.totalTicks);
 #else
-  EXPECT_EQ(8, response.totalTicks);
+  EXPECT_EQ(5, response.totalTicks);
 #endif
 }
 
@@ -1465,10 +1767,10 @@ TEST_F(SynSearchTest, TickCountNoMutation) {
 //
 TEST_F(SynSearchTest, TickCountWithMutations) {
   syn_search_response response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
-#if SEARCH_FULL_MEMORY!=0
-  EXPECT_EQ(10, response.totalTicks);
+#if SEARCH_FULL_MEMORY!=0 || SEARCH_DOMINANCE_FILTER!=0
+  EXPECT_EQ(7, response.totalTicks);
 #else
-  EXPECT_EQ(11, response.totalTicks);
+  EXPECT_EQ(8, response.totalTicks);
 #endif
 }
 
@@ -1477,13 +1779,13 @@ TEST_F(SynSearchTest, TickCountWithMutations) {
 //
 TEST_F(SynSearchTest, TickCountWithMutationsCyclic) {
   syn_search_response response = SynSearch(cyclicGraph, &factdb, lemursHaveTails, costs, true, opts);
-#if SEARCH_FULL_MEMORY!=0
-  EXPECT_EQ(10, response.totalTicks);
+#if SEARCH_FULL_MEMORY!=0 || (SEARCH_DOMINANCE_FILTER!=0 && SEARCH_CYCLE_MEMORY!=0)
+  EXPECT_EQ(7, response.totalTicks);
 #else
-#if SEARCH_CYCLE_MEMORY==0
+#if SEARCH_CYCLE_MEMORY==0 && SEARCH_DOMINANCE_FILTER==0
   EXPECT_EQ(SEARCH_TIMEOUT_TEST, response.totalTicks);
 #else
-  EXPECT_EQ(11, response.totalTicks);
+  EXPECT_EQ(8, response.totalTicks);
 #endif
 #endif
 }
@@ -1496,15 +1798,299 @@ TEST_F(SynSearchTest, LiteralLookup) {
   EXPECT_EQ(1, response.paths.size());
 }
 
+//
+// Literal lookup, without searching
+//
+TEST_F(SynSearchTest, FastSearchLiteralLookup) {
+  syn_search_response response = FastSearch(graph, &factdb, btree_set<uint64_t>(), catsHaveTails, costs, true, opts);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(1, response.paths[0].size());
+  EXPECT_EQ(0, response.totalTicks);
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+  EXPECT_LE(1, response.kbStats.lookups);
+  EXPECT_EQ(response.kbStats.lookups, response.kbStats.filterHits);
+  EXPECT_EQ(0, response.kbStats.diskVerifications);
+}
+
+//
+// Deletions without searching find what the search finds
+//
+TEST_F(SynSearchTest, FastSearchDeletion) {
+  Tree catsHave(CAT_STR +  string("\t2\tnsubj\n") +
+                HAVE_STR + string("\t0\troot"));
+  btree_set<uint64_t> premises;
+  premises.insert(catsHave.hash());
+  syn_search_response full = SynSearch(graph, &premises, catsHaveTails, costs, true, opts);
+  syn_search_response fast = FastSearch(graph, &premises, btree_set<uint64_t>(), catsHaveTails, costs, true, opts);
+  ASSERT_EQ(full.paths.size(), fast.paths.size());
+  ASSERT_EQ(1, fast.paths.size());
+  EXPECT_EQ(full.paths[0].size(), fast.paths[0].size());
+  EXPECT_EQ(catsHave.hash(), fast.front(0).factHash());
+  EXPECT_EQ(catsHaveTails->hash(), fast.back(0).factHash());
+  // (with no variants to look up, nothing is found)
+  opts.maxFastSearchVariants = 0;
+  fast = FastSearch(graph, &premises, btree_set<uint64_t>(), catsHaveTails, costs, true, opts);
+  EXPECT_EQ(0, fast.paths.size());
+}
+
+//
+// Mutations are left to the search
+//
+TEST_F(SynSearchTest, FastSearchNeedsMutation) {
+  syn_search_response response = FastSearch(graph, &factdb, btree_set<uint64_t>(), lemursHaveTails, costs, true, opts);
+  EXPECT_EQ(0, response.paths.size());
+}
+
+//
+// A knowledge base in which every fact was seen the same number of times
+//
+class CountedFactDB : public BTreeFactDB {
+ public:
+  CountedFactDB(const btree_set<uint64_t>* facts, const uint32_t& timesSeen)
+    : BTreeFactDB(facts, false), timesSeen(timesSeen) { }
+
+  virtual uint32_t count(const uint64_t& fact) const {
+    return contains(fact) ? timesSeen : 0;
+  }
+
+ private:
+  uint32_t timesSeen;
+};
+
+//
+// Facts seen often make cheaper results
+//
+TEST_F(SynSearchTest, FactCountBonus) {
+  const CountedFactDB kb(&factdb, 100);
+  const vector<AlignmentSimilarity> alignments;
+  syn_search_response plain = SynSearch(graph, &kb, btree_set<uint64_t>(), lemursHaveTails, costs, true, opts, alignments);
+  ASSERT_EQ(1, plain.paths.size());
+  opts.factCountBonus = 0.01f;
+  syn_search_response bonus = SynSearch(graph, &kb, btree_set<uint64_t>(), lemursHaveTails, costs, true, opts, alignments);
+  ASSERT_EQ(1, bonus.paths.size());
+  EXPECT_LT(bonus.paths[0].cost, plain.paths[0].cost);
+  EXPECT_NEAR(max(0.0f, plain.paths[0].cost - 0.01f * log(100.0f)), bonus.paths[0].cost, 1e-5);
+}
+
 //
 // Real Search (soft weights)
 //
 TEST_F(SynSearchTest, LemursToCatsSoft) {
   syn_search_response response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
   ASSERT_EQ(1, response.paths.size());
-  EXPECT_EQ(5, response.paths[0].size());
-  EXPECT_EQ(lemursHaveTails->hash(), response.paths[0].back().factHash());
-  EXPECT_EQ(catsHaveTails->hash(), response.paths[0].front().factHash());
+  EXPECT_EQ(3, response.paths[0].size());  // index moves are not part of the path
+  EXPECT_EQ(lemursHaveTails->hash(), response.back(0).factHash());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+}
+
+//
+// Check the fringe after timing out
+//
+TEST_F(SynSearchTest, LemursToCatsCheckFringe) {
+  opts.maxTicks = 3;
+  syn_search_response response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
+  EXPECT_EQ(0, response.paths.size());
+  opts.checkFringe = true;
+  response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(3, response.paths[0].size());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+}
+
+//
+// Resume a timed out search from a checkpoint
+//
+TEST_F(SynSearchTest, LemursToCatsResumeFromCheckpoint) {
+  syn_search_response uninterrupted = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
+  ASSERT_EQ(1, uninterrupted.paths.size());
+  // Time out
+  syn_search_checkpoint checkpoint;
+  opts.maxTicks = 3;
+  syn_search_response response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts,
+                                           vector<AlignmentSimilarity>(), &checkpoint);
+  EXPECT_EQ(0, response.paths.size());
+  EXPECT_EQ(3, checkpoint.ticks);
+  EXPECT_EQ(4, checkpoint.history.size());
+  EXPECT_TRUE(checkpoint.resumable());
+  // Round trip through a blob
+  string blob;
+  checkpoint.serialize(&blob);
+  syn_search_checkpoint restored;
+  ASSERT_TRUE(restored.deserialize(blob));
+  EXPECT_EQ(checkpoint.key, restored.key);
+  EXPECT_EQ(checkpoint.fringe.size(), restored.fringe.size());
+  EXPECT_TRUE(checkpoint.memory == restored.memory);
+#if SEARCH_FULL_MEMORY!=0
+  EXPECT_LE(checkpoint.history.size() - 1, checkpoint.memory.size());
+#else
+  EXPECT_TRUE(checkpoint.memory.empty());
+#endif
+  EXPECT_FALSE(syn_search_checkpoint().deserialize(blob.substr(0, blob.size() - 1)));
+  // Resume
+  opts.maxTicks = SEARCH_TIMEOUT_TEST;
+  response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts,
+                       vector<AlignmentSimilarity>(), &restored);
+  EXPECT_EQ(uninterrupted.totalTicks, response.totalTicks);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(uninterrupted.paths[0].size(), response.paths[0].size());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+  EXPECT_EQ(lemursHaveTails->hash(), response.back(0).factHash());
+  EXPECT_FALSE(restored.resumable());
+  // A checkpoint can't be resumed for a different query
+  response = SynSearch(graph, &factdb, catsHaveTails, costs, true, opts,
+                       vector<AlignmentSimilarity>(), &checkpoint);
+  EXPECT_EQ(0, response.totalTicks);
+}
+
+//
+// Search once, and match the explored facts against many premise sets
+//
+TEST_F(SynSearchTest, LemursMatchManyPremiseSets) {
+  btree_set<uint64_t> emptyKB;
+  vector<btree_set<uint64_t> > premiseSets(4);
+  premiseSets[0].insert(catsHaveTails->hash());
+  premiseSets[1].insert(animalsHaveTails->hash());
+  premiseSets[2].insert(catsHaveTails->hash());
+  premiseSets[2].insert(lemursHaveTails->hash());
+  syn_search_explored explored;
+  syn_search_response response = SynSearch(graph, &emptyKB, lemursHaveTails, costs, true, opts,
+                                           vector<AlignmentSimilarity>(), NULL, &explored);
+  EXPECT_EQ(0, response.paths.size());
+  EXPECT_EQ(response.totalTicks + 1, explored.history.size());
+  vector<syn_search_response> matches = explored.match(premiseSets);
+  ASSERT_EQ(4, matches.size());
+  // The same premises should be found as by searching each premise set
+  for (uint32_t i = 0; i < premiseSets.size(); ++i) {
+    syn_search_response expected = SynSearch(graph, &emptyKB, premiseSets[i],
+                                              lemursHaveTails, costs, true, opts);
+    ASSERT_EQ(expected.paths.size(), matches[i].paths.size());
+    for (uint32_t pathI = 0; pathI < expected.paths.size(); ++pathI) {
+      EXPECT_EQ(expected.front(pathI).factHash(), matches[i].front(pathI).factHash());
+      EXPECT_EQ(expected.paths[pathI].size(), matches[i].paths[pathI].size());
+      EXPECT_EQ(expected.paths[pathI].cost, matches[i].paths[pathI].cost);
+    }
+  }
+  ASSERT_EQ(1, matches[0].paths.size());
+  EXPECT_EQ(catsHaveTails->hash(), matches[0].front(0).factHash());
+  EXPECT_EQ(lemursHaveTails->hash(), matches[0].back(0).factHash());
+  EXPECT_EQ(0, matches[3].paths.size());
+}
+
+//
+// The words from which a premise word can be reached
+//
+TEST_F(SynSearchTest, ReachableWords) {
+  BidirectionalGraph bidirectional(ReadMockGraph());
+  vector<word> targets;
+  targets.push_back(CAT.word);
+  ReachableWords reachable(bidirectional, targets);
+  EXPECT_EQ(3, reachable.size());
+  EXPECT_TRUE(reachable.contains(CAT.word));
+  EXPECT_TRUE(reachable.contains(ANIMAL.word));
+  EXPECT_TRUE(reachable.contains(LEMUR.word));
+  EXPECT_FALSE(reachable.contains(POTTO.word));
+  // (animal -> cat costs 42)
+  ReachableWords cheap(bidirectional, targets, 10.0f);
+  EXPECT_EQ(1, cheap.size());
+  EXPECT_FALSE(cheap.contains(ANIMAL.word));
+  // (a word outside the vocabulary reaches nothing)
+  targets.push_back(INVALID_WORD);
+  ReachableWords withInvalid(bidirectional, targets);
+  EXPECT_EQ(3, withInvalid.size());
+  EXPECT_FALSE(withInvalid.contains(INVALID_WORD));
+}
+
+//
+// The largest edge cost a search can take under its cost threshold
+//
+TEST_F(SynSearchTest, ReachableWordsMaxEdgeCost) {
+  SynSearchCosts* unit = createStrictCosts(1.0f, 0.0f, 1.0f, 0.0f);
+  EXPECT_NEAR(5.0f, ReachableWords::maxEdgeCost(*unit, 5.0f), 1e-5);
+  unit->mutationLexicalCost[HYPERNYM] = 0.0f;  // (a free mutation)
+  EXPECT_TRUE(isinf(ReachableWords::maxEdgeCost(*unit, 5.0f)));
+  delete unit;
+}
+
+//
+// Search premises only with a soft alignment, whose target may be
+// INVALID_WORD; only words in the graph are pruned toward
+//
+TEST_F(SynSearchTest, LemursToCatsPremiseWordPruningSoftAlign) {
+  btree_set<uint64_t> emptyKB;
+  vector<alignment_instance> v;
+  v.emplace_back(0, POTTO.word, MONOTONE_UP);
+  v.emplace_back(1, INVALID_WORD, MONOTONE_UP);
+  vector<AlignmentSimilarity> alignments;
+  alignments.emplace_back(v, 0);
+  BidirectionalGraph bidirectional(ReadMockGraph());
+  vector<Tree*> premises;
+  premises.push_back(catsHaveTails);
+  const vector<word> targets = premiseTargets(bidirectional, premises, alignments);
+  EXPECT_TRUE(std::binary_search(targets.begin(), targets.end(), CAT.word));
+  EXPECT_TRUE(std::binary_search(targets.begin(), targets.end(), POTTO.word));
+  for (auto iter = targets.begin(); iter != targets.end(); ++iter) {
+    EXPECT_LT(*iter, bidirectional.vocabSize());
+  }
+  ReachableWords premiseWords(bidirectional, targets,
+      ReachableWords::maxEdgeCost(*costs, opts.costThreshold));
+  EXPECT_TRUE(premiseWords.contains(LEMUR.word));
+  EXPECT_TRUE(premiseWords.contains(POTTO.word));
+  opts.premiseWords = &premiseWords;
+  syn_search_response response = SynSearch(graph, &emptyKB, factdb, lemursHaveTails,
+                                           costs, true, opts, alignments);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+}
+
+//
+// Search premises only, skipping mutations which can't reach a premise
+//
+TEST_F(SynSearchTest, LemursToCatsPremiseWordPruning) {
+  btree_set<uint64_t> emptyKB;
+  syn_search_response unpruned = SynSearch(graph, &emptyKB, factdb, lemursHaveTails, costs, true, opts);
+  BidirectionalGraph bidirectional(ReadMockGraph());
+  vector<word> targets;
+  for (uint8_t i = 0; i < catsHaveTails->length; ++i) {
+    targets.push_back(catsHaveTails->word(i));
+  }
+  ReachableWords premiseWords(bidirectional, targets);
+  opts.premiseWords = &premiseWords;
+  syn_search_response response = SynSearch(graph, &emptyKB, factdb, lemursHaveTails, costs, true, opts);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(unpruned.paths[0].size(), response.paths[0].size());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+  EXPECT_LT(response.totalTicks, unpruned.totalTicks);  // (no mutation to potto)
+  // (with a main KB, nothing is pruned)
+  response = SynSearch(graph, &factdb, lemursHaveTails, costs, true, opts);
+  EXPECT_EQ(unpruned.totalTicks, response.totalTicks);
+}
+
+//
+// Search premises only, skipping mutations which the landmarks show can't
+// reach a premise
+//
+TEST_F(SynSearchTest, LemursToCatsLandmarkPruning) {
+  btree_set<uint64_t> emptyKB;
+  syn_search_response unpruned = SynSearch(graph, &emptyKB, factdb, lemursHaveTails, costs, true, opts);
+  BidirectionalGraph bidirectional(ReadMockGraph());
+  LandmarkOracle* landmarks = LandmarkOracle::build(bidirectional, 4);  // (every word)
+  opts.landmarks = landmarks;
+  for (uint8_t i = 0; i < catsHaveTails->length; ++i) {
+    opts.goalWords.push_back(catsHaveTails->word(i));
+  }
+  opts.goalWords.push_back(INVALID_WORD);  // (skipped; it doesn't stop the pruning)
+  syn_search_response response = SynSearch(graph, &emptyKB, factdb, lemursHaveTails, costs, true, opts);
+  ASSERT_EQ(1, response.paths.size());
+  EXPECT_EQ(catsHaveTails->hash(), response.front(0).factHash());
+  EXPECT_LT(response.totalTicks, unpruned.totalTicks);  // (no mutation to potto)
+  // (together with the words which reach a premise, it prunes at least as much)
+  ReachableWords premiseWords(bidirectional, opts.goalWords);
+  opts.premiseWords = &premiseWords;
+  syn_search_response both = SynSearch(graph, &emptyKB, factdb, lemursHaveTails, costs, true, opts);
+  ASSERT_EQ(1, both.paths.size());
+  EXPECT_EQ(catsHaveTails->hash(), both.front(0).factHash());
+  EXPECT_LE(both.totalTicks, response.totalTicks);
+  delete landmarks;
 }
 
 //
@@ -1523,8 +2109,8 @@ TEST_F(SynSearchTest, LemursToAnimalsSoft) {
   factdb.insert(lemursHaveTails->hash());
   syn_search_response response = SynSearch(cyclicGraph, &factdb, animalsHaveTails, costs, true, opts);
   ASSERT_EQ(1, response.paths.size());
-  EXPECT_EQ(animalsHaveTails->hash(), response.paths[0].back().factHash());
-  EXPECT_EQ(lemursHaveTails->hash(), response.paths[0].front().factHash());
+  EXPECT_EQ(animalsHaveTails->hash(), response.back(0).factHash());
+  EXPECT_EQ(lemursHaveTails->hash(), response.front(0).factHash());
 }
 
 
@@ -1536,8 +2122,8 @@ TEST_F(SynSearchTest, LemursToAnimalsStrict) {
   factdb.insert(lemursHaveTails->hash());
   syn_search_response response = SynSearch(cyclicGraph, &factdb, animalsHaveTails, strictCosts, true, opts);
   ASSERT_EQ(1, response.paths.size());
-  EXPECT_EQ(animalsHaveTails->hash(), response.paths[0].back().factHash());
-  EXPECT_EQ(lemursHaveTails->hash(), response.paths[0].front().factHash());
+  EXPECT_EQ(animalsHaveTails->hash(), response.back(0).factHash());
+  EXPECT_EQ(lemursHaveTails->hash(), response.front(0).factHash());
 }
 
 //
@@ -1566,8 +2152,8 @@ TEST_F(SynSearchTest, LemursToCatsSoftAlignSoftWeights) {
       animalsHaveTails, costs, true, opts, alignments);
   // (check that the path is still OK)
   ASSERT_EQ(1, response.paths.size());
-  EXPECT_EQ(animalsHaveTails->hash(), response.paths[0].back().factHash());
-  EXPECT_EQ(lemursHaveTails->hash(), response.paths[0].front().factHash());
+  EXPECT_EQ(animalsHaveTails->hash(), response.back(0).factHash());
+  EXPECT_EQ(lemursHaveTails->hash(), response.front(0).factHash());
   // (check the closest alignment)
 #if MAX_FUZZY_MATCHES > 0
   EXPECT_EQ(0, response.closestSoftAlignment);